@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+#include "clock.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Initial capacity of a group's ring buffer, in elements per lane.
+#define MIN_CAPACITY 16
+
+/// Lockstep execution state of a group of lanes, which share one instruction pointer, loop depth and sequence shape.
+typedef struct group_t
+{
+	/// Ring buffer of interleaved sequence elements, in which element `i` of lane `j` is located at index `i * N_LANES + j`.
+	bignum_t* elements;
+	
+	/// Capacity of the ring buffer, in elements per lane.
+	size_t capacity;
+	
+	/// Index of the first element in the ring buffer.
+	size_t head;
+	
+	/// Number of elements in the sequence of each lane.
+	size_t count;
+	
+	/// Largest number of elements in the sequences so far.
+	size_t peak_count;
+	
+	/// Stack of interleaved loop counters.
+	bignum_t* loop_counters;
+	
+	/// Mask of the lanes which were active when each loop was entered.
+	unsigned* loop_masks;
+	
+	/// Index of the loop end of each entered loop.
+	size_t* loop_ends;
+	
+	/// Number of instructions executed by the group.
+	uint64_t steps;
+	
+	/// Number of instructions executed by the group while each lane was masked.
+	uint64_t masked_steps[N_LANES];
+	
+	/// Number of instructions the group had executed when each masked lane was masked.
+	uint64_t masked_since[N_LANES];
+	
+	/// Mask of the lanes still in lockstep.
+	unsigned live;
+	
+	/// Mask of the lanes executing the current instruction.
+	unsigned active;
+	
+	/// All ones for each active lane and zero otherwise, for masking element operations.
+	bignum_t lane_masks[N_LANES];
+	
+	/// Context of each lane.
+	n_context_t* contexts[N_LANES];
+	
+	/// Status of each lane.
+	int* statuses[N_LANES];
+	
+	/// Time at which the group started, as returned by `n_clock()`.
+	double start_time;
+	
+} group_t;
+
+/// Input of a batch, ordered by length when grouping.
+typedef struct batch_input_t
+{
+	/// Number of elements in the input sequence, or one for the zero singleton.
+	size_t count;
+	
+	/// Index of the input in the batch.
+	size_t index;
+	
+} batch_input_t;
+
+/// Orders batch inputs by length, then by index.
+static int compare_inputs(const void* a, const void* b)
+{
+	const batch_input_t* x = a;
+	const batch_input_t* y = b;
+	if (x->count != y->count)
+		return (x->count < y->count) ? -1 : 1;
+	return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+/// Ensures a group can hold a given number of elements per lane, growing its ring buffer if necessary.
+static int reserve(group_t* group, size_t count)
+{
+	if (count <= group->capacity)
+		return N_SUCCESS;
+	
+	size_t capacity = (group->capacity) ? group->capacity : MIN_CAPACITY;
+	while (capacity < count)
+		capacity <<= 1;
+	
+	bignum_t* elements = malloc(capacity * N_LANES * sizeof(bignum_t));
+	if (!elements)
+		return N_ERROR_MEMORY;
+	
+	// Copy sequences into new ring buffer, starting at index zero
+	for (size_t i = 0; i < group->count; ++i)
+		memcpy(elements + i * N_LANES, group->elements + ((group->head + i) & (group->capacity - 1)) * N_LANES, N_LANES * sizeof(bignum_t));
+	
+	free(group->elements);
+	group->elements = elements;
+	group->capacity = capacity;
+	group->head = 0;
+	
+	return N_SUCCESS;
+}
+
+/// Changes the mask of active lanes, keeping count of the instructions for which each lane was masked.
+static void set_active(group_t* group, unsigned active, uint64_t steps)
+{
+	for (size_t j = 0; j < N_LANES; ++j)
+	{
+		unsigned bit = 1u << j;
+		if ((group->active & bit) && !(active & bit))
+			group->masked_since[j] = steps;
+		else if (!(group->active & bit) && (active & bit))
+			group->masked_steps[j] += steps - group->masked_since[j];
+		group->lane_masks[j] = (active & bit) ? ~(bignum_t)0 : 0;
+	}
+	group->active = active;
+}
+
+/**
+ * Splits a lane off from its group into its own context, then continues it there unless it was interrupted or ran out of time.
+ *
+ * @param group Group of lanes.
+ * @param program Program the group is running.
+ * @param lane Index of the lane.
+ * @param ip Index of the next instruction of the group.
+ * @param loop_depth Loop depth of the group.
+ */
+static void split(group_t* group, const n_program_t* program, size_t lane, size_t ip, size_t loop_depth)
+{
+	unsigned bit = 1u << lane;
+	uint64_t steps = group->steps;
+	if (!(group->active & bit))
+	{
+		// A masked lane continues after the innermost loop which it entered or skipped while active
+		while (loop_depth > 1 && !(group->loop_masks[loop_depth] & bit))
+			--loop_depth;
+		ip = group->loop_ends[loop_depth--] + 1;
+		steps = group->masked_since[lane];
+	}
+	steps -= group->masked_steps[lane];
+	
+	// Copy the lane's sequence and loop counters into its context
+	n_context_t* context = group->contexts[lane];
+	int status = N_ERROR_MEMORY;
+	context->count = 0;
+	context->head = 0;
+	if (n_context_prepare(context, program, group->count) == N_SUCCESS)
+	{
+		for (size_t i = 0; i < group->count; ++i)
+			context->elements[i] = group->elements[((group->head + i) & (group->capacity - 1)) * N_LANES + lane];
+		for (size_t i = 1; i <= loop_depth; ++i)
+			context->loop_counters[i] = group->loop_counters[i * N_LANES + lane];
+		context->count = group->count;
+		context->peak_count = group->peak_count;
+		context->steps = steps;
+		context->ip = ip;
+		context->loop_depth = loop_depth;
+		
+		// Continue the lane alone, with its time limit reduced by the time spent in lockstep
+		double max_time = context->limits.max_time;
+		double elapsed = (max_time > 0.0) ? n_clock() - group->start_time : 0.0;
+		if (ip < program->instruction_count && context->interrupt && *context->interrupt)
+		{
+			status = N_INTERRUPTED;
+		}
+		else if (ip < program->instruction_count && max_time > 0.0 && elapsed >= max_time)
+		{
+			status = N_ERROR_TIME_LIMIT;
+		}
+		else
+		{
+			context->limits.max_time -= elapsed;
+			status = n_context_resume(context, program);
+			context->limits.max_time = max_time;
+		}
+	}
+	
+	*group->statuses[lane] = status;
+	group->live &= ~bit;
+	group->active &= ~bit;
+	group->lane_masks[lane] = 0;
+}
+
+/// Splits off every lane of a group which is still in lockstep, or only those which are masked.
+static void split_lanes(group_t* group, const n_program_t* program, size_t ip, size_t loop_depth, int masked_only)
+{
+	unsigned lanes = (masked_only) ? group->live & ~group->active : group->live;
+	for (size_t j = 0; j < N_LANES; ++j)
+		if (lanes & (1u << j))
+			split(group, program, j, ip, loop_depth);
+}
+
+/// Runs a program on the lanes of a group in lockstep, splitting them off as they diverge, and finally splitting off those which finished together.
+static void run_group(group_t* group, const n_program_t* program)
+{
+	const n_instruction_t* instructions = program->instructions;
+	const size_t instruction_count = program->instruction_count;
+	size_t loop_depth = 0;
+	
+	// Find the lowest limits of the lanes, before which they are split off so that each stops as it would have alone
+	uint64_t max_steps = UINT64_MAX;
+	size_t max_elements = SIZE_MAX;
+	int timed = 0;
+	for (size_t j = 0; j < N_LANES; ++j)
+	{
+		if (!(group->live & (1u << j)))
+			continue;
+		const n_context_t* context = group->contexts[j];
+		if (context->limits.max_steps && context->limits.max_steps < max_steps)
+			max_steps = context->limits.max_steps;
+		if (context->limits.max_elements && context->limits.max_elements < max_elements)
+			max_elements = context->limits.max_elements;
+		if (context->limits.max_time > 0.0 || context->interrupt)
+			timed = 1;
+	}
+	uint64_t check_steps = (timed && N_CHECK_INTERVAL < max_steps) ? N_CHECK_INTERVAL : max_steps;
+	
+	size_t ip = 0;
+	for (; ip < instruction_count && group->live; ++ip, ++group->steps)
+	{
+		uint32_t opcode = instructions[ip].opcode;
+		bignum_t operand = instructions[ip].operand;
+		
+		// Masked lanes keep the shape of their sequences, so they are split off before the group's shape changes
+		if (group->active != group->live &&
+			(opcode == N_OP_SHIFT_LEFT || opcode == N_OP_SHIFT_RIGHT || opcode == N_OP_APPEND || opcode == N_OP_TRUNCATE))
+			split_lanes(group, program, ip, loop_depth, 1);
+		
+		size_t mask = group->capacity - 1;
+		bignum_t* first = group->elements + group->head * N_LANES;
+		const bignum_t* lane_masks = group->lane_masks;
+		
+		switch (opcode)
+		{
+			case N_OP_ADD:
+				for (size_t j = 0; j < N_LANES; ++j)
+					first[j] += operand & lane_masks[j];
+				break;
+			
+			case N_OP_SUB:
+				for (size_t j = 0; j < N_LANES; ++j)
+				{
+					bignum_t value = first[j];
+					bignum_t difference = (value > operand) ? value - operand : 0;
+					first[j] = (difference & lane_masks[j]) | (value & ~lane_masks[j]);
+				}
+				break;
+			
+			case N_OP_SHIFT_LEFT:
+				if (group->count == group->capacity)
+				{
+					group->head = (group->head + operand) & mask;
+				}
+				else
+				{
+					for (operand %= group->count; operand; --operand)
+					{
+						memcpy(group->elements + ((group->head + group->count) & mask) * N_LANES, group->elements + group->head * N_LANES, N_LANES * sizeof(bignum_t));
+						group->head = (group->head + 1) & mask;
+					}
+				}
+				break;
+			
+			case N_OP_SHIFT_RIGHT:
+				if (group->count == group->capacity)
+				{
+					group->head = (group->head - operand) & mask;
+				}
+				else
+				{
+					for (operand %= group->count; operand; --operand)
+					{
+						group->head = (group->head - 1) & mask;
+						memcpy(group->elements + group->head * N_LANES, group->elements + ((group->head + group->count) & mask) * N_LANES, N_LANES * sizeof(bignum_t));
+					}
+				}
+				break;
+			
+			case N_OP_COUNT:
+				for (size_t j = 0; j < N_LANES; ++j)
+					first[j] = (group->count & lane_masks[j]) | (first[j] & ~lane_masks[j]);
+				break;
+			
+			case N_OP_APPEND:
+				// Lanes append alone if an element limit could be reached
+				if (operand > max_elements - group->count)
+				{
+					split_lanes(group, program, ip, loop_depth, 0);
+					break;
+				}
+				if (operand > group->capacity - group->count)
+				{
+					if (reserve(group, group->count + operand) != N_SUCCESS)
+					{
+						for (size_t j = 0; j < N_LANES; ++j)
+							if (group->live & (1u << j))
+								*group->statuses[j] = N_ERROR_MEMORY;
+						group->live = 0;
+						break;
+					}
+					mask = group->capacity - 1;
+					first = group->elements + group->head * N_LANES;
+				}
+				for (; operand; --operand)
+					memcpy(group->elements + ((group->head + group->count++) & mask) * N_LANES, first, N_LANES * sizeof(bignum_t));
+				if (group->count > group->peak_count)
+					group->peak_count = group->count;
+				break;
+			
+			case N_OP_TRUNCATE:
+				group->count -= (operand < group->count) ? operand : group->count - 1;
+				break;
+			
+			case N_OP_LOOP_START:
+			{
+				unsigned entering = 0;
+				for (size_t j = 0; j < N_LANES; ++j)
+					entering |= (unsigned)(first[j] != 0) << j;
+				entering &= group->active;
+				
+				if (entering)
+				{
+					// Lanes which skip the loop are masked until the others leave it
+					++loop_depth;
+					group->loop_masks[loop_depth] = group->active;
+					group->loop_ends[loop_depth] = operand;
+					memcpy(group->loop_counters + loop_depth * N_LANES, first, N_LANES * sizeof(bignum_t));
+					if (entering != group->active)
+						set_active(group, entering, group->steps + 1);
+				}
+				else
+				{
+					ip = operand;
+				}
+				break;
+			}
+			
+			case N_OP_LOOP_END:
+			{
+				// Split off lanes before they could reach a limit or be interrupted, leaving them to execute the loop end alone
+				if (group->steps >= check_steps)
+				{
+					int stop = (group->steps >= max_steps);
+					for (size_t j = 0; j < N_LANES && !stop; ++j)
+					{
+						const n_context_t* context = group->contexts[j];
+						if ((group->live & (1u << j)) &&
+							((context->interrupt && *context->interrupt) ||
+							(context->limits.max_time > 0.0 && n_clock() - group->start_time >= context->limits.max_time)))
+							stop = 1;
+					}
+					if (stop)
+					{
+						split_lanes(group, program, ip, loop_depth, 0);
+						break;
+					}
+					
+					check_steps = (group->steps + N_CHECK_INTERVAL < max_steps) ? group->steps + N_CHECK_INTERVAL : max_steps;
+				}
+				
+				// Lanes whose loop counters run out are masked until the others leave the loop
+				bignum_t* loop_counters = group->loop_counters + loop_depth * N_LANES;
+				unsigned running = 0;
+				for (size_t j = 0; j < N_LANES; ++j)
+					running |= (unsigned)(loop_counters[j] != 1) << j;
+				running &= group->active;
+				
+				// A lane which would run on with every other lane masked is faster alone, so the group is split
+				if (running && !(running & (running - 1)) && group->live != running)
+				{
+					split_lanes(group, program, ip, loop_depth, 0);
+					break;
+				}
+				
+				for (size_t j = 0; j < N_LANES; ++j)
+					loop_counters[j] -= lane_masks[j] & 1;
+				
+				if (running)
+				{
+					if (running != group->active)
+						set_active(group, running, group->steps + 1);
+					ip = operand;
+				}
+				else
+				{
+					set_active(group, group->loop_masks[loop_depth] & group->live, group->steps + 1);
+					--loop_depth;
+				}
+				break;
+			}
+		}
+	}
+	
+	// Lanes which finished together are split off at the end of the program
+	split_lanes(group, program, ip, loop_depth, 0);
+}
+
+/// Returns whether a run can be grouped with others, rather than run alone.
+static int groupable(const n_context_t* context, size_t input_count)
+{
+	return !context->profile && !context->sampler && !(context->limits.max_elements && input_count > context->limits.max_elements);
+}
+
+int n_batch_run(const n_program_t* program, n_context_t** contexts, const bignum_t* const* inputs, const size_t* input_counts, size_t count, int* statuses)
+{
+	// Allocate group storage
+	batch_input_t* order = malloc((count + 1) * sizeof(batch_input_t));
+	group_t* group = calloc(1, sizeof(group_t));
+	if (group)
+	{
+		group->loop_counters = malloc((program->max_loop_depth + 1) * N_LANES * sizeof(bignum_t));
+		group->loop_masks = malloc((program->max_loop_depth + 1) * sizeof(unsigned));
+		group->loop_ends = malloc((program->max_loop_depth + 1) * sizeof(size_t));
+	}
+	int grouping = (order && group && group->loop_counters && group->loop_masks && group->loop_ends);
+	
+	// Order the inputs which can be grouped by length, and run the rest alone
+	size_t grouped_count = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (grouping && groupable(contexts[i], input_counts[i]))
+		{
+			order[grouped_count].count = (input_counts[i]) ? input_counts[i] : 1;
+			order[grouped_count++].index = i;
+		}
+		else
+		{
+			statuses[i] = n_context_run(contexts[i], program, inputs[i], input_counts[i]);
+		}
+	}
+	if (grouped_count)
+		qsort(order, grouped_count, sizeof(batch_input_t), compare_inputs);
+	
+	// Run groups of inputs of equal length in lockstep
+	for (size_t i = 0; i < grouped_count;)
+	{
+		size_t lane_count = 1;
+		while (lane_count < N_LANES && i + lane_count < grouped_count && order[i + lane_count].count == order[i].count)
+			++lane_count;
+		
+		// Inputs without others of their length are run alone
+		size_t length = order[i].count;
+		if (lane_count == 1 || reserve(group, length) != N_SUCCESS)
+		{
+			for (size_t j = 0; j < lane_count; ++j)
+			{
+				size_t index = order[i + j].index;
+				statuses[index] = n_context_run(contexts[index], program, inputs[index], input_counts[index]);
+			}
+			i += lane_count;
+			continue;
+		}
+		
+		// Load interleaved input sequences, with unused lanes zeroed
+		group->head = 0;
+		group->count = length;
+		group->peak_count = length;
+		group->steps = 0;
+		group->live = (1u << lane_count) - 1;
+		group->active = group->live;
+		group->start_time = n_clock();
+		memset(group->elements, 0, length * N_LANES * sizeof(bignum_t));
+		for (size_t j = 0; j < N_LANES; ++j)
+		{
+			group->masked_steps[j] = 0;
+			group->masked_since[j] = 0;
+			group->lane_masks[j] = (j < lane_count) ? ~(bignum_t)0 : 0;
+			if (j >= lane_count)
+				continue;
+			
+			size_t index = order[i + j].index;
+			group->contexts[j] = contexts[index];
+			group->statuses[j] = &statuses[index];
+			for (size_t k = 0; k < input_counts[index]; ++k)
+				group->elements[k * N_LANES + j] = inputs[index][k];
+		}
+		
+		run_group(group, program);
+		i += lane_count;
+	}
+	
+	if (group)
+	{
+		free(group->elements);
+		free(group->loop_counters);
+		free(group->loop_masks);
+		free(group->loop_ends);
+		free(group);
+	}
+	free(order);
+	
+	// Report the first run which did not succeed
+	for (size_t i = 0; i < count; ++i)
+		if (statuses[i] != N_SUCCESS)
+			return statuses[i];
+	return N_SUCCESS;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_BATCH_H
+#define N_BATCH_H
+
+#include <stddef.h>
+#include "bignum.h"
+#include "context.h"
+#include "program.h"
+
+/// Number of inputs which are run in lockstep through the same instructions.
+#define N_LANES 8
+
+/**
+ * Runs a program on a batch of input sequences, leaving the result of each in its own context as if it had been run with `n_context_run()`.
+ *
+ * Inputs of equal length are run in groups of up to `N_LANES` lanes, which execute each instruction together with their elements interleaved, so that operations on the first element of every lane are a single vector operation. Lanes whose loop counters run out are masked until the rest of the group leaves the loop. A lane is split off into scalar execution in its own context when its sequence would diverge in shape from the group, which happens when the group shifts, appends to or truncates its sequences while the lane is masked, and every lane is split off when a limit may be reached or the run is interrupted. Inputs which cannot be grouped, and contexts which record a profile or sampler, are run alone.
+ *
+ * @param program Compiled program.
+ * @param contexts Execution context of each input, whose limits and interrupt flag apply to its run.
+ * @param inputs Array of each input sequence. If empty, an input sequence will be the zero singleton.
+ * @param input_counts Number of elements in each input sequence.
+ * @param count Number of input sequences.
+ * @param[out] statuses Status of each run, as returned by `n_context_run()`.
+ *
+ * @return `N_SUCCESS` if every run succeeded, otherwise the status of the first run which did not.
+ */
+int n_batch_run(const n_program_t* program, n_context_t** contexts, const bignum_t* const* inputs, const size_t* input_counts, size_t count, int* statuses);
+
+#endif // N_BATCH_H
@@ -16,78 +16,633 @@
  * You should have received a copy of the GNU General Public License
  * along with bin2n.  If not, see <http://www.gnu.org/licenses/>.
  */
+#if defined(__unix__) || defined(__APPLE__)
+	#define BIN2N_SYSCONF
+	#include <unistd.h>
+#endif
 
+#if defined(BIN2N_THREADS)
+	#include <pthread.h>
+#endif
+
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "bin2n.h"
+#include "constant.h"
 
 #define ERROR_ARGC 1
 #define ERROR_INPUT 2
 #define ERROR_OUTPUT 3
 #define ERROR_FWRITE 4
+#define ERROR_MEMORY 5
+#define ERROR_FREAD 6
 
-int main(int argc, char* argv[])
+/// Number of input bytes converted by each thread at a time.
+#define CHUNK_SIZE (256 * 1024)
+
+/// Number of allocation operators written at a time.
+#define CONS_BLOCK_SIZE (64 * 1024)
+
+/// Largest number of input bytes which can be packed into each element.
+#define MAX_WORD_SIZE 2
+
+/// Longest period of repeated blocks of words, which are built by loops.
+#define MAX_PERIOD 64
+
+/// Largest number of copies of a repeated word appended by each iteration of a loop.
+#define MAX_COPIES 64
+
+/// Number of input bytes before each chunk in which repeated blocks are found.
+#define HISTORY_SIZE (MAX_PERIOD * MAX_WORD_SIZE)
+
+/// Number of entries in the hash table of the most recent position of each sequence of four words, by which repeated blocks are found.
+#define RECENT_SIZE 4096
+
+/// Operations which build every value of an input word.
+typedef struct encoding_t
 {
-	FILE* input, *output;
-	unsigned char index;
-	int write_success = 1;
+	/// Number of input bytes packed into each element, in little-endian order.
+	size_t word_size;
+	
+	/// Operations which build each value.
+	const char* const* operations;
+	
+	/// Number of operators which build each value.
+	const size_t* lengths;
+	
+} encoding_t;
+
+/// Chunk of input bytes, which is converted to operations by one thread.
+typedef struct chunk_t
+{
+	/// Operations which build each input word.
+	const encoding_t* encoding;
+	
+	/// Input bytes, preceded by `history` bytes of earlier input.
+	const unsigned char* input;
+	
+	/// Number of input bytes.
 	size_t input_size;
-	const char op_cons = ':';
-	const char op_lshift = '<';
 	
-	if (argc != 2 && argc != 3)
+	/// Number of bytes of earlier input before the chunk.
+	size_t history;
+	
+	/// Input words, preceded by the words of earlier input.
+	size_t* words;
+	
+	/// Number of operators which build each prefix of the words of a repeated block as separate elements.
+	size_t* prefix_lengths;
+	
+	/// Buffer of operations, large enough for the longest operations of every word.
+	char* output;
+	
+	/// Non-zero to write operations to the buffer, or zero to only count them.
+	int write;
+	
+	/// Number of operations written to the buffer.
+	size_t output_size;
+	
+	/// Number of elements built in preallocated elements, each of which must be allocated before the first chunk.
+	size_t slot_count;
+	
+	/// Non-zero if a loop counter was built in a preallocated element, which must be allocated and then truncated.
+	int counted;
+	
+	#if defined(BIN2N_THREADS)
+		/// Thread which converts the chunk.
+		pthread_t thread;
+		
+		/// Non-zero if the thread was started.
+		int started;
+	#endif
+	
+} chunk_t;
+
+/// Reads the input one block at a time, converts the chunks of each block in parallel, then writes their operations in order, or only counts the elements which they build if the output is `0`. Returns zero or an error code.
+int convert_input(FILE* input, FILE* output, unsigned char* input_buffer, chunk_t* chunks, size_t thread_count, size_t* slot_count, int* counted);
+
+/// Converts a chunk of input bytes to the operations which build each word at the end of the sequence. Words are built in preallocated elements, or as copies of the previous word adjusted by a small difference, and runs and repeated blocks of words are built by loops which append copies.
+void* convert_chunk(void* argument);
+
+/// Synthesizes the operations of every 16-bit value into an encoding, and returns zero or `ERROR_MEMORY`.
+int create_word_encoding(encoding_t* encoding, char** buffer);
+
+/// Deallocates the operations of an encoding created by `create_word_encoding()`.
+void free_word_encoding(encoding_t* encoding, char* buffer);
+
+/// Prints the usage string.
+void usage();
+
+int main(int argc, char* argv[])
+{
+	const char* input_path = 0;
+	const char* output_path = 0;
+	size_t thread_count = 1;
+	size_t word_size = 1;
+	
+	#if defined(BIN2N_SYSCONF) && defined(BIN2N_THREADS)
+		long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+		if (processor_count > 0)
+			thread_count = (size_t)processor_count;
+	#endif
+	
+	// Read arguments
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			thread_count = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--word-size") && i + 1 < argc)
+			word_size = strtoull(argv[++i], 0, 10);
+		else if (!input_path)
+			input_path = argv[i];
+		else if (!output_path)
+			output_path = argv[i];
+		else
+		{
+			usage();
+			return ERROR_ARGC;
+		}
+	}
+	if (!input_path || !word_size || word_size > MAX_WORD_SIZE)
 	{
-		printf("Usage: bin2n <input file> [output file]\n");
+		usage();
 		return ERROR_ARGC;
 	}
+	if (!thread_count)
+		thread_count = 1;
+	#if !defined(BIN2N_THREADS)
+		thread_count = 1;
+	#endif
 	
 	// Open input file
-	input = fopen(argv[1], "rb");
+	FILE* input = fopen(input_path, "rb");
 	if (!input)
 	{
-		printf("Failed to open input file \"%s\"\n", argv[1]);
+		printf("Failed to open input file \"%s\"\n", input_path);
 		return ERROR_INPUT;
 	}
 	
 	// Determine size of input file
 	fseek(input, 0, SEEK_END);
-	input_size = ftell(input);
+	size_t input_size = ftell(input);
 	rewind(input);
 	
 	// Open output file or stdout
-	output = (argc == 3) ? fopen(argv[2], "wb") : stdout;
+	FILE* output = (output_path) ? fopen(output_path, "wb") : stdout;
 	if (!output)
 	{
-		printf("Failed to open output file \"%s\"", argv[2]);
+		printf("Failed to open output file \"%s\"\n", output_path);
+		fclose(input);
 		return ERROR_OUTPUT;
 	}
 	
-	// Write clear sequence to output
-	write_success = (fwrite(bin2n_clear_sequence, 1, strlen(bin2n_clear_sequence), output) == strlen(bin2n_clear_sequence));
+	// Build bytes from the 8-bit table, or wider words from synthesized operations
+	encoding_t encoding = {word_size, bin2n_operations, bin2n_lengths};
+	char* encoding_buffer = 0;
+	int error = (word_size > 1) ? create_word_encoding(&encoding, &encoding_buffer) : 0;
+	
+	// Allocate one input buffer for all chunks, after the history of the previous block, and output and word buffers for each chunk
+	size_t value_count = (size_t)1 << (8 * word_size);
+	size_t max_length = 0;
+	for (size_t i = 0; i < value_count && !error; ++i)
+		if (encoding.lengths[i] > max_length)
+			max_length = encoding.lengths[i];
+	unsigned char* input_buffer = malloc(HISTORY_SIZE + thread_count * CHUNK_SIZE);
+	chunk_t* chunks = calloc(thread_count, sizeof(chunk_t));
+	if (!error && (!input_buffer || !chunks))
+		error = ERROR_MEMORY;
+	for (size_t i = 0; i < thread_count && !error; ++i)
+	{
+		size_t word_count = CHUNK_SIZE / word_size;
+		chunks[i].encoding = &encoding;
+		chunks[i].output = malloc(word_count * (max_length + 2));
+		chunks[i].words = malloc((MAX_PERIOD + word_count) * sizeof(size_t));
+		chunks[i].prefix_lengths = malloc((word_count + 1) * sizeof(size_t));
+		if (!chunks[i].output || !chunks[i].words || !chunks[i].prefix_lengths)
+			error = ERROR_MEMORY;
+	}
+	
+	// Count the elements which must be preallocated, by converting the input once without writing it
+	size_t slot_count = 0;
+	int counted = 0;
+	if (!error)
+		error = convert_input(input, 0, input_buffer, chunks, thread_count, &slot_count, &counted);
+	rewind(input);
+	
+	// Packed words are followed by an element holding the number of input bytes in the last word, so that the unpacked output has the length of the input
+	size_t last_word_size = (input_size) ? input_size - (input_size - 1) / word_size * word_size : 0;
+	int trailer = (word_size > 1 && input_size);
+	size_t element_count = slot_count + trailer + counted;
 	
-	// Write allocation operations
-	for (size_t i = 1; (i < input_size) && write_success; ++i)
-		write_success = (fwrite(&op_cons, 1, 1, output) == 1);
+	// Write clear sequence and allocation operations, one block at a time
+	if (!error)
+	{
+		static char cons_block[CONS_BLOCK_SIZE];
+		memset(cons_block, ':', CONS_BLOCK_SIZE);
+		size_t length = strlen(bin2n_clear_sequence);
+		if (fwrite(bin2n_clear_sequence, 1, length, output) != length)
+			error = ERROR_FWRITE;
+		for (size_t remaining = (element_count) ? element_count - 1 : 0; remaining && !error;)
+		{
+			length = (remaining < CONS_BLOCK_SIZE) ? remaining : CONS_BLOCK_SIZE;
+			if (fwrite(cons_block, 1, length, output) != length)
+				error = ERROR_FWRITE;
+			remaining -= length;
+		}
+	}
 	
-	// Translate input bytes to operations, then write to output
-	while (write_success && fread(&index, 1, 1, input))
+	// Convert and write the input
+	if (!error)
+		error = convert_input(input, output, input_buffer, chunks, thread_count, &slot_count, &counted);
+	
+	// Write the length of the last word, and truncate the element of the loop counters
+	if (!error && trailer)
 	{
-		write_success = (fwrite(bin2n_operations[index], 1, bin2n_lengths[index], output) == bin2n_lengths[index]);
-		if (write_success)
-			write_success = (fwrite(&op_lshift, 1, 1, output) == 1);
+		size_t length = encoding.lengths[last_word_size];
+		if (fwrite(encoding.operations[last_word_size], 1, length, output) != length || fputc('<', output) == EOF)
+			error = ERROR_FWRITE;
 	}
+	if (!error && counted && fputs("<|", output) == EOF)
+		error = ERROR_FWRITE;
 	
-	// Close input and output file streams
+	// Free buffers, and close input and output file streams
+	for (size_t i = 0; chunks && i < thread_count; ++i)
+	{
+		free(chunks[i].output);
+		free(chunks[i].words);
+		free(chunks[i].prefix_lengths);
+	}
+	free(chunks);
+	free(input_buffer);
+	if (encoding_buffer)
+		free_word_encoding(&encoding, encoding_buffer);
 	fclose(input);
-	if (argc == 3)
+	if (!error && ((output_path && fclose(output)) || (!output_path && fflush(output))))
+		error = ERROR_FWRITE;
+	else if (error && output_path)
 		fclose(output);
 	
-	if (!write_success)
-	{
+	if (error == ERROR_MEMORY)
+		printf("Failed to allocate memory\n");
+	else if (error == ERROR_FREAD)
+		printf("Failed to read input file \"%s\"\n", input_path);
+	else if (error == ERROR_FWRITE)
 		printf("Failed to write data to output\n");
-		return ERROR_FWRITE;
+	
+	return (error) ? error : EXIT_SUCCESS;
+}
+
+int convert_input(FILE* input, FILE* output, unsigned char* input_buffer, chunk_t* chunks, size_t thread_count, size_t* slot_count, int* counted)
+{
+	*slot_count = 0;
+	*counted = 0;
+	
+	// Each block is read after the history of earlier blocks
+	unsigned char* block = input_buffer + HISTORY_SIZE;
+	size_t history = 0;
+	size_t block_size;
+	while ((block_size = fread(block, 1, thread_count * CHUNK_SIZE, input)) > 0)
+	{
+		size_t chunk_count = 0;
+		for (size_t offset = 0; offset < block_size; offset += CHUNK_SIZE)
+		{
+			chunk_t* chunk = &chunks[chunk_count++];
+			chunk->input = block + offset;
+			chunk->input_size = (block_size - offset < CHUNK_SIZE) ? block_size - offset : CHUNK_SIZE;
+			chunk->history = (offset) ? HISTORY_SIZE : history;
+			chunk->write = (output != 0);
+		}
+		
+		#if defined(BIN2N_THREADS)
+			for (size_t i = 1; i < chunk_count; ++i)
+				chunks[i].started = !pthread_create(&chunks[i].thread, 0, convert_chunk, &chunks[i]);
+			convert_chunk(&chunks[0]);
+			for (size_t i = 1; i < chunk_count; ++i)
+			{
+				if (chunks[i].started)
+					pthread_join(chunks[i].thread, 0);
+				else
+					convert_chunk(&chunks[i]);
+			}
+		#else
+			for (size_t i = 0; i < chunk_count; ++i)
+				convert_chunk(&chunks[i]);
+		#endif
+		
+		for (size_t i = 0; i < chunk_count; ++i)
+		{
+			*slot_count += chunks[i].slot_count;
+			*counted |= chunks[i].counted;
+			if (output && fwrite(chunks[i].output, 1, chunks[i].output_size, output) != chunks[i].output_size)
+				return ERROR_FWRITE;
+		}
+		
+		// Keep the end of the block as the history of the next, which is only short at the end of the input
+		if (block_size >= HISTORY_SIZE)
+		{
+			memcpy(input_buffer, block + block_size - HISTORY_SIZE, HISTORY_SIZE);
+			history = HISTORY_SIZE;
+		}
+	}
+	
+	return (ferror(input)) ? ERROR_FREAD : 0;
+}
+
+/// Writes operators to the output buffer of a chunk, or only counts them.
+static void put_operators(chunk_t* chunk, const char* operators, size_t length)
+{
+	if (chunk->write)
+		memcpy(chunk->output + chunk->output_size, operators, length);
+	chunk->output_size += length;
+}
+
+/// Writes an operator a number of times to the output buffer of a chunk, or only counts them.
+static void put_repeated(chunk_t* chunk, char op, size_t count)
+{
+	if (chunk->write)
+		memset(chunk->output + chunk->output_size, op, count);
+	chunk->output_size += count;
+}
+
+/// Returns the number of operators which build a word in a preallocated element, including its allocation and shift.
+static size_t slot_length(const encoding_t* encoding, size_t word)
+{
+	return encoding->lengths[word] + 2;
+}
+
+/// Returns the number of operators which build a word from a copy of the previous word, by appending the copy and adding or subtracting their difference.
+static size_t delta_length(size_t previous, size_t word)
+{
+	return ((word > previous) ? word - previous : previous - word) + 3;
+}
+
+/// Returns the number of operators which build a word as a separate element, after the previous word if any.
+static size_t word_length(const encoding_t* encoding, const size_t* words, ptrdiff_t index, int has_previous)
+{
+	size_t length = slot_length(encoding, words[index]);
+	if (has_previous && delta_length(words[index - 1], words[index]) < length)
+		length = delta_length(words[index - 1], words[index]);
+	return length;
+}
+
+/// Returns the number of operators which build a word from a copy of the previous word which is cleared, by appending the copy and rebuilding it.
+static size_t rebuild_length(const encoding_t* encoding, size_t word)
+{
+	return encoding->lengths[word] + 6;
+}
+
+/// Returns the number of operators which build a word inside a loop body, from a copy of the previous word which is either adjusted or cleared and rebuilt.
+static size_t body_length(const encoding_t* encoding, size_t previous, size_t word)
+{
+	size_t length = rebuild_length(encoding, word);
+	return (delta_length(previous, word) < length) ? delta_length(previous, word) : length;
+}
+
+/// Returns the hash table entry of the sequence of four words at an index.
+static size_t recent_entry(const size_t* words, ptrdiff_t index)
+{
+	size_t hash = words[index];
+	hash = hash * 0x9E3779B1u + words[index + 1];
+	hash = hash * 0x9E3779B1u + words[index + 2];
+	hash = hash * 0x9E3779B1u + words[index + 3];
+	return (hash * 0x9E3779B1u >> 12) & (RECENT_SIZE - 1);
+}
+
+/// Writes the operations which build a word from a copy of the previous word, either adjusted or cleared and rebuilt.
+static void put_copy(chunk_t* chunk, size_t previous, size_t word, int rebuild)
+{
+	put_operators(chunk, ">:", 2);
+	if (rebuild)
+	{
+		put_operators(chunk, "[-]", 3);
+		put_operators(chunk, chunk->encoding->operations[word], chunk->encoding->lengths[word]);
+	}
+	else
+	{
+		put_repeated(chunk, (word > previous) ? '+' : '-', (word > previous) ? word - previous : previous - word);
+	}
+	put_operators(chunk, "<", 1);
+}
+
+void* convert_chunk(void* argument)
+{
+	chunk_t* chunk = argument;
+	const encoding_t* encoding = chunk->encoding;
+	size_t word_size = encoding->word_size;
+	size_t max_count = ((size_t)1 << (8 * word_size)) - 1;
+	chunk->output_size = 0;
+	chunk->slot_count = 0;
+	chunk->counted = 0;
+	
+	// Pack bytes in little-endian order, where the last word of the input may be short
+	ptrdiff_t history = (ptrdiff_t)((chunk->history / word_size < MAX_PERIOD) ? chunk->history / word_size : MAX_PERIOD);
+	size_t word_count = (chunk->input_size + word_size - 1) / word_size;
+	size_t* words = chunk->words + MAX_PERIOD;
+	for (ptrdiff_t i = -history; i < (ptrdiff_t)word_count; ++i)
+	{
+		size_t word = 0;
+		for (size_t j = 0; j < word_size && i * (ptrdiff_t)word_size + (ptrdiff_t)j < (ptrdiff_t)chunk->input_size; ++j)
+			word |= (size_t)chunk->input[i * (ptrdiff_t)word_size + (ptrdiff_t)j] << (8 * j);
+		words[i] = word;
+	}
+	
+	// Blocks which repeat at least twice start with four words which occurred within the longest period, so only runs and the most recent occurrence of those words are tried
+	ptrdiff_t recent[RECENT_SIZE];
+	for (size_t i = 0; i < RECENT_SIZE; ++i)
+		recent[i] = PTRDIFF_MIN;
+	ptrdiff_t recent_count = -history;
+	
+	size_t* prefix_lengths = chunk->prefix_lengths;
+	for (size_t i = 0; i < word_count;)
+	{
+		int has_previous = (i || history);
+		
+		size_t periods[2] = {1, 0};
+		if (i + 3 < word_count)
+		{
+			for (; recent_count < (ptrdiff_t)i; ++recent_count)
+				recent[recent_entry(words, recent_count)] = recent_count;
+			ptrdiff_t last = recent[recent_entry(words, i)];
+			if (last != PTRDIFF_MIN && (ptrdiff_t)i - last > 1 && (ptrdiff_t)i - last <= MAX_PERIOD)
+				periods[1] = (size_t)((ptrdiff_t)i - last);
+		}
+		
+		// Find the repeated block, or run of copies of the previous word, which saves the most operators over building its words separately. The first loop must also pay for allocating and truncating the element of its counter.
+		size_t counter_length = (chunk->counted) ? 0 : 3;
+		size_t best_saving = 0;
+		size_t best_period = 0;
+		size_t best_count = 0;
+		size_t best_copies = 0;
+		for (size_t p = 0; p < 2; ++p)
+		{
+			size_t period = periods[p];
+			if (!period || (ptrdiff_t)period > (ptrdiff_t)i + history || words[i] != words[(ptrdiff_t)i - (ptrdiff_t)period])
+				continue;
+			
+			size_t limit = (period == 1) ? MAX_COPIES * max_count : period * max_count;
+			size_t match = 0;
+			prefix_lengths[0] = 0;
+			while (i + match < word_count && match < limit && words[i + match] == words[(ptrdiff_t)(i + match) - (ptrdiff_t)period])
+			{
+				prefix_lengths[match + 1] = prefix_lengths[match] + word_length(encoding, words, i + match, 1);
+				++match;
+			}
+			
+			if (period == 1)
+			{
+				// Append copies of the previous word at once
+				if (prefix_lengths[match] > match + 2 && prefix_lengths[match] - (match + 2) > best_saving)
+				{
+					best_saving = prefix_lengths[match] - (match + 2);
+					best_period = 1;
+					best_count = 0;
+					best_copies = match;
+				}
+				
+				// Append copies in a loop, with a counter in the next preallocated element which is cleared afterwards
+				for (size_t copies = 1; copies <= MAX_COPIES && copies * 2 <= match; ++copies)
+				{
+					size_t count = (match / copies < max_count) ? match / copies : max_count;
+					size_t length = encoding->lengths[count] + copies + 7 + counter_length;
+					if (prefix_lengths[count * copies] > length && prefix_lengths[count * copies] - length > best_saving)
+					{
+						best_saving = prefix_lengths[count * copies] - length;
+						best_period = 1;
+						best_count = count;
+						best_copies = copies;
+					}
+				}
+			}
+			else if (match >= period * 2)
+			{
+				// Append copies of the block in a loop, each word from a copy of the word before it
+				size_t count = (match / period < max_count) ? match / period : max_count;
+				size_t length = encoding->lengths[count] + 5 + counter_length;
+				for (size_t j = 0; j < period; ++j)
+					length += body_length(encoding, words[i + j - 1], words[i + j]);
+				if (prefix_lengths[count * period] > length && prefix_lengths[count * period] - length > best_saving)
+				{
+					best_saving = prefix_lengths[count * period] - length;
+					best_period = period;
+					best_count = count;
+				}
+			}
+		}
+		
+		if (best_period == 1 && !best_count)
+		{
+			put_operators(chunk, ">", 1);
+			put_repeated(chunk, ':', best_copies);
+			put_operators(chunk, "<", 1);
+			i += best_copies;
+		}
+		else if (best_period)
+		{
+			put_operators(chunk, encoding->operations[best_count], encoding->lengths[best_count]);
+			put_operators(chunk, "[", 1);
+			if (best_period == 1)
+			{
+				put_operators(chunk, ">", 1);
+				put_repeated(chunk, ':', best_copies);
+				put_operators(chunk, "<", 1);
+			}
+			else
+			{
+				for (size_t j = 0; j < best_period; ++j)
+				{
+					size_t previous = words[i + j - 1];
+					size_t word = words[i + j];
+					put_copy(chunk, previous, word, delta_length(previous, word) > rebuild_length(encoding, word));
+				}
+			}
+			put_operators(chunk, "][-]", 4);
+			chunk->counted = 1;
+			i += best_count * ((best_period == 1) ? best_copies : best_period);
+		}
+		else if (has_previous && delta_length(words[i - 1], words[i]) < slot_length(encoding, words[i]))
+		{
+			put_copy(chunk, words[i - 1], words[i], 0);
+			++i;
+		}
+		else
+		{
+			put_operators(chunk, encoding->operations[words[i]], encoding->lengths[words[i]]);
+			put_operators(chunk, "<", 1);
+			++chunk->slot_count;
+			++i;
+		}
+	}
+	
+	return 0;
+}
+
+int create_word_encoding(encoding_t* encoding, char** buffer)
+{
+	size_t value_count = (size_t)1 << (8 * encoding->word_size);
+	n_constant_table_t* table = n_constant_table_create();
+	char** operations = calloc(value_count, sizeof(char*));
+	size_t* lengths = calloc(value_count, sizeof(size_t));
+	size_t* offsets = calloc(value_count, sizeof(size_t));
+	int error = (!table || !operations || !lengths || !offsets) ? ERROR_MEMORY : 0;
+	
+	// Concatenate the operations of every value into one buffer
+	size_t size = 0;
+	size_t capacity = 0;
+	char* operators = 0;
+	for (size_t i = 0; i < value_count && !error; ++i)
+	{
+		char* value_operators = n_constant_synthesize(table, i, &lengths[i]);
+		if (value_operators && size + lengths[i] > capacity)
+		{
+			capacity = (capacity) ? capacity : value_count * 16;
+			while (capacity < size + lengths[i])
+				capacity *= 2;
+			char* grown = realloc(operators, capacity);
+			if (grown)
+				operators = grown;
+			else
+				error = ERROR_MEMORY;
+		}
+		if (!value_operators)
+			error = ERROR_MEMORY;
+		if (!error)
+		{
+			memcpy(operators + size, value_operators, lengths[i]);
+			offsets[i] = size;
+			size += lengths[i];
+		}
+		free(value_operators);
+	}
+	for (size_t i = 0; i < value_count && !error; ++i)
+		operations[i] = operators + offsets[i];
+	
+	free(offsets);
+	n_constant_table_free(table);
+	if (error)
+	{
+		free(operators);
+		free(operations);
+		free(lengths);
+		return error;
 	}
 	
-	return EXIT_SUCCESS;
+	encoding->operations = (const char* const*)operations;
+	encoding->lengths = lengths;
+	*buffer = operators;
+	
+	return 0;
+}
+
+void free_word_encoding(encoding_t* encoding, char* buffer)
+{
+	free((char**)encoding->operations);
+	free((size_t*)encoding->lengths);
+	free(buffer);
+}
+
+void usage()
+{
+	printf("Usage: bin2n <input file> [output file] [--threads <count>] [--word-size <bytes>]\n");
 }
@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+#include "hash.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_CACHE_MMAP
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+/// Magic number at the start of cached program files.
+static const char cache_magic[8] = {'(', 'N', ')', 'P', 'R', 'O', 'G', '\0'};
+
+/// Header of a cached program file, which is followed by the program's instructions.
+typedef struct cache_header_t
+{
+	/// Magic number identifying the file as a cached program.
+	char magic[8];
+	
+	/// Hash of the interpreter version and instruction layout.
+	uint64_t version_hash;
+	
+	/// Hash of the program source.
+	uint64_t source_hash;
+	
+	/// Length of the program source, in bytes.
+	uint64_t source_length;
+	
+	/// Number of instructions following the header.
+	uint64_t instruction_count;
+	
+	/// Maximum loop nesting depth of the program.
+	uint64_t max_loop_depth;
+	
+} cache_header_t;
+
+uint64_t n_cache_version(void)
+{
+	const uint64_t format = N_CACHE_FORMAT;
+	return n_hash(&format, sizeof(format), n_hash(N_VERSION, strlen(N_VERSION), sizeof(n_instruction_t)));
+}
+
+void* n_cache_map(const char* path, size_t* size)
+{
+	#if defined(N_CACHE_MMAP)
+		int file = open(path, O_RDONLY);
+		if (file < 0)
+			return 0;
+		
+		struct stat status;
+		void* mapping = 0;
+		if (!fstat(file, &status) && status.st_size > 0)
+		{
+			mapping = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (mapping == MAP_FAILED)
+				mapping = 0;
+			else
+				*size = status.st_size;
+		}
+		close(file);
+		
+		return mapping;
+	#else
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			return 0;
+		
+		fseek(file, 0, SEEK_END);
+		long file_size = ftell(file);
+		rewind(file);
+		
+		void* mapping = (file_size > 0) ? malloc(file_size) : 0;
+		if (mapping && fread(mapping, 1, file_size, file) != (size_t)file_size)
+		{
+			free(mapping);
+			mapping = 0;
+		}
+		fclose(file);
+		
+		*size = file_size;
+		return mapping;
+	#endif
+}
+
+void n_cache_unmap(void* mapping, size_t size)
+{
+	#if defined(N_CACHE_MMAP)
+		munmap(mapping, size);
+	#else
+		(void)size;
+		free(mapping);
+	#endif
+}
+
+/**
+ * Checks that cached instructions are those of a compiled program, which the interpreter can run without indexing out of bounds.
+ *
+ * @param instructions Cached instructions.
+ * @param count Number of cached instructions.
+ * @param max_loop_depth Maximum loop nesting depth recorded with the instructions.
+ *
+ * @return `0` if every opcode is valid, loop instructions are nested and point at each other, unmatched loop starts skip to the end of the program, and the loop nesting depth is as recorded, or `-1` otherwise.
+ */
+static int validate_instructions(const n_instruction_t* instructions, size_t count, uint64_t max_loop_depth)
+{
+	if (max_loop_depth > count)
+		return -1;
+	size_t* loop_starts = malloc((max_loop_depth + 1) * sizeof(size_t));
+	if (!loop_starts)
+		return -1;
+	
+	int result = 0;
+	size_t loop_depth = 0;
+	size_t deepest = 0;
+	for (size_t i = 0; i < count && !result; ++i)
+	{
+		uint32_t opcode = instructions[i].opcode;
+		if (opcode == N_OP_LOOP_START)
+		{
+			if (loop_depth == max_loop_depth)
+				result = -1;
+			else
+				loop_starts[++loop_depth] = i;
+			deepest += (loop_depth > deepest);
+		}
+		else if (opcode == N_OP_LOOP_END)
+		{
+			// Loop ends are only compiled for matched loops
+			if (!loop_depth || instructions[i].operand != loop_starts[loop_depth] || instructions[loop_starts[loop_depth]].operand != i)
+				result = -1;
+			else
+				--loop_depth;
+		}
+		else if (opcode > N_OP_LOOP_END)
+		{
+			result = -1;
+		}
+	}
+	
+	// Unmatched loop starts skip to the end of the program
+	while (loop_depth && !result)
+		if (instructions[loop_starts[loop_depth--]].operand != count)
+			result = -1;
+	if (deepest != max_loop_depth)
+		result = -1;
+	
+	free(loop_starts);
+	return result;
+}
+
+n_program_t* n_program_load(const char* path, uint64_t source_hash, size_t source_length)
+{
+	size_t size = 0;
+	void* mapping = n_cache_map(path, &size);
+	if (!mapping)
+		return 0;
+	
+	// Validate header
+	const cache_header_t* header = mapping;
+	if (size < sizeof(cache_header_t) ||
+		memcmp(header->magic, cache_magic, sizeof(cache_magic)) ||
+		header->version_hash != n_cache_version() ||
+		header->source_hash != source_hash ||
+		header->source_length != source_length ||
+		header->instruction_count > (size - sizeof(cache_header_t)) / sizeof(n_instruction_t) ||
+		size != sizeof(cache_header_t) + header->instruction_count * sizeof(n_instruction_t) ||
+		validate_instructions((const n_instruction_t*)((const char*)mapping + sizeof(cache_header_t)), header->instruction_count, header->max_loop_depth))
+	{
+		n_cache_unmap(mapping, size);
+		return 0;
+	}
+	
+	n_program_t* program = malloc(sizeof(n_program_t));
+	if (!program)
+	{
+		n_cache_unmap(mapping, size);
+		return 0;
+	}
+	
+	// Point instructions into mapped file
+	program->instructions = (n_instruction_t*)((char*)mapping + sizeof(cache_header_t));
+	program->instruction_count = header->instruction_count;
+	program->max_loop_depth = header->max_loop_depth;
+	program->mapping = mapping;
+	program->mapping_size = size;
+	
+	return program;
+}
+
+int n_program_save(const n_program_t* program, const char* path, uint64_t source_hash, size_t source_length)
+{
+	cache_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version_hash = n_cache_version();
+	header.source_hash = source_hash;
+	header.source_length = source_length;
+	header.instruction_count = program->instruction_count;
+	header.max_loop_depth = program->max_loop_depth;
+	
+	// Build temporary file path
+	size_t path_length = strlen(path);
+	char* temporary_path = malloc(path_length + 32);
+	if (!temporary_path)
+		return -1;
+	#if defined(N_CACHE_MMAP)
+		sprintf(temporary_path, "%s.%ld.tmp", path, (long)getpid());
+	#else
+		sprintf(temporary_path, "%s.tmp", path);
+	#endif
+	
+	// Write header and instructions to temporary file
+	FILE* file = fopen(temporary_path, "wb");
+	int result = -1;
+	if (file)
+	{
+		if (fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(program->instructions, sizeof(n_instruction_t), program->instruction_count, file) == program->instruction_count)
+			result = 0;
+		if (fclose(file))
+			result = -1;
+		
+		// Replace cache file with temporary file
+		if (!result)
+		{
+			#if !defined(N_CACHE_MMAP)
+				remove(path);
+			#endif
+			result = rename(temporary_path, path) ? -1 : 0;
+		}
+		if (result)
+			remove(temporary_path);
+	}
+	
+	free(temporary_path);
+	return result;
+}
+
+n_program_t* n_program_compile_cached(const char* directory, const char* source, size_t length)
+{
+	uint64_t source_hash = n_hash(source, length, 0);
+	
+	// Build cache file path
+	char* path = malloc(strlen(directory) + 32);
+	if (!path)
+		return n_program_compile(source, length);
+	sprintf(path, "%s/%016" PRIx64 ".nc", directory, source_hash);
+	
+	// Load cached program
+	n_program_t* program = n_program_load(path, source_hash, length);
+	if (!program)
+	{
+		// Compile program then add it to the cache
+		program = n_program_compile(source, length);
+		if (program)
+		{
+			#if defined(N_CACHE_MMAP)
+				mkdir(directory, 0777);
+			#endif
+			n_program_save(program, path, source_hash, length);
+		}
+	}
+	
+	free(path);
+	return program;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_CACHE_H
+#define N_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "program.h"
+
+/// Version string of the interpreter, which invalidates cached programs when changed.
+#ifndef N_VERSION
+	#define N_VERSION "unknown"
+#endif
+
+/// Version of the compiled program format, which invalidates cached programs when changed. It must be incremented whenever compilation produces different instructions for the same source, even if the interpreter version is not.
+#define N_CACHE_FORMAT 2
+
+/// Returns a hash identifying the interpreter version, program format and instruction layout, which is stored with cached programs and memoized results.
+uint64_t n_cache_version(void);
+
+/**
+ * Compiles an (N) program, reusing its compiled form from a cache directory if possible.
+ *
+ * Cached programs are keyed by a hash of their source, and stored in files named after the hash. A cached program is memory-mapped rather than read, and is only used if it was compiled from the same source by the same interpreter version and program format. Otherwise the program is compiled and written to the cache.
+ *
+ * @param directory Path to the cache directory, which is created if it does not exist.
+ * @param source (N) source code.
+ * @param length Length of the source code, in bytes.
+ *
+ * @return Compiled program, or `0` if memory could not be allocated.
+ */
+n_program_t* n_program_compile_cached(const char* directory, const char* source, size_t length);
+
+/**
+ * Loads a compiled program from a cache file. The instructions are validated before use, so a corrupted file is rejected rather than run.
+ *
+ * @param path Path to the cache file.
+ * @param source_hash Hash of the program source.
+ * @param source_length Length of the program source, in bytes.
+ *
+ * @return Compiled program, or `0` if the file does not exist, was not compiled from the given source by this interpreter version, or contains invalid instructions.
+ */
+n_program_t* n_program_load(const char* path, uint64_t source_hash, size_t source_length);
+
+/**
+ * Writes a compiled program to a cache file. The file is written under a temporary name then renamed, so concurrent readers never see a partially written program.
+ *
+ * @return `0` on success, `-1` otherwise.
+ */
+int n_program_save(const n_program_t* program, const char* path, uint64_t source_hash, size_t source_length);
+
+/**
+ * Maps a file into memory for reading.
+ *
+ * @param path Path to the file.
+ * @param[out] size Size of the file, in bytes.
+ *
+ * @return Pointer to the mapped file, or `0` if the file could not be mapped.
+ */
+void* n_cache_map(const char* path, size_t* size);
+
+/// Unmaps a file mapped with `n_cache_map()`.
+void n_cache_unmap(void* mapping, size_t size);
+
+#endif // N_CACHE_H
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "clock.h"
+#include <time.h>
+
+double n_clock(void)
+{
+	#if defined(CLOCK_MONOTONIC)
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+	#else
+		return (double)clock() / (double)CLOCKS_PER_SEC;
+	#endif
+}
@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "constant.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// Number of values in a constant table.
+#define TABLE_SIZE ((size_t)1 << N_CONSTANT_TABLE_BITS)
+
+/// Length of operations which have not been found.
+#define UNREACHED 255
+
+/// Number of bodies in the library which only add, which come first.
+#define ADDITIVE_BODY_COUNT 15
+
+/// Largest loop count to which bodies with multiplications are applied in the table, beyond which every such loop exceeds the table.
+#define MAX_TABLE_COUNT 16
+
+/// Largest loop count to which bodies with multiplications are applied to find large values.
+#define MAX_GENERATOR_COUNT 64
+
+/// Largest factor by which large values are decomposed.
+#define MAX_FACTOR 8
+
+/// Largest offset between a large value and a value built by a single loop.
+#define MAX_GENERATOR_OFFSET 4
+
+/// Large values which have been decomposed during a synthesis.
+typedef struct decomposition_t
+{
+	/// Decomposed values, in an open addressing hash table with a power of two capacity, where zero marks an empty slot.
+	bignum_t* values;
+	
+	/// Number of operators which build each value.
+	uint16_t* lengths;
+	
+	/// Factor of each value, or zero if it is built by a single loop, in the upper eight bits, and its offset plus 128 in the lower eight bits.
+	uint16_t* choices;
+	
+	/// Number of decomposed values.
+	size_t count;
+	
+	/// Capacity of the hash table.
+	size_t capacity;
+	
+} decomposition_t;
+
+/// Returns the hash table slot at which to start looking for a value.
+static size_t hash_slot(bignum_t value, size_t capacity)
+{
+	return (size_t)((value * 0x9E3779B97F4A7C15) >> 32) & (capacity - 1);
+}
+
+static int apply_loop(const n_constant_body_t* bodies, const n_constant_body_t* body, bignum_t* value, bignum_t max_value);
+
+/// Applies a loop body from a library to a value, returning zero if the value exceeded a maximum.
+static int apply_body(const n_constant_body_t* bodies, const n_constant_body_t* body, bignum_t* value, bignum_t max_value)
+{
+	bignum_t x = *value;
+	for (int i = 0; i < 3; ++i)
+	{
+		int offset = body->offsets[i];
+		if (offset >= 0)
+		{
+			if (x > max_value - (bignum_t)offset)
+				return 0;
+			x += (bignum_t)offset;
+		}
+		else
+		{
+			x = (x > (bignum_t)-offset) ? x - (bignum_t)-offset : 0;
+		}
+		
+		if (i == 0 && body->inner)
+		{
+			if (!apply_loop(bodies, &bodies[body->inner - 1], &x, max_value))
+				return 0;
+		}
+		else if (i < 2 && body->factors[i])
+		{
+			if (x > max_value / body->factors[i])
+				return 0;
+			x *= body->factors[i];
+		}
+	}
+	
+	*value = x;
+	return 1;
+}
+
+/// Applies a loop with a body from a library to a value, which is also its count, returning zero if the value exceeded a maximum.
+static int apply_loop(const n_constant_body_t* bodies, const n_constant_body_t* body, bignum_t* value, bignum_t max_value)
+{
+	bignum_t count = *value;
+	
+	// Bodies without loops only add, so have a closed form
+	if (!body->factors[0] && !body->inner)
+	{
+		bignum_t offset = (bignum_t)body->offsets[0];
+		if (count && offset > (max_value - count) / count)
+			return 0;
+		*value = count + count * offset;
+		return 1;
+	}
+	
+	for (bignum_t i = 0; i < count; ++i)
+	{
+		bignum_t previous = *value;
+		if (!apply_body(bodies, body, value, max_value))
+			return 0;
+		
+		// Remaining iterations have no effect once the value is a fixed point of the body
+		if (*value == previous)
+			break;
+	}
+	
+	return 1;
+}
+
+/// Adds a body with up to two multiplications, or a nested loop in place of the first, to the library.
+static void add_body(n_constant_table_t* table, int offset0, int factor0, int offset1, int factor1, int offset2, size_t inner)
+{
+	n_constant_body_t* body = &table->bodies[table->body_count++];
+	body->inner = (uint16_t)inner;
+	body->offsets[0] = (int8_t)offset0;
+	body->offsets[1] = (int8_t)offset1;
+	body->offsets[2] = (int8_t)offset2;
+	body->factors[0] = (uint8_t)factor0;
+	body->factors[1] = (uint8_t)factor1;
+	body->length = (uint8_t)(abs(offset0) + abs(offset1) + abs(offset2) + ((factor0) ? factor0 + 1 : 0) + ((factor1) ? factor1 + 1 : 0) + ((inner) ? table->bodies[inner - 1].length + 2 : 0));
+}
+
+/// Inserts a large value built by a single loop, keeping the shorter of any existing operations for it.
+static void insert_generator(n_constant_table_t* table, bignum_t value, size_t body_index, bignum_t count)
+{
+	size_t mask = table->generator_capacity - 1;
+	size_t slot = hash_slot(value, table->generator_capacity);
+	while (table->generators[slot] && table->generators[slot] != value)
+		slot = (slot + 1) & mask;
+	
+	uint32_t step = (uint32_t)(body_index + 1) | ((uint32_t)count << 16);
+	if (table->generators[slot])
+	{
+		uint32_t existing = table->generator_steps[slot];
+		size_t existing_length = table->lengths[existing >> 16] + table->bodies[(existing & 0xFFFF) - 1].length;
+		if (table->lengths[count] + table->bodies[body_index].length >= existing_length)
+			return;
+	}
+	table->generators[slot] = value;
+	table->generator_steps[slot] = step;
+}
+
+/// Returns the number of operators which build a large value with a single loop, or `SIZE_MAX` if it is not built by one.
+static size_t find_generator(const n_constant_table_t* table, bignum_t value, uint32_t* step)
+{
+	size_t mask = table->generator_capacity - 1;
+	for (size_t slot = hash_slot(value, table->generator_capacity); table->generators[slot]; slot = (slot + 1) & mask)
+	{
+		if (table->generators[slot] == value)
+		{
+			*step = table->generator_steps[slot];
+			return table->lengths[*step >> 16] + table->bodies[(*step & 0xFFFF) - 1].length + 2;
+		}
+	}
+	
+	return SIZE_MAX;
+}
+
+n_constant_table_t* n_constant_table_create(void)
+{
+	n_constant_table_t* table = calloc(1, sizeof(n_constant_table_t));
+	if (!table)
+		return 0;
+	
+	// Library of bodies: additions alone, which multiply the loop count, bodies with one or two multiplications, and bodies with a loop of a body with one multiplication
+	size_t max_body_count = ADDITIVE_BODY_COUNT + 11 * 15 * 7 + 5 * 5 * 5 * 5 * 5 + 7 * 7 * 5 * 3 * 5;
+	table->bodies = calloc(max_body_count, sizeof(n_constant_body_t));
+	table->lengths = malloc(TABLE_SIZE * sizeof(uint8_t));
+	table->steps = malloc(TABLE_SIZE * sizeof(uint16_t));
+	table->previous = malloc(TABLE_SIZE * sizeof(uint16_t));
+	if (!table->bodies || !table->lengths || !table->steps || !table->previous)
+	{
+		n_constant_table_free(table);
+		return 0;
+	}
+	for (int offset = 1; offset <= ADDITIVE_BODY_COUNT; ++offset)
+		add_body(table, offset, 0, 0, 0, 0, 0);
+	size_t first_inner = table->body_count;
+	for (int offset0 = -5; offset0 <= 5; ++offset0)
+		for (int factor = 2; factor <= 16; ++factor)
+			for (int offset1 = -3; offset1 <= 3; ++offset1)
+				add_body(table, offset0, factor, offset1, 0, 0, 0);
+	size_t last_inner = table->body_count;
+	for (int offset0 = -2; offset0 <= 2; ++offset0)
+		for (int factor0 = 2; factor0 <= 6; ++factor0)
+			for (int offset1 = -2; offset1 <= 2; ++offset1)
+				for (int factor1 = 2; factor1 <= 6; ++factor1)
+					for (int offset2 = -2; offset2 <= 2; ++offset2)
+						add_body(table, offset0, factor0, offset1, factor1, offset2, 0);
+	for (size_t inner = first_inner; inner < last_inner; ++inner)
+	{
+		const n_constant_body_t* body = &table->bodies[inner];
+		if (abs(body->offsets[0]) > 2 || body->factors[0] > 4 || abs(body->offsets[1]) > 2)
+			continue;
+		for (int offset0 = -3; offset0 <= 3; ++offset0)
+			for (int offset1 = -3; offset1 <= 3; ++offset1)
+				add_body(table, offset0, 0, offset1, 0, 0, inner + 1);
+	}
+	
+	// Find shortest operations in order of length, so that every value of the current length is final when it is reached
+	memset(table->lengths, UNREACHED, TABLE_SIZE);
+	table->lengths[0] = 0;
+	size_t final_count = 0;
+	for (size_t length = 0; length < UNREACHED && final_count < TABLE_SIZE; ++length)
+	{
+		for (size_t value = 0; value < TABLE_SIZE; ++value)
+		{
+			if (table->lengths[value] != length)
+				continue;
+			++final_count;
+			
+			// Relax each step from this value, where loops of bodies with multiplications exceed the table for all but small counts
+			size_t step_count = ((value > MAX_TABLE_COUNT) ? ADDITIVE_BODY_COUNT : table->body_count) + 2;
+			for (size_t step = 0; step < step_count; ++step)
+			{
+				bignum_t next = value;
+				size_t next_length = length + 1;
+				if (step == 0)
+				{
+					++next;
+				}
+				else if (step == 1)
+				{
+					next = (next) ? next - 1 : 0;
+				}
+				else
+				{
+					const n_constant_body_t* body = &table->bodies[step - 2];
+					if (!apply_loop(table->bodies, body, &next, TABLE_SIZE - 1))
+						continue;
+					next_length += body->length + 1;
+				}
+				
+				if (next < TABLE_SIZE && next_length < table->lengths[next])
+				{
+					table->lengths[next] = (uint8_t)next_length;
+					table->steps[next] = (uint16_t)step;
+					table->previous[next] = (uint16_t)value;
+				}
+			}
+		}
+	}
+	
+	// Find large values built by a single loop from a small count, counting them first to size their hash table
+	size_t generator_count = 0;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		if (pass)
+		{
+			table->generator_capacity = 1;
+			while (table->generator_capacity < 2 * generator_count + 2)
+				table->generator_capacity <<= 1;
+			table->generators = calloc(table->generator_capacity, sizeof(bignum_t));
+			table->generator_steps = malloc(table->generator_capacity * sizeof(uint32_t));
+			if (!table->generators || !table->generator_steps)
+			{
+				n_constant_table_free(table);
+				return 0;
+			}
+		}
+		
+		for (size_t i = 0; i < table->body_count; ++i)
+		{
+			if (!table->bodies[i].factors[0])
+				continue;
+			for (bignum_t count = 1; count <= MAX_GENERATOR_COUNT; ++count)
+			{
+				bignum_t value = count;
+				if (!apply_loop(table->bodies, &table->bodies[i], &value, UINT64_MAX))
+					break;
+				if (value < TABLE_SIZE)
+					continue;
+				if (pass)
+					insert_generator(table, value, i, count);
+				else
+					++generator_count;
+			}
+		}
+	}
+	
+	return table;
+}
+
+void n_constant_table_free(n_constant_table_t* table)
+{
+	if (!table)
+		return;
+	
+	free(table->bodies);
+	free(table->lengths);
+	free(table->steps);
+	free(table->previous);
+	free(table->generators);
+	free(table->generator_steps);
+	free(table);
+}
+
+/// Finds the slot of a decomposed value, or the empty slot at which it would be inserted.
+static size_t find_decomposition(const decomposition_t* decomposition, bignum_t value)
+{
+	size_t mask = decomposition->capacity - 1;
+	size_t slot = hash_slot(value, decomposition->capacity);
+	while (decomposition->values[slot] && decomposition->values[slot] != value)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+/// Inserts a decomposed value, growing the hash table at half load. Returns zero if memory could not be allocated.
+static int insert_decomposition(decomposition_t* decomposition, bignum_t value, uint16_t length, uint16_t choice)
+{
+	if (2 * (decomposition->count + 1) > decomposition->capacity)
+	{
+		decomposition_t grown = {0, 0, 0, decomposition->count, decomposition->capacity << 1};
+		grown.values = calloc(grown.capacity, sizeof(bignum_t));
+		grown.lengths = malloc(grown.capacity * sizeof(uint16_t));
+		grown.choices = malloc(grown.capacity * sizeof(uint16_t));
+		if (!grown.values || !grown.lengths || !grown.choices)
+		{
+			free(grown.values);
+			free(grown.lengths);
+			free(grown.choices);
+			return 0;
+		}
+		for (size_t i = 0; i < decomposition->capacity; ++i)
+		{
+			if (!decomposition->values[i])
+				continue;
+			size_t slot = find_decomposition(&grown, decomposition->values[i]);
+			grown.values[slot] = decomposition->values[i];
+			grown.lengths[slot] = decomposition->lengths[i];
+			grown.choices[slot] = decomposition->choices[i];
+		}
+		free(decomposition->values);
+		free(decomposition->lengths);
+		free(decomposition->choices);
+		*decomposition = grown;
+	}
+	
+	size_t slot = find_decomposition(decomposition, value);
+	decomposition->values[slot] = value;
+	decomposition->lengths[slot] = length;
+	decomposition->choices[slot] = choice;
+	++decomposition->count;
+	
+	return 1;
+}
+
+/// Returns the number of operators which build a value, decomposing it if it is not in the table, or `SIZE_MAX` if memory could not be allocated.
+static size_t decompose(const n_constant_table_t* table, decomposition_t* decomposition, bignum_t value)
+{
+	if (value < TABLE_SIZE)
+		return table->lengths[value];
+	
+	size_t slot = find_decomposition(decomposition, value);
+	if (decomposition->values[slot])
+		return decomposition->lengths[slot];
+	
+	// Try values built by a single loop, then a product of a smaller value and a factor, each plus an offset
+	size_t best_length = SIZE_MAX;
+	uint16_t best_choice = 0;
+	for (int offset = -MAX_GENERATOR_OFFSET; offset <= MAX_GENERATOR_OFFSET; ++offset)
+	{
+		uint32_t step;
+		size_t length = find_generator(table, value - (bignum_t)(int64_t)offset, &step);
+		if (length != SIZE_MAX && length + (size_t)abs(offset) < best_length)
+		{
+			best_length = length + (size_t)abs(offset);
+			best_choice = (uint16_t)(offset + 128);
+		}
+	}
+	for (int factor = 2; factor <= MAX_FACTOR; ++factor)
+	{
+		int remainder = (int)(value % (bignum_t)factor);
+		for (int offset = remainder; offset >= remainder - factor; offset -= factor)
+		{
+			// Values just below 2^64 cannot be rounded up
+			if (offset < 0 && value > UINT64_MAX - (bignum_t)-offset)
+				continue;
+			
+			size_t length = decompose(table, decomposition, (value - (bignum_t)(int64_t)offset) / (bignum_t)factor);
+			if (length == SIZE_MAX)
+				return SIZE_MAX;
+			length += (size_t)(factor + 1 + abs(offset));
+			if (length < best_length)
+			{
+				best_length = length;
+				best_choice = (uint16_t)((factor << 8) | (offset + 128));
+			}
+		}
+	}
+	
+	if (!insert_decomposition(decomposition, value, (uint16_t)best_length, best_choice))
+		return SIZE_MAX;
+	return best_length;
+}
+
+/// Writes repeated copies of an operator.
+static void write_repeated(char** output, char operator, size_t count)
+{
+	memset(*output, operator, count);
+	*output += count;
+}
+
+/// Writes an offset as increments or decrements.
+static void write_offset(char** output, int offset)
+{
+	write_repeated(output, (offset < 0) ? '-' : '+', (size_t)abs(offset));
+}
+
+/// Writes a loop with a body from a library.
+static void write_loop(char** output, const n_constant_body_t* bodies, const n_constant_body_t* body)
+{
+	*(*output)++ = '[';
+	for (int i = 0; i < 3; ++i)
+	{
+		write_offset(output, body->offsets[i]);
+		if (i == 0 && body->inner)
+		{
+			write_loop(output, bodies, &bodies[body->inner - 1]);
+		}
+		else if (i < 2 && body->factors[i])
+		{
+			*(*output)++ = '[';
+			write_repeated(output, '+', body->factors[i] - 1);
+			*(*output)++ = ']';
+		}
+	}
+	*(*output)++ = ']';
+}
+
+/// Writes the operations which build a value in the table.
+static void write_small(const n_constant_table_t* table, char** output, size_t value)
+{
+	if (!value)
+		return;
+	
+	uint16_t step = table->steps[value];
+	write_small(table, output, table->previous[value]);
+	if (step == 0)
+		*(*output)++ = '+';
+	else if (step == 1)
+		*(*output)++ = '-';
+	else
+		write_loop(output, table->bodies, &table->bodies[step - 2]);
+}
+
+/// Writes the operations which build a decomposed value.
+static void write_value(const n_constant_table_t* table, const decomposition_t* decomposition, char** output, bignum_t value)
+{
+	if (value < TABLE_SIZE)
+	{
+		write_small(table, output, (size_t)value);
+		return;
+	}
+	
+	uint16_t choice = decomposition->choices[find_decomposition(decomposition, value)];
+	int factor = choice >> 8;
+	int offset = (int)(choice & 0xFF) - 128;
+	bignum_t base = value - (bignum_t)(int64_t)offset;
+	if (factor)
+	{
+		write_value(table, decomposition, output, base / (bignum_t)factor);
+		*(*output)++ = '[';
+		write_repeated(output, '+', (size_t)(factor - 1));
+		*(*output)++ = ']';
+	}
+	else
+	{
+		uint32_t step = 0;
+		find_generator(table, base, &step);
+		write_small(table, output, step >> 16);
+		write_loop(output, table->bodies, &table->bodies[(step & 0xFFFF) - 1]);
+	}
+	write_offset(output, offset);
+}
+
+char* n_constant_synthesize(const n_constant_table_t* table, bignum_t value, size_t* length)
+{
+	decomposition_t decomposition = {0, 0, 0, 0, 1024};
+	decomposition.values = calloc(decomposition.capacity, sizeof(bignum_t));
+	decomposition.lengths = malloc(decomposition.capacity * sizeof(uint16_t));
+	decomposition.choices = malloc(decomposition.capacity * sizeof(uint16_t));
+	
+	size_t operations_length = SIZE_MAX;
+	if (decomposition.values && decomposition.lengths && decomposition.choices)
+		operations_length = decompose(table, &decomposition, value);
+	
+	char* operations = (operations_length != SIZE_MAX) ? malloc(operations_length + 1) : 0;
+	if (operations)
+	{
+		char* output = operations;
+		write_value(table, &decomposition, &output, value);
+		*output = '\0';
+		if (length)
+			*length = operations_length;
+	}
+	
+	free(decomposition.values);
+	free(decomposition.lengths);
+	free(decomposition.choices);
+	
+	return operations;
+}
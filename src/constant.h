@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_CONSTANT_H
+#define N_CONSTANT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bignum.h"
+
+/// Number of bits of the values whose operations are found exhaustively by `n_constant_table_create()`.
+#define N_CONSTANT_TABLE_BITS 16
+
+/// Loop body whose effect on an element is a sequence of additions, saturating subtractions, multiplications and nested loops.
+typedef struct n_constant_body_t
+{
+	/// Amounts added to the element before, between and after the multiplications, negative for subtraction.
+	int8_t offsets[3];
+	
+	/// Factors by which the element is multiplied, each with a loop of `factor - 1` increments, or zero for none.
+	uint8_t factors[2];
+	
+	/// Index of a body in the library plus one, whose loop is applied in place of the first multiplication, or zero for none.
+	uint16_t inner;
+	
+	/// Number of operators in the body, excluding its enclosing loop.
+	uint8_t length;
+	
+} n_constant_body_t;
+
+/**
+ * Table of the shortest operations which build each small value from zero in a single element, using the operators `+`, `-`, `[` and `]`.
+ *
+ * Shortest operations are found by a shortest path search over values, where each step is an increment, a decrement or a loop whose body is taken from a library of bodies with a closed form effect. Operations are therefore minimal among those whose loop bodies are in the library, which covers every entry of the 8-bit constants table.
+ */
+typedef struct n_constant_table_t
+{
+	/// Library of loop bodies.
+	n_constant_body_t* bodies;
+	
+	/// Number of loop bodies.
+	size_t body_count;
+	
+	/// Number of operators which build each value.
+	uint8_t* lengths;
+	
+	/// Last step which builds each value: `0` for an increment, `1` for a decrement, or the index of a loop body plus two.
+	uint16_t* steps;
+	
+	/// Value to which the last step of each value is applied.
+	uint16_t* previous;
+	
+	/// Large values built by a single loop from a small value, in an open addressing hash table with a power of two capacity, where zero marks an empty slot.
+	bignum_t* generators;
+	
+	/// Index of the loop body plus one, and the loop count in the upper bits, of each large value.
+	uint32_t* generator_steps;
+	
+	/// Capacity of the large value hash table.
+	size_t generator_capacity;
+	
+} n_constant_table_t;
+
+/**
+ * Creates a table of the shortest operations for every value below 2^`N_CONSTANT_TABLE_BITS`.
+ *
+ * @return Constant table, or `0` if memory could not be allocated.
+ */
+n_constant_table_t* n_constant_table_create(void);
+
+/// Deallocates a constant table.
+void n_constant_table_free(n_constant_table_t* table);
+
+/**
+ * Synthesizes short operations which build a value from zero in a single element, using the operators `+`, `-`, `[` and `]`.
+ *
+ * Values in the table are built with their shortest operations. Larger values are decomposed into a product of a smaller value and a factor, plus an offset, choosing the decomposition with the fewest operators by a memoized search down to values in the table or built by a single loop. The result is near-minimal for large values. Programs which build large values are short but execute a number of instructions proportional to the value, since each iteration of a loop adds at most a constant.
+ *
+ * @param table Constant table, which is not modified and may be shared between threads.
+ * @param value Value to build.
+ * @param[out] length Number of operators, or `0` to ignore.
+ *
+ * @return Null-terminated operators, which must be freed with `free()`, or `0` if memory could not be allocated.
+ */
+char* n_constant_synthesize(const n_constant_table_t* table, bignum_t value, size_t* length);
+
+#endif // N_CONSTANT_H
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "context.h"
+#include "cache.h"
+#include "clock.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// Initial capacity of a context's ring buffer.
+#define MIN_CAPACITY 16
+
+/// Reverses the elements in the range [first, last).
+static void reverse_elements(bignum_t* first, bignum_t* last)
+{
+	while (first < --last)
+	{
+		bignum_t value = *first;
+		*(first++) = *last;
+		*last = value;
+	}
+}
+
+/// Deallocates a context's ring buffer, which is either allocated or mapped from a shared input.
+static void release_elements(n_context_t* context)
+{
+	if (context->mapping_size)
+		n_cache_unmap(context->elements, context->mapping_size);
+	else
+		free(context->elements);
+	context->mapping_size = 0;
+}
+
+n_context_t* n_context_create(void)
+{
+	n_context_t* context = calloc(1, sizeof(n_context_t));
+	if (!context)
+		return 0;
+	
+	if (n_context_reserve(context, MIN_CAPACITY) != N_SUCCESS)
+	{
+		free(context);
+		return 0;
+	}
+	
+	// Start with the zero singleton
+	context->elements[0] = 0;
+	context->count = 1;
+	
+	return context;
+}
+
+void n_context_free(n_context_t* context)
+{
+	if (!context)
+		return;
+	
+	release_elements(context);
+	free(context->loop_counters);
+	free(context);
+}
+
+int n_context_reserve(n_context_t* context, size_t count)
+{
+	if (count <= context->capacity)
+		return N_SUCCESS;
+	
+	size_t capacity = (context->capacity) ? context->capacity : MIN_CAPACITY;
+	while (capacity < count)
+		capacity <<= 1;
+	
+	bignum_t* elements = malloc(capacity * sizeof(bignum_t));
+	if (!elements)
+		return N_ERROR_MEMORY;
+	
+	// Copy sequence into new ring buffer, starting at index zero
+	if (context->count)
+	{
+		size_t mask = context->capacity - 1;
+		for (size_t i = 0; i < context->count; ++i)
+			elements[i] = context->elements[(context->head + i) & mask];
+	}
+	
+	release_elements(context);
+	context->elements = elements;
+	context->capacity = capacity;
+	context->head = 0;
+	
+	return N_SUCCESS;
+}
+
+/// Returns the number of elements which can be appended to a context's sequence before it must be grown or has exceeded its element limit.
+static size_t append_limit(const n_context_t* context)
+{
+	if (context->limits.max_elements && context->limits.max_elements < context->capacity)
+		return context->limits.max_elements;
+	return context->capacity;
+}
+
+// Instantiate the interpreter loop without profiling, with profiling, and with sampling
+#define EXECUTE execute
+#define PROFILE(...)
+#define SAMPLE(...)
+#include "execute.inl"
+#undef EXECUTE
+#undef PROFILE
+#undef SAMPLE
+
+#define EXECUTE execute_profiled
+#define PROFILE(...) __VA_ARGS__
+#define SAMPLE(...)
+#include "execute.inl"
+#undef EXECUTE
+#undef PROFILE
+#undef SAMPLE
+
+#define EXECUTE execute_sampled
+#define PROFILE(...)
+#define SAMPLE(...) __VA_ARGS__
+#include "execute.inl"
+#undef EXECUTE
+#undef PROFILE
+#undef SAMPLE
+
+int n_context_prepare(n_context_t* context, const n_program_t* program, size_t count)
+{
+	if (n_context_reserve(context, count) != N_SUCCESS)
+		return N_ERROR_MEMORY;
+	
+	// Grow loop counter stack
+	if (program->max_loop_depth >= context->loop_capacity)
+	{
+		bignum_t* loop_counters = malloc((program->max_loop_depth + 1) * sizeof(bignum_t));
+		if (!loop_counters)
+			return N_ERROR_MEMORY;
+		free(context->loop_counters);
+		context->loop_counters = loop_counters;
+		context->loop_capacity = program->max_loop_depth + 1;
+	}
+	
+	return N_SUCCESS;
+}
+
+/// Executes a program with the instantiation of the interpreter loop required by the context.
+static int dispatch(n_context_t* context, const n_program_t* program, double start_time)
+{
+	if (context->profile)
+		return execute_profiled(context, program, start_time);
+	if (context->sampler)
+		return execute_sampled(context, program, start_time);
+	return execute(context, program, start_time);
+}
+
+int n_context_run(n_context_t* context, const n_program_t* program, const bignum_t* input, size_t input_count)
+{
+	double start_time = (context->limits.max_time > 0.0) ? n_clock() : 0.0;
+	
+	// Reset execution state
+	context->steps = 0;
+	context->ip = 0;
+	context->loop_depth = 0;
+	
+	// Load input sequence, or the zero singleton if empty
+	context->count = 0;
+	context->head = 0;
+	if (context->limits.max_elements && input_count > context->limits.max_elements)
+		return N_ERROR_ELEMENT_LIMIT;
+	if (n_context_prepare(context, program, (input_count) ? input_count : 1) != N_SUCCESS)
+		return N_ERROR_MEMORY;
+	if (input_count)
+		memcpy(context->elements, input, input_count * sizeof(bignum_t));
+	else
+		context->elements[0] = 0;
+	context->count = (input_count) ? input_count : 1;
+	context->peak_count = context->count;
+	
+	return dispatch(context, program, start_time);
+}
+
+int n_context_run_shared(n_context_t* context, const n_program_t* program, const n_shared_input_t* input)
+{
+	double start_time = (context->limits.max_time > 0.0) ? n_clock() : 0.0;
+	
+	// Reset execution state
+	context->steps = 0;
+	context->ip = 0;
+	context->loop_depth = 0;
+	if (context->limits.max_elements && input->count > context->limits.max_elements)
+		return N_ERROR_ELEMENT_LIMIT;
+	
+	// Replace the ring buffer with a mapping of the shared input, which is copied on write
+	size_t mapping_size;
+	bignum_t* elements = n_shared_input_map(input, &mapping_size);
+	if (!elements)
+		return N_ERROR_MEMORY;
+	release_elements(context);
+	context->elements = elements;
+	context->capacity = input->capacity;
+	context->mapping_size = mapping_size;
+	context->head = 0;
+	context->count = input->count;
+	context->peak_count = context->count;
+	if (n_context_prepare(context, program, context->count) != N_SUCCESS)
+		return N_ERROR_MEMORY;
+	
+	return dispatch(context, program, start_time);
+}
+
+int n_context_resume(n_context_t* context, const n_program_t* program)
+{
+	double start_time = (context->limits.max_time > 0.0) ? n_clock() : 0.0;
+	
+	if (n_context_prepare(context, program, context->count) != N_SUCCESS)
+		return N_ERROR_MEMORY;
+	
+	return dispatch(context, program, start_time);
+}
+
+int n_context_chain(n_context_t* context, const n_program_t* program)
+{
+	double start_time = (context->limits.max_time > 0.0) ? n_clock() : 0.0;
+	
+	// Start the program on the current sequence, keeping the step count of previous programs
+	context->ip = 0;
+	context->loop_depth = 0;
+	if (n_context_prepare(context, program, context->count) != N_SUCCESS)
+		return N_ERROR_MEMORY;
+	
+	return dispatch(context, program, start_time);
+}
+
+const bignum_t* n_context_result(n_context_t* context, size_t* count)
+{
+	// Rotate the ring buffer so that the sequence is contiguous and starts at index zero
+	if (context->head + context->count > context->capacity)
+	{
+		bignum_t* elements = context->elements;
+		reverse_elements(elements, elements + context->head);
+		reverse_elements(elements + context->head, elements + context->capacity);
+		reverse_elements(elements, elements + context->capacity);
+		context->head = 0;
+	}
+	
+	*count = context->count;
+	return context->elements + context->head;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_CONTEXT_H
+#define N_CONTEXT_H
+
+#include <signal.h>
+#include <stddef.h>
+#include "bignum.h"
+#include "profile.h"
+#include "program.h"
+#include "sample.h"
+#include "share.h"
+
+#define N_SUCCESS 0
+#define N_ERROR_MEMORY 1
+#define N_ERROR_STEP_LIMIT 2
+#define N_ERROR_ELEMENT_LIMIT 3
+#define N_ERROR_TIME_LIMIT 4
+#define N_INTERRUPTED 5
+#define N_ERROR_SNAPSHOT 6
+
+/// Number of executed instructions between checks of the time limit and interrupt flag.
+#define N_CHECK_INTERVAL (1 << 20)
+
+/**
+ * Execution limits, which stop a program once exceeded. A limit of zero is no limit.
+ *
+ * Limits are checked when loops jump back to their start and when the sequence grows, rather than after every instruction, so a program may execute up to one pass through its longest loop-free run of instructions past the step limit, and up to `N_CHECK_INTERVAL` instructions past the time limit.
+ */
+typedef struct n_limits_t
+{
+	/// Maximum number of instructions to execute.
+	uint64_t max_steps;
+	
+	/// Maximum number of elements in the sequence.
+	size_t max_elements;
+	
+	/// Maximum run time, in seconds.
+	double max_time;
+	
+} n_limits_t;
+
+/**
+ * Execution context, which owns reusable sequence and loop storage. A context may only be used by one thread at a time, but can run any number of programs.
+ *
+ * The sequence is stored in a ring buffer with a power of two capacity, in which the first element is located at index `head` and the remaining elements follow it.
+ */
+typedef struct n_context_t
+{
+	/// Ring buffer of sequence elements.
+	bignum_t* elements;
+	
+	/// Capacity of the ring buffer, in elements.
+	size_t capacity;
+	
+	/// Size of the ring buffer in bytes, if it is a mapping of a shared input, or zero if it was allocated.
+	size_t mapping_size;
+	
+	/// Index of the first element in the ring buffer.
+	size_t head;
+	
+	/// Number of elements in the sequence.
+	size_t count;
+	
+	/// Stack of loop counters.
+	bignum_t* loop_counters;
+	
+	/// Capacity of the loop counter stack.
+	size_t loop_capacity;
+	
+	/// Execution limits of subsequent runs.
+	n_limits_t limits;
+	
+	/// Number of instructions executed by the last run.
+	uint64_t steps;
+	
+	/// Largest number of elements in the sequence during the last run.
+	size_t peak_count;
+	
+	/// Index of the next instruction to execute, if the last run was stopped.
+	size_t ip;
+	
+	/// Number of loops entered, if the last run was stopped.
+	size_t loop_depth;
+	
+	/// Profile into which subsequent runs are recorded, or `0` to run without profiling. The profile must have been created for the program being run.
+	n_profile_t* profile;
+	
+	/// Flag which stops subsequent runs with `N_INTERRUPTED` once non-zero, or `0` for none. The flag is polled at the same points as the time limit, so it may be set from a signal handler or another thread.
+	volatile sig_atomic_t* interrupt;
+	
+	/// Sampler to which subsequent runs publish their current instruction, or `0` to run without sampling. The sampler must have been created for the program being run, and is ignored if a profile is also set.
+	n_sampler_t* sampler;
+	
+} n_context_t;
+
+/// Creates an execution context.
+n_context_t* n_context_create(void);
+
+/// Deallocates an execution context.
+void n_context_free(n_context_t* context);
+
+/**
+ * Ensures a context can hold a given number of elements, growing its ring buffer if necessary.
+ *
+ * @return `N_SUCCESS`, or `N_ERROR_MEMORY` if the ring buffer could not be grown.
+ */
+int n_context_reserve(n_context_t* context, size_t count);
+
+/**
+ * Ensures a context can run a program on a sequence of a given number of elements, growing its ring buffer and loop counter stack if necessary.
+ *
+ * @return `N_SUCCESS`, or `N_ERROR_MEMORY` if storage could not be grown.
+ */
+int n_context_prepare(n_context_t* context, const n_program_t* program, size_t count);
+
+/**
+ * Runs a program on an input sequence. Storage is only allocated when the context has not previously held a sequence or loop nest as large as required.
+ *
+ * @param context Execution context.
+ * @param program Compiled program.
+ * @param input Array of input sequence elements. If empty, the input sequence will be the zero singleton.
+ * @param input_count Number of input sequence elements.
+ *
+ * @return `N_SUCCESS`, `N_ERROR_MEMORY` if storage could not be allocated, `N_ERROR_STEP_LIMIT`, `N_ERROR_ELEMENT_LIMIT` or `N_ERROR_TIME_LIMIT` if the program was stopped by an execution limit, or `N_INTERRUPTED` if it was stopped by the interrupt flag. A stopped program's sequence is left as it was when the program was stopped, and the program can be continued with `n_context_resume()`.
+ */
+int n_context_run(n_context_t* context, const n_program_t* program, const bignum_t* input, size_t input_count);
+
+/**
+ * Runs a program on a shared input sequence. The context's ring buffer is replaced by a private mapping of the input, so only the pages which the program writes to are copied.
+ *
+ * @param context Execution context.
+ * @param program Compiled program.
+ * @param input Shared input sequence, which may be freed once the run has started.
+ *
+ * @return As for `n_context_run()`.
+ */
+int n_context_run_shared(n_context_t* context, const n_program_t* program, const n_shared_input_t* input);
+
+/**
+ * Continues running a program in a context which was stopped, or restored from a snapshot. Limits apply to the total number of executed instructions, but the time limit is measured from when the program is resumed.
+ *
+ * @param context Execution context, which must have last run the same program.
+ * @param program Compiled program.
+ *
+ * @return As for `n_context_run()`.
+ */
+int n_context_resume(n_context_t* context, const n_program_t* program);
+
+/**
+ * Runs a program on the sequence left by the last run in a context, as the next stage of a pipeline. The sequence is not copied, and limits apply to the total number of instructions executed by all stages.
+ *
+ * @param context Execution context, whose last run completed successfully.
+ * @param program Compiled program.
+ *
+ * @return As for `n_context_run()`.
+ */
+int n_context_chain(n_context_t* context, const n_program_t* program);
+
+/**
+ * Returns the sequence held by a context as a contiguous array, which remains valid until the context is next run or freed.
+ *
+ * @param context Execution context.
+ * @param[out] count Number of elements in the sequence.
+ */
+const bignum_t* n_context_result(n_context_t* context, size_t* count);
+
+#endif // N_CONTEXT_H
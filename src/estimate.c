@@ -0,0 +1,627 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "estimate.h"
+#include <string.h>
+
+/// Bound which represents no bound below 2^64.
+#define UNBOUNDED UINT64_MAX
+
+/// Maximum sequence length for which each element is bounded separately.
+#define MAX_EXACT_LENGTH 256
+
+/// Number of loop iterations which are certain to run that are abstractly interpreted one by one.
+#define MAX_UNROLL 4096
+
+/// Number of joined abstract iterations of a loop before its bounds are widened.
+#define MAX_ITERATIONS 64
+
+/// Number of instructions which may be abstractly interpreted before all bounds are given up.
+#define MAX_WORK (1 << 22)
+
+/// Range of possible element values.
+typedef struct range_t
+{
+	/// Lower bound of the value.
+	uint64_t min;
+	
+	/// Upper bound of the value.
+	uint64_t max;
+	
+} range_t;
+
+/// Abstract sequence state, holding ranges of element values.
+typedef struct state_t
+{
+	/// Non-zero if the sequence length is exact and each element is bounded separately in `cells`, starting from the first element. Otherwise `cells[0]` bounds the first element, and `cells[1]` bounds all other elements.
+	int exact;
+	
+	/// Lower bound of the sequence length.
+	uint64_t length_min;
+	
+	/// Upper bound of the sequence length.
+	uint64_t length_max;
+	
+	/// Ranges of element values.
+	range_t cells[MAX_EXACT_LENGTH];
+	
+	/// Upper bound of the number of executed instructions.
+	uint64_t steps;
+	
+	/// Upper bound of the sequence length at any point.
+	uint64_t peak_length;
+	
+	/// Upper bound of any element value at any point.
+	uint64_t peak_value;
+	
+} state_t;
+
+/// State of an estimate in progress.
+typedef struct estimator_t
+{
+	/// Program being estimated.
+	const n_program_t* program;
+	
+	/// Number of instructions abstractly interpreted so far.
+	uint64_t work;
+	
+} estimator_t;
+
+/// Adds two bounds, saturating at unbounded.
+static uint64_t add_bounds(uint64_t a, uint64_t b)
+{
+	return (a > UNBOUNDED - b) ? UNBOUNDED : a + b;
+}
+
+/// Multiplies two bounds, saturating at unbounded.
+static uint64_t multiply_bounds(uint64_t a, uint64_t b)
+{
+	return (a && b > UNBOUNDED / a) ? UNBOUNDED : a * b;
+}
+
+/// Returns the larger of two bounds.
+static uint64_t max_bound(uint64_t a, uint64_t b)
+{
+	return (a > b) ? a : b;
+}
+
+/// Returns the smaller of two bounds.
+static uint64_t min_bound(uint64_t a, uint64_t b)
+{
+	return (a < b) ? a : b;
+}
+
+/// Returns the smallest range which contains two ranges.
+static range_t join_ranges(range_t a, range_t b)
+{
+	range_t range = {min_bound(a.min, b.min), max_bound(a.max, b.max)};
+	return range;
+}
+
+/// Adds to a range of values, which may be anything if the values could wrap around.
+static range_t add_range(range_t range, uint64_t min_add, uint64_t max_add)
+{
+	if (range.max > UNBOUNDED - max_add)
+	{
+		range.min = 0;
+		range.max = UNBOUNDED;
+	}
+	else
+	{
+		range.min += min_add;
+		range.max += max_add;
+	}
+	return range;
+}
+
+/// Returns the range of all elements in a state.
+static range_t join_cells(const state_t* state)
+{
+	size_t count = (state->exact) ? state->length_max : 2;
+	range_t range = state->cells[0];
+	for (size_t i = 1; i < count; ++i)
+		range = join_ranges(range, state->cells[i]);
+	return range;
+}
+
+/// Switches a state from bounding each element separately to bounding the first element and all others.
+static void summarize(state_t* state)
+{
+	if (!state->exact)
+		return;
+	
+	// The range of other elements in a singleton is irrelevant, as it is joined with the first element once the sequence grows
+	range_t rest = state->cells[(state->length_max > 1) ? 1 : 0];
+	for (size_t i = 2; i < state->length_max; ++i)
+		rest = join_ranges(rest, state->cells[i]);
+	
+	state->exact = 0;
+	state->cells[1] = rest;
+}
+
+/// Switches a summarized state of known, small length back to bounding each element separately.
+static void expand(state_t* state)
+{
+	if (state->exact || state->length_min != state->length_max || state->length_max > MAX_EXACT_LENGTH)
+		return;
+	
+	for (size_t i = 2; i < state->length_max; ++i)
+		state->cells[i] = state->cells[1];
+	state->exact = 1;
+}
+
+/// Sets the sequence bounds of a state to the widest possible.
+static void widen_fully(state_t* state)
+{
+	range_t any = {0, UNBOUNDED};
+	summarize(state);
+	state->length_min = 1;
+	state->length_max = UNBOUNDED;
+	state->cells[0] = state->cells[1] = any;
+	state->peak_length = UNBOUNDED;
+	state->peak_value = UNBOUNDED;
+}
+
+/// Gives up all bounds of a state.
+static void give_up(state_t* state)
+{
+	widen_fully(state);
+	state->steps = UNBOUNDED;
+}
+
+/// Joins a state into another, so that it bounds both states.
+static void join_states(state_t* state, const state_t* other)
+{
+	state->steps = max_bound(state->steps, other->steps);
+	state->peak_length = max_bound(state->peak_length, other->peak_length);
+	state->peak_value = max_bound(state->peak_value, other->peak_value);
+	
+	if (state->exact && other->exact && state->length_max == other->length_max)
+	{
+		for (size_t i = 0; i < state->length_max; ++i)
+			state->cells[i] = join_ranges(state->cells[i], other->cells[i]);
+		return;
+	}
+	
+	state_t summary = *other;
+	summarize(&summary);
+	summarize(state);
+	state->length_min = min_bound(state->length_min, summary.length_min);
+	state->length_max = max_bound(state->length_max, summary.length_max);
+	state->cells[0] = join_ranges(state->cells[0], summary.cells[0]);
+	state->cells[1] = join_ranges(state->cells[1], summary.cells[1]);
+}
+
+/// Returns non-zero if two states have the same sequence bounds.
+static int equal_states(const state_t* a, const state_t* b)
+{
+	if (a->exact != b->exact || a->length_min != b->length_min || a->length_max != b->length_max)
+		return 0;
+	
+	size_t count = (a->exact) ? a->length_max : 2;
+	return !memcmp(a->cells, b->cells, count * sizeof(range_t));
+}
+
+/// Widens a range which grew since a previous range to its limits.
+static range_t widen_range(range_t range, range_t previous)
+{
+	if (range.min < previous.min)
+		range.min = 0;
+	if (range.max > previous.max)
+		range.max = UNBOUNDED;
+	return range;
+}
+
+/// Widens the sequence bounds of a state which grew since a previous state to their limits.
+static void widen_state(state_t* state, const state_t* previous)
+{
+	if (state->exact && previous->exact && state->length_max == previous->length_max)
+	{
+		for (size_t i = 0; i < state->length_max; ++i)
+			state->cells[i] = widen_range(state->cells[i], previous->cells[i]);
+	}
+	else
+	{
+		state_t summary = *previous;
+		summarize(&summary);
+		summarize(state);
+		state->cells[0] = widen_range(state->cells[0], summary.cells[0]);
+		state->cells[1] = widen_range(state->cells[1], summary.cells[1]);
+		if (state->length_max > summary.length_max)
+			state->length_max = UNBOUNDED;
+		if (state->length_min < summary.length_min)
+			state->length_min = 1;
+	}
+	
+	state->peak_length = max_bound(state->peak_length, state->length_max);
+	state->peak_value = max_bound(state->peak_value, join_cells(state).max);
+}
+
+/// Circular shifts a state by a number of elements, to the left if `left` is non-zero.
+static void shift_state(state_t* state, bignum_t operand, int left)
+{
+	if (!state->exact)
+	{
+		// The first element may be any element after a shift
+		if (state->length_max > 1)
+			state->cells[0] = state->cells[1] = join_ranges(state->cells[0], state->cells[1]);
+		return;
+	}
+	
+	size_t length = state->length_max;
+	size_t offset = operand % length;
+	if (!left)
+		offset = (length - offset) % length;
+	
+	range_t cells[MAX_EXACT_LENGTH];
+	for (size_t i = 0; i < length; ++i)
+		cells[i] = state->cells[(i + offset) % length];
+	memcpy(state->cells, cells, length * sizeof(range_t));
+}
+
+/// Appends copies of the first element to a state.
+static void append_state(state_t* state, bignum_t operand)
+{
+	if (state->exact && state->length_max + operand <= MAX_EXACT_LENGTH)
+	{
+		for (size_t i = 0; i < operand; ++i)
+			state->cells[state->length_max + i] = state->cells[0];
+		state->length_min = state->length_max = state->length_max + operand;
+	}
+	else
+	{
+		summarize(state);
+		state->cells[1] = join_ranges(state->cells[1], state->cells[0]);
+		state->length_min = add_bounds(state->length_min, operand);
+		state->length_max = add_bounds(state->length_max, operand);
+	}
+	
+	state->peak_length = max_bound(state->peak_length, state->length_max);
+}
+
+/// Removes elements from the end of a state.
+static void truncate_state(state_t* state, bignum_t operand)
+{
+	if (state->exact)
+	{
+		state->length_min = state->length_max = (operand < state->length_max) ? state->length_max - operand : 1;
+	}
+	else
+	{
+		state->length_min = (operand < state->length_min) ? state->length_min - operand : 1;
+		if (state->length_max != UNBOUNDED)
+			state->length_max = (operand < state->length_max) ? state->length_max - operand : 1;
+		expand(state);
+	}
+}
+
+static void evaluate(estimator_t* estimator, size_t first, size_t last, state_t* state);
+
+/**
+ * Abstractly interprets a loop whose body only adds, subtracts and shifts, in closed form.
+ *
+ * @param estimator Estimate in progress.
+ * @param start Index of the loop start instruction.
+ * @param end Index of the loop end instruction.
+ * @param trips Range of the loop's trip count.
+ * @param state State before the loop, which is replaced by the state after the loop.
+ */
+static void evaluate_simple_loop(estimator_t* estimator, size_t start, size_t end, range_t trips, state_t* state)
+{
+	const n_instruction_t* instructions = estimator->program->instructions;
+	uint64_t cell_adds[MAX_EXACT_LENGTH];
+	char cell_subs[MAX_EXACT_LENGTH];
+	uint64_t total_add = 0;
+	int subs = 0;
+	size_t length = (state->exact) ? state->length_max : 1;
+	size_t offset = 0;
+	memset(cell_adds, 0, sizeof(cell_adds));
+	memset(cell_subs, 0, sizeof(cell_subs));
+	
+	// Sum the additions to each element relative to the first element at the start of the loop
+	for (size_t ip = start + 1; ip < end; ++ip)
+	{
+		bignum_t operand = instructions[ip].operand;
+		switch (instructions[ip].opcode)
+		{
+			case N_OP_ADD:
+				cell_adds[offset] = add_bounds(cell_adds[offset], operand);
+				total_add = add_bounds(total_add, operand);
+				break;
+			
+			case N_OP_SUB:
+				cell_subs[offset] = 1;
+				subs = 1;
+				break;
+			
+			case N_OP_SHIFT_LEFT:
+				offset = (offset + operand % length) % length;
+				break;
+			
+			case N_OP_SHIFT_RIGHT:
+				offset = (offset + length - operand % length) % length;
+				break;
+		}
+	}
+	
+	if (state->exact && !offset)
+	{
+		for (size_t i = 0; i < length; ++i)
+		{
+			state->cells[i] = add_range(state->cells[i], multiply_bounds(trips.min, cell_adds[i]), multiply_bounds(trips.max, cell_adds[i]));
+			if (cell_subs[i])
+				state->cells[i].min = 0;
+		}
+	}
+	else
+	{
+		// Loops with a net shift may add any part of their total to any element
+		range_t range = add_range(join_cells(state), 0, multiply_bounds(trips.max, total_add));
+		if (subs)
+			range.min = 0;
+		size_t count = (state->exact) ? length : 2;
+		for (size_t i = 0; i < count; ++i)
+			state->cells[i] = range;
+	}
+	
+	state->steps = add_bounds(state->steps, multiply_bounds(trips.max, end - start));
+	state->peak_value = max_bound(state->peak_value, join_cells(state).max);
+}
+
+/**
+ * Abstractly interprets the iterations of a loop which is entered.
+ *
+ * @param estimator Estimate in progress.
+ * @param start Index of the loop start instruction.
+ * @param end Index of the loop end instruction.
+ * @param trips Range of the loop's trip count, which is at least one.
+ * @param state State after the loop start instruction, which is replaced by the state after the loop.
+ */
+static void evaluate_loop_body(estimator_t* estimator, size_t start, size_t end, range_t trips, state_t* state)
+{
+	const n_instruction_t* instructions = estimator->program->instructions;
+	
+	// Classify loop body
+	int simple = 1;
+	for (size_t ip = start + 1; ip < end && simple; ++ip)
+	{
+		uint32_t opcode = instructions[ip].opcode;
+		simple = (opcode == N_OP_ADD || opcode == N_OP_SUB || opcode == N_OP_SHIFT_LEFT || opcode == N_OP_SHIFT_RIGHT);
+	}
+	
+	if (end == start + 2 && instructions[start + 1].opcode == N_OP_SUB)
+	{
+		// Loops which only decrement clear the first element
+		state->cells[0].min = state->cells[0].max = 0;
+		state->steps = add_bounds(state->steps, multiply_bounds(trips.max, 2));
+		return;
+	}
+	
+	if (simple)
+	{
+		evaluate_simple_loop(estimator, start, end, trips, state);
+		return;
+	}
+	
+	// Run iterations which are certain to run one by one
+	uint64_t iteration = 0;
+	for (; iteration < trips.min && iteration < MAX_UNROLL; ++iteration)
+	{
+		evaluate(estimator, start + 1, end, state);
+		state->steps = add_bounds(state->steps, 1);
+	}
+	if (iteration == trips.max)
+		return;
+	
+	// Join the states after each further iteration until they converge, the trip count is reached, or the bounds are widened
+	state_t previous, next;
+	for (uint64_t joins = 1; ; ++joins)
+	{
+		previous = *state;
+		next = *state;
+		evaluate(estimator, start + 1, end, &next);
+		next.steps = add_bounds(next.steps, 1);
+		join_states(state, &next);
+		++iteration;
+		
+		if (equal_states(state, &previous) || iteration == trips.max)
+		{
+			// Remaining iterations of a converged loop each cost as much as the last
+			uint64_t iteration_steps = (next.steps == UNBOUNDED) ? UNBOUNDED : next.steps - previous.steps;
+			state->steps = add_bounds(state->steps, multiply_bounds(trips.max - iteration, iteration_steps));
+			break;
+		}
+		
+		if (joins >= MAX_ITERATIONS)
+		{
+			if (joins < MAX_ITERATIONS + 2)
+				widen_state(state, &previous);
+			else
+				widen_fully(state);
+		}
+	}
+}
+
+/**
+ * Abstractly interprets a loop.
+ *
+ * @param estimator Estimate in progress.
+ * @param start Index of the loop start instruction.
+ * @param state State before the loop start instruction, which is replaced by the state after the loop.
+ *
+ * @return Index of the loop end instruction.
+ */
+static size_t evaluate_loop(estimator_t* estimator, size_t start, state_t* state)
+{
+	const n_program_t* program = estimator->program;
+	const n_instruction_t* instructions = program->instructions;
+	size_t end = instructions[start].operand;
+	range_t trips = state->cells[0];
+	if (!trips.max)
+		return (end < program->instruction_count) ? end : program->instruction_count;
+	
+	// The first element is zero if the loop is skipped, and non-zero otherwise
+	state_t skipped = *state;
+	skipped.cells[0].max = 0;
+	state->cells[0].min = trips.min = max_bound(trips.min, 1);
+	
+	if (end >= program->instruction_count)
+	{
+		// Unmatched loops run once until the end of the program
+		evaluate(estimator, start + 1, program->instruction_count, state);
+		end = program->instruction_count;
+	}
+	else
+	{
+		evaluate_loop_body(estimator, start, end, trips, state);
+	}
+	
+	if (!skipped.cells[0].min)
+		join_states(state, &skipped);
+	
+	return end;
+}
+
+/**
+ * Abstractly interprets a range of instructions.
+ *
+ * @param estimator Estimate in progress.
+ * @param first Index of the first instruction.
+ * @param last Index past the last instruction.
+ * @param state State before the first instruction, which is replaced by the state after the last instruction.
+ */
+static void evaluate(estimator_t* estimator, size_t first, size_t last, state_t* state)
+{
+	const n_instruction_t* instructions = estimator->program->instructions;
+	
+	for (size_t ip = first; ip < last; ++ip)
+	{
+		if (++estimator->work > MAX_WORK)
+		{
+			give_up(state);
+			return;
+		}
+		
+		bignum_t operand = instructions[ip].operand;
+		range_t* head = &state->cells[0];
+		state->steps = add_bounds(state->steps, 1);
+		
+		switch (instructions[ip].opcode)
+		{
+			case N_OP_ADD:
+				*head = add_range(*head, operand, operand);
+				state->peak_value = max_bound(state->peak_value, head->max);
+				break;
+			
+			case N_OP_SUB:
+				head->min = (head->min > operand) ? head->min - operand : 0;
+				head->max = (head->max > operand) ? head->max - operand : 0;
+				break;
+			
+			case N_OP_SHIFT_LEFT:
+				shift_state(state, operand, 1);
+				break;
+			
+			case N_OP_SHIFT_RIGHT:
+				shift_state(state, operand, 0);
+				break;
+			
+			case N_OP_COUNT:
+				head->min = state->length_min;
+				head->max = state->length_max;
+				state->peak_value = max_bound(state->peak_value, head->max);
+				break;
+			
+			case N_OP_APPEND:
+				append_state(state, operand);
+				break;
+			
+			case N_OP_TRUNCATE:
+				truncate_state(state, operand);
+				break;
+			
+			case N_OP_LOOP_START:
+				ip = evaluate_loop(estimator, ip, state);
+				break;
+		}
+	}
+}
+
+void n_program_estimate(const n_program_t* program, size_t input_count, bignum_t input_max, n_estimate_t* estimate)
+{
+	estimator_t estimator;
+	estimator.program = program;
+	estimator.work = 0;
+	
+	// An empty input sequence is replaced by the zero singleton
+	if (!input_count)
+	{
+		input_count = 1;
+		input_max = 0;
+	}
+	
+	state_t state;
+	state.exact = 0;
+	state.length_min = state.length_max = input_count;
+	state.cells[0].min = state.cells[1].min = 0;
+	state.cells[0].max = state.cells[1].max = input_max;
+	state.steps = 0;
+	state.peak_length = input_count;
+	state.peak_value = input_max;
+	expand(&state);
+	
+	evaluate(&estimator, 0, program->instruction_count, &state);
+	
+	estimate->max_steps = state.steps;
+	estimate->max_elements = state.peak_length;
+	estimate->max_value = state.peak_value;
+}
+
+/// Returns the polynomial degree of a bound which grows from `a` to `b` as its input doubles, given that it grew from `c` to `a` as its input previously doubled.
+static int growth_degree(uint64_t c, uint64_t a, uint64_t b)
+{
+	if (b == UNBOUNDED)
+		return N_GROWTH_EXPONENTIAL;
+	if (b <= a || !a || !c)
+		return 0;
+	
+	double ratio = (double)b / (double)a;
+	double previous_ratio = (double)a / (double)c;
+	
+	// Polynomial growth has a constant ratio, while exponential growth has an increasing ratio
+	if (ratio > 4096.0 || ratio > previous_ratio * 2.0)
+		return N_GROWTH_EXPONENTIAL;
+	
+	// Round the base-two logarithm of the ratio to the nearest degree, allowing for lower order terms
+	int degree = 0;
+	for (; ratio > 1.1892; ratio *= 0.5)
+		++degree;
+	return degree;
+}
+
+void n_program_growth(const n_program_t* program, int* steps_degree, int* elements_degree)
+{
+	// Estimate bounds over inputs with both length and element values of 8, 16 and 32, short enough for each element to be bounded separately
+	n_estimate_t estimates[3];
+	for (int i = 0; i < 3; ++i)
+		n_program_estimate(program, (size_t)8 << i, (bignum_t)8 << i, &estimates[i]);
+	
+	*steps_degree = growth_degree(estimates[0].max_steps, estimates[1].max_steps, estimates[2].max_steps);
+	*elements_degree = growth_degree(estimates[0].max_elements, estimates[1].max_elements, estimates[2].max_elements);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_ESTIMATE_H
+#define N_ESTIMATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bignum.h"
+#include "program.h"
+
+/// Growth class of a program which grows faster than any polynomial of its input.
+#define N_GROWTH_EXPONENTIAL -1
+
+/// Upper bounds on the cost of running a program, where `UINT64_MAX` means no bound below 2^64 was found.
+typedef struct n_estimate_t
+{
+	/// Upper bound on the number of executed instructions.
+	uint64_t max_steps;
+	
+	/// Upper bound on the number of elements in the sequence at any point.
+	uint64_t max_elements;
+	
+	/// Upper bound on the value of any element at any point.
+	bignum_t max_value;
+	
+} n_estimate_t;
+
+/**
+ * Estimates upper bounds on the cost of running a program without running it.
+ *
+ * The program is abstractly interpreted on bounds of element values and sequence length. Loops are evaluated using their maximum trip count, with closed forms for loops which only add to and shift the sequence, and loops which otherwise do not converge within a fixed number of iterations are widened to unbounded. The bounds are therefore always safe, but may be far from tight for programs whose values grow inside nested loops.
+ *
+ * @param program Compiled program.
+ * @param input_count Number of elements in the input sequence.
+ * @param input_max Maximum value of any element in the input sequence.
+ * @param[out] estimate Estimated upper bounds.
+ */
+void n_program_estimate(const n_program_t* program, size_t input_count, bignum_t input_max, n_estimate_t* estimate);
+
+/**
+ * Estimates the growth classes of a program's cost, as polynomial degrees in the size of its input. The degrees are found by comparing the upper bounds of `n_program_estimate()` over inputs of increasing length and element value.
+ *
+ * @param program Compiled program.
+ * @param[out] steps_degree Degree of the growth of executed instructions, or `N_GROWTH_EXPONENTIAL`.
+ * @param[out] elements_degree Degree of the growth of sequence length, or `N_GROWTH_EXPONENTIAL`.
+ */
+void n_program_growth(const n_program_t* program, int* steps_degree, int* elements_degree);
+
+#endif // N_ESTIMATE_H
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Interpreter loop, which is included by context.c once for each instantiation. `EXECUTE` names the instantiation, `PROFILE(...)` expands to its arguments in the instantiation which records a profile, and `SAMPLE(...)` in the instantiation which publishes the current instruction to a sampler. Both expand to nothing otherwise.
+
+/**
+ * Executes a program in a context, starting from the context's instruction pointer and loop stack.
+ *
+ * @param context Execution context.
+ * @param program Compiled program.
+ * @param start_time Time at which the run started, as returned by `n_clock()`.
+ */
+static int EXECUTE(n_context_t* context, const n_program_t* program, double start_time)
+{
+	const n_instruction_t* instructions = program->instructions;
+	const size_t instruction_count = program->instruction_count;
+	bignum_t* loop_counters = context->loop_counters;
+	size_t loop_depth = context->loop_depth;
+	
+	bignum_t* elements = context->elements;
+	size_t mask = context->capacity - 1;
+	size_t head = context->head;
+	size_t count = context->count;
+	size_t peak_count = context->peak_count;
+	size_t max_count = append_limit(context);
+	
+	// The number of executed instructions is the instruction pointer plus a base, which is adjusted whenever the instruction pointer jumps
+	size_t ip = context->ip;
+	uint64_t base = context->steps - ip;
+	
+	// Find the number of executed instructions at which limits will next be checked
+	const n_limits_t limits = context->limits;
+	uint64_t check_steps = (limits.max_steps) ? limits.max_steps : UINT64_MAX;
+	volatile sig_atomic_t* interrupt = context->interrupt;
+	if ((limits.max_time > 0.0 || interrupt) && context->steps + N_CHECK_INTERVAL < check_steps)
+		check_steps = context->steps + N_CHECK_INTERVAL;
+	
+	PROFILE(uint64_t* profile_counts = context->profile->counts;)
+	PROFILE(uint64_t* profile_skips = context->profile->skips;)
+	PROFILE(bignum_t* profile_max_trips = context->profile->max_trips;)
+	SAMPLE(volatile size_t* sample_ip = &context->sampler->ip;)
+	
+	int status = N_SUCCESS;
+	for (; ip < instruction_count; ++ip)
+	{
+		const n_instruction_t* instruction = &instructions[ip];
+		bignum_t operand = instruction->operand;
+		PROFILE(++profile_counts[ip];)
+		SAMPLE(*sample_ip = ip;)
+		
+		switch (instruction->opcode)
+		{
+			case N_OP_ADD:
+				elements[head] += operand;
+				break;
+			
+			case N_OP_SUB:
+				elements[head] = (elements[head] > operand) ? elements[head] - operand : 0;
+				break;
+			
+			case N_OP_SHIFT_LEFT:
+				if (count == mask + 1)
+				{
+					// Ring buffer is full, so shifting only moves the head
+					head = (head + operand) & mask;
+				}
+				else
+				{
+					for (operand %= count; operand; --operand)
+					{
+						elements[(head + count) & mask] = elements[head];
+						head = (head + 1) & mask;
+					}
+				}
+				break;
+			
+			case N_OP_SHIFT_RIGHT:
+				if (count == mask + 1)
+				{
+					head = (head - operand) & mask;
+				}
+				else
+				{
+					for (operand %= count; operand; --operand)
+					{
+						head = (head - 1) & mask;
+						elements[head] = elements[(head + count) & mask];
+					}
+				}
+				break;
+			
+			case N_OP_COUNT:
+				elements[head] = count;
+				break;
+			
+			case N_OP_APPEND:
+				if (operand > max_count - count)
+				{
+					// Stop before appending if the element limit would be exceeded
+					if (limits.max_elements && operand > limits.max_elements - count)
+					{
+						status = N_ERROR_ELEMENT_LIMIT;
+						goto stop;
+					}
+					
+					context->head = head;
+					context->count = count;
+					if (n_context_reserve(context, count + operand) != N_SUCCESS)
+					{
+						status = N_ERROR_MEMORY;
+						goto stop;
+					}
+					elements = context->elements;
+					mask = context->capacity - 1;
+					head = context->head;
+					max_count = append_limit(context);
+				}
+				for (; operand; --operand)
+					elements[(head + count++) & mask] = elements[head];
+				if (count > peak_count)
+					peak_count = count;
+				break;
+			
+			case N_OP_TRUNCATE:
+				count -= (operand < count) ? operand : count - 1;
+				break;
+			
+			case N_OP_LOOP_START:
+				if (elements[head])
+				{
+					loop_counters[++loop_depth] = elements[head];
+					PROFILE(if (elements[head] > profile_max_trips[ip]) profile_max_trips[ip] = elements[head];)
+				}
+				else
+				{
+					PROFILE(++profile_skips[ip];)
+					base += ip - operand;
+					ip = operand;
+				}
+				break;
+			
+			case N_OP_LOOP_END:
+				if (--loop_counters[loop_depth])
+				{
+					base += ip - operand;
+					ip = operand;
+					
+					// Check limits
+					if (base + ip >= check_steps)
+					{
+						if (limits.max_steps && base + ip >= limits.max_steps)
+							status = N_ERROR_STEP_LIMIT;
+						else if (limits.max_time > 0.0 && n_clock() - start_time >= limits.max_time)
+							status = N_ERROR_TIME_LIMIT;
+						else if (interrupt && *interrupt)
+							status = N_INTERRUPTED;
+						
+						if (status != N_SUCCESS)
+						{
+							++ip;
+							goto stop;
+						}
+						
+						check_steps = base + ip + N_CHECK_INTERVAL;
+						if (limits.max_steps && limits.max_steps < check_steps)
+							check_steps = limits.max_steps;
+					}
+				}
+				else
+				{
+					--loop_depth;
+				}
+				break;
+		}
+	}
+	
+	stop:
+	SAMPLE(*sample_ip = ip;)
+	context->head = head;
+	context->count = count;
+	context->peak_count = peak_count;
+	context->steps = base + ip;
+	context->ip = ip;
+	context->loop_depth = loop_depth;
+	
+	return status;
+}
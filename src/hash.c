@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hash.h"
+#include <string.h>
+
+/// Mixes a 64-bit word into a hash.
+static uint64_t mix(uint64_t hash, uint64_t word)
+{
+	word *= 0x9E3779B97F4A7C15ULL;
+	word ^= word >> 32;
+	hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+	return hash ^ (hash >> 29);
+}
+
+uint64_t n_hash(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = data;
+	uint64_t hash = seed ^ 0x94D049BB133111EBULL;
+	uint64_t word;
+	
+	// Hash whole words
+	for (; size >= sizeof(word); size -= sizeof(word), bytes += sizeof(word))
+	{
+		memcpy(&word, bytes, sizeof(word));
+		hash = mix(hash, word);
+	}
+	
+	// Hash remaining bytes, along with their count
+	word = 0;
+	memcpy(&word, bytes, size);
+	hash = mix(hash, word ^ ((uint64_t)size << 56));
+	
+	return mix(hash, 0);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_HASH_H
+#define N_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Calculates a 64-bit non-cryptographic hash of a block of memory.
+ *
+ * @param data Data to hash.
+ * @param size Size of the data, in bytes.
+ * @param seed Initial hash value, which can be the hash of a previous block to hash several blocks as one.
+ */
+uint64_t n_hash(const void* data, size_t size, uint64_t seed);
+
+#endif // N_HASH_H
@@ -18,7 +18,10 @@
  */
 
 #include "interpret.h"
+#include "context.h"
+#include "program.h"
 #include <stdlib.h>
+#include <string.h>
 
 void n_interpret(const char* source, element_t** sequence)
 {
@@ -26,110 +29,43 @@ void n_interpret(const char* source, element_t** sequence)
 	if (!source || !*source || !sequence)
 		return;
 	
-	// Get a pointer to the first element in the sequence
-	element_t* head = *sequence;
-	
 	// If input sequence is empty, create a zero singleton
-	if (!head)
-		head = append_sequence(0, 0);
-	
-	// Count number of elements in the sequence;
-	size_t element_count = count_elements(head);
+	if (!*sequence)
+		*sequence = append_sequence(0, 0);
 	
-	// Count number of instructions
-	size_t instruction_count = strlen(source);
+	// Compile program
+	n_program_t* program = n_program_compile(source, strlen(source));
+	n_context_t* context = n_context_create();
 	
-	// Count max loop depth
-	size_t loop_depth = 0;
-	size_t max_loop_depth = 0;
-	for (const char* c = source; *c; ++c)
+	// Copy input sequence into context
+	size_t element_count = count_elements(*sequence);
+	bignum_t* input = malloc(element_count * sizeof(bignum_t));
+	if (!program || !context || !input)
 	{
-		if (*c == '[')
-			max_loop_depth += (++loop_depth > max_loop_depth);
-		else if (*c == ']')
-			loop_depth -= !!loop_depth;
+		free(input);
+		n_context_free(context);
+		n_program_free(program);
+		return;
 	}
+	element_t* element = *sequence;
+	for (size_t i = 0; i < element_count; ++i, element = element->next)
+		input[i] = element->value;
 	
-	// Allocate loop stacks
-	loop_depth = 0;
-	bignum_t* loop_counters = calloc(max_loop_depth + 1, sizeof(bignum_t));
-	size_t* loop_headers = malloc((max_loop_depth + 1) * (sizeof(size_t)));
-	size_t skipped_loops = 0;
-	
-	for (size_t ip = 0; ip < instruction_count; ++ip)
+	// Interpret program then replace input sequence with output sequence
+	if (n_context_run(context, program, input, element_count) == N_SUCCESS)
 	{
-		char i = source[ip];
+		const bignum_t* output = n_context_result(context, &element_count);
+		
+		free_sequence(*sequence);
+		element_t* head = 0;
+		for (size_t i = element_count; i; --i)
+			head = append_sequence(head, output[i - 1]);
 		
-		if (!skipped_loops)
-		{
-			switch (i)
-			{
-				case '+':
-					++head->value;
-					break;
-				
-				case '-':
-					head->value -= !!head->value;
-					break;
-				
-				case '>':
-					head = head->previous;
-					break;
-				
-				case '<':
-					head = head->next;
-					break;
-				
-				case '[':
-					if (head->value)
-					{
-						++loop_depth;
-						loop_counters[loop_depth] = head->value;
-						loop_headers[loop_depth] = ip;
-					}
-					else
-					{
-						++skipped_loops;
-					}
-					break;
-				
-				case ']':
-					if (loop_depth)
-					{
-						if (--loop_counters[loop_depth])
-							ip = loop_headers[loop_depth];
-						else
-							--loop_depth;
-					}
-					break;
-				
-				case ':':
-					append_sequence(head, head->value);
-					++element_count;
-					break;
-				
-				case '|':
-					element_count -= truncate_sequence(head);
-					break;
-				
-				case '#':
-					head->value = element_count;
-					break;
-			}
-		}
-		else
-		{
-			if (i == '[')
-				++skipped_loops;
-			else if (i == ']')
-				--skipped_loops;
-		}
+		// Redirect sequence pointer to first element
+		*sequence = head;
 	}
 	
-	// Free loop stacks
-	free(loop_headers);
-	free(loop_counters);
-	
-	// Redirect sequence pointer to first element
-	*sequence = head;
+	free(input);
+	n_context_free(context);
+	n_program_free(program);
 }
@@ -25,6 +25,9 @@
 /**
  * Interprets an (N) program, transforming the input sequence.
  *
+ * The program is compiled and run in a temporary execution context on every call. Programs which are run repeatedly should instead be compiled once with `n_program_compile()` and run with `n_context_run()`.
+ *
+ * @param source (N) source code.
  * @param sequence Reference to the pointer to the first element in the input sequence.
  */
 void n_interpret(const char* source, element_t** sequence);
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memo.h"
+#include "cache.h"
+#include "hash.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_MEMO_POSIX
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <utime.h>
+#endif
+
+#define STAT_HITS 0
+#define STAT_MISSES 1
+#define STAT_STORES 2
+#define STAT_SKIPS 3
+#define STAT_SIZE 4
+#define STAT_COUNT 5
+
+/// Magic number at the start of stored result files.
+static const char memo_magic[8] = {'(', 'N', ')', 'M', 'E', 'M', 'O', '\0'};
+
+/// File name extension of stored result files.
+static const char* memo_extension = ".nm";
+
+/// Header of a stored result file, which is followed by the input then output sequence.
+typedef struct memo_header_t
+{
+	/// Magic number identifying the file as a stored result.
+	char magic[8];
+	
+	/// Hash of the interpreter version and program format.
+	uint64_t version_hash;
+	
+	/// Hash of the program.
+	uint64_t program_hash;
+	
+	/// Number of instructions executed by the run which computed the result.
+	uint64_t steps;
+	
+	/// Largest number of elements in the sequence during the run which computed the result.
+	uint64_t peak_count;
+	
+	/// Run time of the run which computed the result, in seconds.
+	double time;
+	
+	/// Number of elements in the input sequence.
+	uint64_t input_count;
+	
+	/// Number of elements in the output sequence.
+	uint64_t output_count;
+	
+} memo_header_t;
+
+/// Record of a stored result file, used for eviction.
+typedef struct memo_file_t
+{
+	/// File name.
+	char* name;
+	
+	/// Size of the file, in bytes.
+	uint64_t size;
+	
+	/// Last time the file was used.
+	int64_t time;
+	
+} memo_file_t;
+
+/// Returns the path of the stored result file for a program and input sequence.
+static char* result_path(const n_memo_t* memo, uint64_t program_hash, const bignum_t* input, size_t input_count)
+{
+	uint64_t key = n_hash(input, input_count * sizeof(bignum_t), n_hash(&program_hash, sizeof(program_hash), n_cache_version()));
+	char* path = malloc(strlen(memo->directory) + 32);
+	if (path)
+		sprintf(path, "%s/%016" PRIx64 "%s", memo->directory, key, memo_extension);
+	return path;
+}
+
+/**
+ * Adds the statistics counted by this process to the statistics file of a result memoization store, and updates the total size of stored results which it records.
+ *
+ * @param memo Result memoization store.
+ * @param size_change Change in the total size of stored results, in bytes.
+ * @param size If not null, the total size of stored results, which replaces the recorded size.
+ *
+ * @return Total size of stored results, or `UINT64_MAX` if the statistics file did not yet record it.
+ */
+static uint64_t flush_stats(n_memo_t* memo, int64_t size_change, const uint64_t* size)
+{
+	uint64_t total_size = 0;
+	
+	#if defined(N_MEMO_POSIX)
+		char* path = malloc(strlen(memo->directory) + 16);
+		if (!path)
+			return total_size;
+		sprintf(path, "%s/stats", memo->directory);
+		int file = open(path, O_RDWR | O_CREAT, 0666);
+		free(path);
+		if (file < 0)
+			return total_size;
+		
+		// Lock statistics file while it is updated by this process
+		struct flock lock;
+		memset(&lock, 0, sizeof(lock));
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		if (!fcntl(file, F_SETLKW, &lock))
+		{
+			uint64_t stats[STAT_COUNT] = {0, 0, 0, 0, 0};
+			ssize_t read_size = pread(file, stats, sizeof(stats), 0);
+			if (read_size < 0)
+				memset(stats, 0, sizeof(stats));
+			for (size_t i = 0; i < 4; ++i)
+				stats[i] += memo->counts[i];
+			
+			// Files written before the size was recorded must be scanned once to find it
+			if (size)
+				stats[STAT_SIZE] = *size;
+			else if (size_change < 0 && (uint64_t)-size_change > stats[STAT_SIZE])
+				stats[STAT_SIZE] = 0;
+			else
+				stats[STAT_SIZE] += size_change;
+			total_size = (size || read_size == (ssize_t)sizeof(stats)) ? stats[STAT_SIZE] : UINT64_MAX;
+			
+			if (pwrite(file, stats, sizeof(stats), 0) == (ssize_t)sizeof(stats))
+				memset(memo->counts, 0, sizeof(memo->counts));
+			
+			lock.l_type = F_UNLCK;
+			fcntl(file, F_SETLK, &lock);
+		}
+		close(file);
+	#else
+		(void)memo;
+		(void)size_change;
+		(void)size;
+	#endif
+	
+	return total_size;
+}
+
+/// Orders stored result files from least to most recently used.
+static int compare_files(const void* a, const void* b)
+{
+	int64_t time_a = ((const memo_file_t*)a)->time;
+	int64_t time_b = ((const memo_file_t*)b)->time;
+	return (time_a > time_b) - (time_a < time_b);
+}
+
+/// Evicts least recently used results until a result memoization store is within its size limit, scanning its directory for the size and last use time of each result.
+static void evict_results(n_memo_t* memo)
+{
+	#if defined(N_MEMO_POSIX)
+		DIR* directory = opendir(memo->directory);
+		if (!directory)
+			return;
+		
+		size_t directory_length = strlen(memo->directory);
+		size_t extension_length = strlen(memo_extension);
+		size_t file_count = 0;
+		size_t file_capacity = 64;
+		memo_file_t* files = malloc(file_capacity * sizeof(memo_file_t));
+		uint64_t total_size = 0;
+		char* path = malloc(directory_length + 256 + 2);
+		
+		// Find the size and last use time of each stored result
+		struct dirent* entry;
+		while (files && path && (entry = readdir(directory)))
+		{
+			size_t name_length = strlen(entry->d_name);
+			if (name_length > 255 || name_length <= extension_length || strcmp(entry->d_name + name_length - extension_length, memo_extension))
+				continue;
+			
+			sprintf(path, "%s/%s", memo->directory, entry->d_name);
+			struct stat status;
+			if (stat(path, &status))
+				continue;
+			
+			if (file_count == file_capacity)
+			{
+				memo_file_t* grown_files = realloc(files, (file_capacity *= 2) * sizeof(memo_file_t));
+				if (!grown_files)
+					break;
+				files = grown_files;
+			}
+			
+			files[file_count].name = malloc(name_length + 1);
+			if (!files[file_count].name)
+				break;
+			strcpy(files[file_count].name, entry->d_name);
+			files[file_count].size = status.st_size;
+			files[file_count].time = status.st_mtime;
+			total_size += status.st_size;
+			++file_count;
+		}
+		closedir(directory);
+		
+		// Remove least recently used results, then record the size of those which remain
+		if (files && path)
+		{
+			if (total_size > memo->max_size)
+			{
+				qsort(files, file_count, sizeof(memo_file_t), compare_files);
+				for (size_t i = 0; i < file_count && total_size > memo->max_size; ++i)
+				{
+					sprintf(path, "%s/%s", memo->directory, files[i].name);
+					if (!unlink(path))
+						total_size -= files[i].size;
+				}
+			}
+			flush_stats(memo, 0, &total_size);
+		}
+		
+		for (size_t i = 0; files && i < file_count; ++i)
+			free(files[i].name);
+		free(files);
+		free(path);
+	#else
+		(void)memo;
+	#endif
+}
+
+n_memo_t* n_memo_open(const char* directory, uint64_t max_size, double min_time)
+{
+	n_memo_t* memo = malloc(sizeof(n_memo_t));
+	if (!memo)
+		return 0;
+	
+	memo->directory = malloc(strlen(directory) + 1);
+	if (!memo->directory)
+	{
+		free(memo);
+		return 0;
+	}
+	strcpy(memo->directory, directory);
+	memo->max_size = max_size;
+	memo->min_time = min_time;
+	memset(memo->counts, 0, sizeof(memo->counts));
+	
+	#if defined(N_MEMO_POSIX)
+		mkdir(directory, 0777);
+	#endif
+	
+	return memo;
+}
+
+void n_memo_close(n_memo_t* memo)
+{
+	if (!memo)
+		return;
+	
+	flush_stats(memo, 0, 0);
+	free(memo->directory);
+	free(memo);
+}
+
+uint64_t n_program_hash(const n_program_t* program)
+{
+	uint64_t hash = program->instruction_count;
+	for (size_t i = 0; i < program->instruction_count; ++i)
+	{
+		uint64_t words[2] = {program->instructions[i].opcode, program->instructions[i].operand};
+		hash = n_hash(words, sizeof(words), hash);
+	}
+	
+	return hash;
+}
+
+int n_memo_lookup(n_memo_t* memo, uint64_t program_hash, const bignum_t* input, size_t input_count, const n_limits_t* limits, n_memo_entry_t* entry)
+{
+	char* path = result_path(memo, program_hash, input, input_count);
+	if (!path)
+		return 0;
+	
+	// Map stored result, if any
+	size_t size = 0;
+	void* mapping = n_cache_map(path, &size);
+	int hit = 0;
+	if (mapping && size >= sizeof(memo_header_t) && !((size - sizeof(memo_header_t)) % sizeof(bignum_t)))
+	{
+		// Check that the stored result is for the same program and input sequence, and that its run was within the limits
+		const memo_header_t* header = mapping;
+		const bignum_t* stored_input = (const bignum_t*)(header + 1);
+		size_t element_count = (size - sizeof(memo_header_t)) / sizeof(bignum_t);
+		if (!memcmp(header->magic, memo_magic, sizeof(memo_magic)) &&
+			header->version_hash == n_cache_version() &&
+			header->program_hash == program_hash &&
+			(!limits->max_steps || header->steps <= limits->max_steps) &&
+			(!limits->max_elements || header->peak_count <= limits->max_elements) &&
+			(limits->max_time <= 0.0 || header->time <= limits->max_time) &&
+			header->input_count == input_count &&
+			input_count <= element_count &&
+			header->output_count == element_count - input_count &&
+			!memcmp(stored_input, input, input_count * sizeof(bignum_t)))
+		{
+			entry->output = stored_input + input_count;
+			entry->output_count = header->output_count;
+			entry->mapping = mapping;
+			entry->mapping_size = size;
+			hit = 1;
+			
+			// Mark stored result as recently used
+			#if defined(N_MEMO_POSIX)
+				utime(path, 0);
+			#endif
+		}
+	}
+	if (mapping && !hit)
+		n_cache_unmap(mapping, size);
+	
+	++memo->counts[(hit) ? STAT_HITS : STAT_MISSES];
+	
+	free(path);
+	return hit;
+}
+
+void n_memo_release(n_memo_entry_t* entry)
+{
+	if (entry->mapping)
+		n_cache_unmap(entry->mapping, entry->mapping_size);
+	entry->mapping = 0;
+}
+
+int n_memo_store(n_memo_t* memo, uint64_t program_hash, const bignum_t* input, size_t input_count, const bignum_t* output, size_t output_count, uint64_t steps, size_t peak_count, double time)
+{
+	// Skip results which are cheaper to compute than to store, or too large to store
+	uint64_t size = sizeof(memo_header_t) + (uint64_t)(input_count + output_count) * sizeof(bignum_t);
+	if (time < memo->min_time || size > memo->max_size)
+	{
+		++memo->counts[STAT_SKIPS];
+		return 0;
+	}
+	
+	char* path = result_path(memo, program_hash, input, input_count);
+	char* temporary_path = (path) ? malloc(strlen(path) + 32) : 0;
+	if (!temporary_path)
+	{
+		free(path);
+		return 0;
+	}
+	#if defined(N_MEMO_POSIX)
+		sprintf(temporary_path, "%s.%ld.tmp", path, (long)getpid());
+	#else
+		sprintf(temporary_path, "%s.tmp", path);
+	#endif
+	
+	memo_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, memo_magic, sizeof(memo_magic));
+	header.version_hash = n_cache_version();
+	header.program_hash = program_hash;
+	header.steps = steps;
+	header.peak_count = peak_count;
+	header.time = time;
+	header.input_count = input_count;
+	header.output_count = output_count;
+	
+	// Find the size of any stored result which will be replaced
+	int64_t size_change = (int64_t)size;
+	#if defined(N_MEMO_POSIX)
+		struct stat status;
+		if (!stat(path, &status))
+			size_change -= status.st_size;
+	#endif
+	
+	// Write result to temporary file, then replace stored result file
+	int stored = 0;
+	FILE* file = fopen(temporary_path, "wb");
+	if (file)
+	{
+		stored = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(input, sizeof(bignum_t), input_count, file) == input_count &&
+			fwrite(output, sizeof(bignum_t), output_count, file) == output_count;
+		if (fclose(file))
+			stored = 0;
+		
+		if (stored)
+		{
+			#if !defined(N_MEMO_POSIX)
+				remove(path);
+			#endif
+			stored = !rename(temporary_path, path);
+		}
+		if (!stored)
+			remove(temporary_path);
+	}
+	
+	free(temporary_path);
+	free(path);
+	
+	// Record the size of the stored result, and evict results only once the store is over its size limit
+	if (stored)
+	{
+		++memo->counts[STAT_STORES];
+		if (flush_stats(memo, size_change, 0) > memo->max_size)
+			evict_results(memo);
+	}
+	
+	return stored;
+}
+
+void n_memo_stats(n_memo_t* memo, n_memo_stats_t* stats)
+{
+	uint64_t counts[STAT_COUNT] = {0, 0, 0, 0, 0};
+	flush_stats(memo, 0, 0);
+	
+	char* path = malloc(strlen(memo->directory) + 16);
+	if (path)
+	{
+		sprintf(path, "%s/stats", memo->directory);
+		#if defined(N_MEMO_POSIX)
+			int file = open(path, O_RDONLY);
+			if (file >= 0)
+			{
+				// Lock statistics file while it is read, so updates by other processes are not torn
+				struct flock lock;
+				memset(&lock, 0, sizeof(lock));
+				lock.l_type = F_RDLCK;
+				lock.l_whence = SEEK_SET;
+				if (!fcntl(file, F_SETLKW, &lock))
+				{
+					if (pread(file, counts, sizeof(counts), 0) <= 0)
+						memset(counts, 0, sizeof(counts));
+					
+					lock.l_type = F_UNLCK;
+					fcntl(file, F_SETLK, &lock);
+				}
+				close(file);
+			}
+		#else
+			FILE* file = fopen(path, "rb");
+			if (file)
+			{
+				if (!fread(counts, 1, sizeof(counts), file))
+					memset(counts, 0, sizeof(counts));
+				fclose(file);
+			}
+		#endif
+		free(path);
+	}
+	
+	stats->hits = counts[STAT_HITS];
+	stats->misses = counts[STAT_MISSES];
+	stats->stores = counts[STAT_STORES];
+	stats->skips = counts[STAT_SKIPS];
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_MEMO_H
+#define N_MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bignum.h"
+#include "context.h"
+#include "program.h"
+
+/**
+ * Result memoization store.
+ *
+ * (N) programs are pure functions of their input sequence, so the output of a program can be stored and returned again for the same input without interpreting it. Results are stored in a directory, one file per (program, input) pair, and the least recently used results are evicted once the directory grows beyond its size limit. Files are memory-mapped when read, so the operating system's page cache shares recently used results between processes.
+ *
+ * The total size of stored results is kept in the store's statistics file, so the directory is only scanned when a store takes it over its size limit. Statistics are counted in memory and added to the file when the store is closed.
+ */
+typedef struct n_memo_t
+{
+	/// Path to the store directory.
+	char* directory;
+	
+	/// Maximum total size of stored results, in bytes.
+	uint64_t max_size;
+	
+	/// Minimum run time of a program, in seconds, below which its results are not stored.
+	double min_time;
+	
+	/// Statistics counted since they were last added to the statistics file.
+	uint64_t counts[4];
+	
+} n_memo_t;
+
+/// Result memoization statistics, accumulated across all processes sharing a store.
+typedef struct n_memo_stats_t
+{
+	/// Number of lookups which found a stored result.
+	uint64_t hits;
+	
+	/// Number of lookups which did not find a stored result.
+	uint64_t misses;
+	
+	/// Number of results stored.
+	uint64_t stores;
+	
+	/// Number of results not stored because their programs ran faster than the minimum run time.
+	uint64_t skips;
+	
+} n_memo_stats_t;
+
+/// Result returned by a successful memoization lookup.
+typedef struct n_memo_entry_t
+{
+	/// Stored output sequence.
+	const bignum_t* output;
+	
+	/// Number of elements in the output sequence.
+	size_t output_count;
+	
+	/// Memory-mapped file containing the result.
+	void* mapping;
+	
+	/// Size of the memory-mapped file, in bytes.
+	size_t mapping_size;
+	
+} n_memo_entry_t;
+
+/**
+ * Opens a result memoization store, creating its directory if it does not exist.
+ *
+ * @param directory Path to the store directory.
+ * @param max_size Maximum total size of stored results, in bytes.
+ * @param min_time Minimum run time of a program, in seconds, below which its results are not stored.
+ */
+n_memo_t* n_memo_open(const char* directory, uint64_t max_size, double min_time);
+
+/// Closes a result memoization store, adding its statistics to the statistics file.
+void n_memo_close(n_memo_t* memo);
+
+/// Calculates a hash which identifies the behavior of a compiled program.
+uint64_t n_program_hash(const n_program_t* program);
+
+/**
+ * Looks up the stored output of a program for an input sequence. Results are stored with the instructions, peak elements and time of the run which computed them, and a result whose run would have exceeded the given limits is not used, so that the program is run and stopped by the limit as it would be without memoization.
+ *
+ * @param memo Result memoization store.
+ * @param program_hash Hash of the program, as returned by `n_program_hash()`.
+ * @param input Array of input sequence elements.
+ * @param input_count Number of input sequence elements.
+ * @param limits Execution limits of the run which the result would replace.
+ * @param[out] entry Stored result, which must be released with `n_memo_release()`.
+ *
+ * @return `1` if a result was found, `0` otherwise.
+ */
+int n_memo_lookup(n_memo_t* memo, uint64_t program_hash, const bignum_t* input, size_t input_count, const n_limits_t* limits, n_memo_entry_t* entry);
+
+/// Releases a result returned by `n_memo_lookup()`.
+void n_memo_release(n_memo_entry_t* entry);
+
+/**
+ * Stores the output of a program for an input sequence, if the program's run time was not below the minimum run time. Least recently used results are evicted to keep the store within its size limit.
+ *
+ * @param memo Result memoization store.
+ * @param program_hash Hash of the program, as returned by `n_program_hash()`.
+ * @param input Array of input sequence elements.
+ * @param input_count Number of input sequence elements.
+ * @param output Array of output sequence elements.
+ * @param output_count Number of output sequence elements.
+ * @param steps Number of instructions executed by the program.
+ * @param peak_count Largest number of elements in the sequence during the run.
+ * @param time Run time of the program, in seconds.
+ *
+ * @return `1` if the result was stored, `0` otherwise.
+ */
+int n_memo_store(n_memo_t* memo, uint64_t program_hash, const bignum_t* input, size_t input_count, const bignum_t* output, size_t output_count, uint64_t steps, size_t peak_count, double time);
+
+/// Reads the accumulated statistics of a result memoization store, including those counted by this process.
+void n_memo_stats(n_memo_t* memo, n_memo_stats_t* stats);
+
+#endif // N_MEMO_H
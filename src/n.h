@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_H
+#define N_H
+
+/**
+ * libn, the embeddable (N) interpreter library.
+ *
+ * A program is compiled once with `n_program_compile()`, after which it is immutable and may be shared between threads. Each thread creates its own `n_context_t` with `n_context_create()`, then calls `n_context_run()` and `n_context_result()` as many times as required. Contexts keep their sequence and loop storage between runs, so no memory is allocated once they have grown to fit the workload.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "bignum.h"
+#include "program.h"
+#include "context.h"
+#include "batch.h"
+#include "cache.h"
+#include "clock.h"
+#include "constant.h"
+#include "estimate.h"
+#include "hash.h"
+#include "memo.h"
+#include "profile.h"
+#include "sample.h"
+#include "share.h"
+#include "snapshot.h"
+#include "preprocess.h"
+#include "sequence.h"
+#include "interpret.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // N_H
@@ -17,161 +17,1733 @@
  * along with n2c.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctype.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "bignum.h"
+#include "constant.h"
 #include "preprocess.h"
+#include "program.h"
+#include "specialize.h"
 
-const char* bootstrap_header = "#include <inttypes.h>\n#include <stdlib.h>\n#in"
-"clude <stdio.h>\ntypedef uint64_t n;typedef struct e{struct e*l,*r;n v;}e;e*a("
-"e*h,n v){e*t=malloc(sizeof(e));t->v=v;if(h){t->l=h->l;t->r=h;h->l->r=t;h->l=t;"
-"}else t->l=t->r=t;return t;}int x(e*h){if(h->l!=h){e*t=h->l;t->l->r=h;h->l=t->"
-"l;free(t);return 1;}return 0;}int main(int m,char**s){e* h=0,*o;n v,c=0;for(;-"
-"-m;)if(sscanf(s[m],\"%llu\",&v)){h=a(h,v);++c;}if(!h){h=a(h,0);c=1;}";
-
-const char* bootstrap_footer = "o=h;do{printf(\"%llu\",o->v);o=o->r;if(o!=h)put"
-"char(32);}while(o!=h);return 0;}";
-
-const char* op_inc = "++h->v;";
-const char* op_dec = "h->v-=!!h->v;";
-const char* op_car = "h->v=c;";
-const char* op_rsh = "h=h->l;";
-const char* op_lsh = "h=h->r;";
-const char* op_app = "a(h,h->v);";
-const char* op_trn = "c-=x(h);";
-const char* op_lst = "for(int i=h->v;i;--i){";
+// Runtime of the generated C, which keeps the sequence in a ring buffer of `m + 1` elements, whose first element is at index `h`, with `c` elements.
+// The helper function grows the ring buffer, returning zero if it could not be grown, and the macros shift, append and truncate as the interpreter does.
+const char* runtime_header =
+"#include <inttypes.h>\n"
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"#include <string.h>\n"
+"typedef uint64_t n;\n"
+"static n*g(n*e,size_t*m,size_t h,size_t c,size_t k){\n"
+"size_t z=*m+1,i;n*t;\n"
+"if(k>SIZE_MAX/2/sizeof(n)-c)return 0;\n"
+"while(z<c+k)z<<=1;\n"
+"t=malloc(z*sizeof(n));\n"
+"if(!t)return 0;\n"
+"for(i=0;i<c;++i)t[i]=e[(h+i)&*m];\n"
+"free(e);*m=z-1;return t;}\n"
+"#define L(k) {n j=((k)<c)?(k):(k)%c;if(c==m+1)h=(h+j)&m;else for(;j;--j){e[(h+c)&m]=e[h];h=(h+1)&m;}}\n"
+"#define R(k) {n j=((k)<c)?(k):(k)%c;if(c==m+1)h=(h-j)&m;else for(;j;--j){h=(h-1)&m;e[h]=e[(h+c)&m];}}\n"
+"#define A(k) {n j=(k);if(j>m+1-c){n*u=g(e,&m,h,c,j);if(!u)Z e=u;h=0;}for(;j;--j)e[(h+c++)&m]=e[h];}\n"
+"#define T(k) {n j=(k);c-=(j<c)?j:c-1;}\n";
+
+// Failure of the standalone program, or of the library function, when the ring buffer cannot be grown.
+const char* program_failure = "#define Z {fputs(\"Out of memory\\n\",stderr);free(e);return 1;}\n";
+const char* function_failure = "#define Z {free(e);return 1;}\n";
+
+// Standalone program, whose helper functions append an element, read elements from stdin, and write the sequence to stdout.
+const char* program_header =
+"static n*p(n*e,size_t*m,size_t*c,n v){\n"
+"if(*c>*m){n*t=g(e,m,0,*c,1);if(!t){fputs(\"Out of memory\\n\",stderr);exit(1);}e=t;}\n"
+"e[(*c)++]=v;return e;}\n"
+"static n*r(n*e,size_t*m,size_t*c){\n"
+"static char b[65536];size_t z,i;n v=0;int d=0;\n"
+"while((z=fread(b,1,sizeof b,stdin))>0)for(i=0;i<z;++i){\n"
+"if(b[i]>='0'&&b[i]<='9'){v=v*10+(n)(b[i]-'0');d=1;}\n"
+"else if(d){e=p(e,m,c,v);v=0;d=0;}}\n"
+"if(d)e=p(e,m,c,v);\n"
+"return e;}\n"
+"static void o(const n*e,size_t m,size_t h,size_t c){\n"
+"static char b[65536];char t[20];size_t z=0,i;int k;n v;\n"
+"for(i=0;i<c;++i){\n"
+"if(z>sizeof b-21){fwrite(b,1,z,stdout);z=0;}\n"
+"if(i)b[z++]=' ';\n"
+"v=e[(h+i)&m];k=0;do t[k++]=(char)('0'+v%10);while(v/=10);\n"
+"while(k)b[z++]=t[--k];}\n"
+"fwrite(b,1,z,stdout);}\n"
+"int main(int argc,char**argv){\n"
+"size_t m=15,h=0,c=0;int i;char*x;n v;\n"
+"n*e=malloc(16*sizeof(n));\n"
+"if(!e){fputs(\"Out of memory\\n\",stderr);return 1;}\n"
+"for(i=1;i<argc;++i){\n"
+"if(!strcmp(argv[i],\"-\")){e=r(e,&m,&c);continue;}\n"
+"v=strtoull(argv[i],&x,10);if(x!=argv[i])e=p(e,&m,&c,v);}\n"
+"if(!c)e[c++]=0;\n";
+
+const char* program_footer = "o(e,m,h,c);free(e);return 0;}\n";
+
+// Library function, which copies its input into a new ring buffer and hands the ring buffer back as its output once it is contiguous.
+const char* function_header =
+"int %s(const uint64_t*in,size_t k,uint64_t**out,size_t*out_count){\n"
+"size_t m=15,h=0,c=(k)?k:1,i;n*e;\n"
+"if(k>SIZE_MAX/2/sizeof(n))return 1;\n"
+"while(m+1<c)m=m*2+1;\n"
+"e=malloc((m+1)*sizeof(n));\n"
+"if(!e)return 1;\n"
+"if(k)memcpy(e,in,k*sizeof(n));else e[0]=0;\n";
+
+const char* function_footer =
+"if(h+c>m+1){n*u=malloc(c*sizeof(n));if(!u)Z for(i=0;i<c;++i)u[i]=e[(h+i)&m];free(e);e=u;}\n"
+"else if(h)memmove(e,e+h,c*sizeof(n));\n"
+"*out=e;*out_count=c;return 0;}\n";
+
+// Declaration of a library function, with its name in upper case and twice in lower case.
+const char* function_declaration =
+"#ifndef N2C_%s_H\n"
+"#define N2C_%s_H\n"
+"\n"
+"#include <stddef.h>\n"
+"#include <stdint.h>\n"
+"\n"
+"#ifdef __cplusplus\n"
+"extern \"C\" {\n"
+"#endif\n"
+"\n"
+"/**\n"
+" * Runs the (N) program `%s` on an input sequence. The function is reentrant, so it may be called from any number of threads at once.\n"
+" *\n"
+" * @param input Array of input sequence elements. If empty, the input sequence will be the zero singleton.\n"
+" * @param input_count Number of input sequence elements.\n"
+" * @param[out] output Output sequence elements, which must be deallocated with `free()`.\n"
+" * @param[out] output_count Number of output sequence elements.\n"
+" *\n"
+" * @return `0`, or `1` if memory could not be allocated.\n"
+" */\n"
+"int %s(const uint64_t* input, size_t input_count, uint64_t** output, size_t* output_count);\n"
+"\n"
+"#ifdef __cplusplus\n"
+"}\n"
+"#endif\n"
+"\n"
+"#endif\n";
+
+// Batch driver, which reads one input sequence per line and writes one output sequence per line, running the library function on batches of lines across threads unless `N_NO_THREADS` is defined.
+const char* driver_source =
+"#include <inttypes.h>\n"
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"#include <string.h>\n"
+"#ifndef N_NO_THREADS\n"
+"#include <pthread.h>\n"
+"#include <unistd.h>\n"
+"#endif\n"
+"\n"
+"int N_PROGRAM(const uint64_t* input, size_t input_count, uint64_t** output, size_t* output_count);\n"
+"\n"
+"#define BATCH_SIZE 4096\n"
+"\n"
+"typedef struct job_t\n"
+"{\n"
+"\tuint64_t* input;\n"
+"\tsize_t input_count;\n"
+"\tuint64_t* output;\n"
+"\tsize_t output_count;\n"
+"\tint status;\n"
+"} job_t;\n"
+"\n"
+"typedef struct batch_t\n"
+"{\n"
+"\tjob_t* jobs;\n"
+"\tsize_t count;\n"
+"\tsize_t next;\n"
+"#ifndef N_NO_THREADS\n"
+"\tpthread_mutex_t mutex;\n"
+"#endif\n"
+"} batch_t;\n"
+"\n"
+"static void* run_batch(void* data)\n"
+"{\n"
+"\tbatch_t* batch = data;\n"
+"\tfor (;;)\n"
+"\t{\n"
+"#ifndef N_NO_THREADS\n"
+"\t\tpthread_mutex_lock(&batch->mutex);\n"
+"#endif\n"
+"\t\tsize_t i = batch->next++;\n"
+"#ifndef N_NO_THREADS\n"
+"\t\tpthread_mutex_unlock(&batch->mutex);\n"
+"#endif\n"
+"\t\tif (i >= batch->count)\n"
+"\t\t\treturn 0;\n"
+"\t\tjob_t* job = &batch->jobs[i];\n"
+"\t\tjob->status = N_PROGRAM(job->input, job->input_count, &job->output, &job->output_count);\n"
+"\t}\n"
+"}\n"
+"\n"
+"/* Reads the elements on one line, returning 1 if a line was read, 0 at the end of the file, or -1 if memory could not be allocated. */\n"
+"static int read_line(FILE* file, job_t* job)\n"
+"{\n"
+"\tsize_t capacity = 0;\n"
+"\tuint64_t value = 0;\n"
+"\tint digits = 0, any = 0, c;\n"
+"\tjob->input_count = 0;\n"
+"\tfor (;;)\n"
+"\t{\n"
+"\t\tc = getc(file);\n"
+"\t\tif (c != EOF)\n"
+"\t\t\tany = 1;\n"
+"\t\tif (c >= '0' && c <= '9')\n"
+"\t\t{\n"
+"\t\t\tvalue = value * 10 + (uint64_t)(c - '0');\n"
+"\t\t\tdigits = 1;\n"
+"\t\t\tcontinue;\n"
+"\t\t}\n"
+"\t\tif (digits)\n"
+"\t\t{\n"
+"\t\t\tif (job->input_count == capacity)\n"
+"\t\t\t{\n"
+"\t\t\t\tcapacity = (capacity) ? capacity * 2 : 16;\n"
+"\t\t\t\tuint64_t* input = realloc(job->input, capacity * sizeof(uint64_t));\n"
+"\t\t\t\tif (!input)\n"
+"\t\t\t\t\treturn -1;\n"
+"\t\t\t\tjob->input = input;\n"
+"\t\t\t}\n"
+"\t\t\tjob->input[job->input_count++] = value;\n"
+"\t\t\tvalue = 0;\n"
+"\t\t\tdigits = 0;\n"
+"\t\t}\n"
+"\t\tif (c == '\\n' || c == EOF)\n"
+"\t\t\treturn any;\n"
+"\t}\n"
+"}\n"
+"\n"
+"int main(int argc, char** argv)\n"
+"{\n"
+"\tFILE* input = stdin;\n"
+"\tFILE* output = stdout;\n"
+"\tsize_t thread_count = 1;\n"
+"#ifndef N_NO_THREADS\n"
+"\tlong processor_count = sysconf(_SC_NPROCESSORS_ONLN);\n"
+"\tif (processor_count > 0)\n"
+"\t\tthread_count = (size_t)processor_count;\n"
+"#endif\n"
+"\tint positional = 0;\n"
+"\tfor (int i = 1; i < argc; ++i)\n"
+"\t{\n"
+"\t\tif (!strcmp(argv[i], \"--threads\") && i + 1 < argc)\n"
+"\t\t\tthread_count = strtoull(argv[++i], 0, 10);\n"
+"\t\telse if (positional == 0)\n"
+"\t\t{\n"
+"\t\t\tif (strcmp(argv[i], \"-\") && !(input = fopen(argv[i], \"rb\")))\n"
+"\t\t\t{\n"
+"\t\t\t\tfprintf(stderr, \"Failed to open input file \\\"%s\\\"\\n\", argv[i]);\n"
+"\t\t\t\treturn 1;\n"
+"\t\t\t}\n"
+"\t\t\t++positional;\n"
+"\t\t}\n"
+"\t\telse if (positional == 1)\n"
+"\t\t{\n"
+"\t\t\tif (strcmp(argv[i], \"-\") && !(output = fopen(argv[i], \"wb\")))\n"
+"\t\t\t{\n"
+"\t\t\t\tfprintf(stderr, \"Failed to open output file \\\"%s\\\"\\n\", argv[i]);\n"
+"\t\t\t\treturn 1;\n"
+"\t\t\t}\n"
+"\t\t\t++positional;\n"
+"\t\t}\n"
+"\t\telse\n"
+"\t\t{\n"
+"\t\t\tfprintf(stderr, \"Usage: %s [input file] [output file] [--threads <count>]\\n\", argv[0]);\n"
+"\t\t\treturn 1;\n"
+"\t\t}\n"
+"\t}\n"
+"\tif (!thread_count)\n"
+"\t\tthread_count = 1;\n"
+"\n"
+"\tbatch_t batch;\n"
+"\tbatch.jobs = calloc(BATCH_SIZE, sizeof(job_t));\n"
+"#ifndef N_NO_THREADS\n"
+"\tpthread_t* threads = malloc(thread_count * sizeof(pthread_t));\n"
+"\tif (!threads)\n"
+"\t\tthread_count = 1;\n"
+"\tpthread_mutex_init(&batch.mutex, 0);\n"
+"#endif\n"
+"\tif (!batch.jobs)\n"
+"\t{\n"
+"\t\tfputs(\"Out of memory\\n\", stderr);\n"
+"\t\treturn 1;\n"
+"\t}\n"
+"\n"
+"\tint error = 0;\n"
+"\tsize_t line = 0;\n"
+"\tfor (;;)\n"
+"\t{\n"
+"\t\t/* Read a batch of input sequences */\n"
+"\t\tint status = 0;\n"
+"\t\tbatch.count = 0;\n"
+"\t\twhile (batch.count < BATCH_SIZE && (status = read_line(input, &batch.jobs[batch.count])) > 0)\n"
+"\t\t\t++batch.count;\n"
+"\t\tif (status < 0)\n"
+"\t\t{\n"
+"\t\t\tfputs(\"Out of memory\\n\", stderr);\n"
+"\t\t\terror = 1;\n"
+"\t\t\tbreak;\n"
+"\t\t}\n"
+"\t\tif (!batch.count)\n"
+"\t\t\tbreak;\n"
+"\n"
+"\t\t/* Run the program on the batch in parallel */\n"
+"\t\tbatch.next = 0;\n"
+"#ifndef N_NO_THREADS\n"
+"\t\tsize_t started_count = 0;\n"
+"\t\tfor (size_t i = 1; i < thread_count && i < batch.count; ++i)\n"
+"\t\t\tif (!pthread_create(&threads[started_count], 0, run_batch, &batch))\n"
+"\t\t\t\t++started_count;\n"
+"\t\trun_batch(&batch);\n"
+"\t\tfor (size_t i = 0; i < started_count; ++i)\n"
+"\t\t\tpthread_join(threads[i], 0);\n"
+"#else\n"
+"\t\trun_batch(&batch);\n"
+"#endif\n"
+"\n"
+"\t\t/* Write the output sequences in input order */\n"
+"\t\tfor (size_t i = 0; i < batch.count; ++i, ++line)\n"
+"\t\t{\n"
+"\t\t\tjob_t* job = &batch.jobs[i];\n"
+"\t\t\tif (job->status)\n"
+"\t\t\t{\n"
+"\t\t\t\tfprintf(stderr, \"Out of memory on line %zu\\n\", line + 1);\n"
+"\t\t\t\terror = 1;\n"
+"\t\t\t\tfputc('\\n', output);\n"
+"\t\t\t\tcontinue;\n"
+"\t\t\t}\n"
+"\t\t\tfor (size_t j = 0; j < job->output_count; ++j)\n"
+"\t\t\t\tfprintf(output, (j) ? \" %\" PRIu64 : \"%\" PRIu64, job->output[j]);\n"
+"\t\t\tfputc('\\n', output);\n"
+"\t\t\tfree(job->output);\n"
+"\t\t\tjob->output = 0;\n"
+"\t\t}\n"
+"\t}\n"
+"\n"
+"\tfor (size_t i = 0; i < BATCH_SIZE; ++i)\n"
+"\t\tfree(batch.jobs[i].input);\n"
+"\tfree(batch.jobs);\n"
+"#ifndef N_NO_THREADS\n"
+"\tpthread_mutex_destroy(&batch.mutex);\n"
+"\tfree(threads);\n"
+"#endif\n"
+"\tif (input != stdin)\n"
+"\t\tfclose(input);\n"
+"\tif (ferror(output) || (output != stdout && fclose(output)) || (output == stdout && fflush(stdout)))\n"
+"\t{\n"
+"\t\tfputs(\"Failed to write output\\n\", stderr);\n"
+"\t\terror = 1;\n"
+"\t}\n"
+"\treturn error;\n"
+"}\n";
+
+// Program split across translation units, whose parts take the runtime state from the main function and call their functions in turn.
+const char* split_state = "struct n2c_state{n*e;size_t m,h,c;};\n";
+const char* split_start = "{struct n2c_state q;q.e=e;q.m=m;q.h=h;q.c=c;\n";
+const char* split_call = "{int %s_part_%zu(struct n2c_state*);if(%s_part_%zu(&q))return 1;}\n";
+const char* split_end = "e=q.e;m=q.m;h=q.h;c=q.c;}\n";
+const char* part_function_start = "static int f%zu(struct n2c_state*q){n*e=q->e;size_t m=q->m,h=q->h,c=q->c;\n";
+const char* part_function_end = "\nq->e=e;q->m=m;q->h=h;q->c=c;return 0;}\n";
+
+const char* op_inc = "++e[h];";
+const char* op_dec = "e[h]-=!!e[h];";
+const char* op_car = "e[h]=c;";
+const char* op_set = "e[h]=0x%" PRIX64 "ULL;";
+const char* op_rsh = "R(%" PRIu64 ")";
+const char* op_lsh = "L(%" PRIu64 ")";
+const char* op_rsh_one = "h=(h-1)&m;e[h]=e[(h+c)&m];";
+const char* op_lsh_one = "e[(h+c)&m]=e[h];h=(h+1)&m;";
+const char* op_app = "A(%" PRIu64 ")";
+const char* op_trn = "T(%" PRIu64 ")";
+const char* op_lst = "for(n i=e[h];i;--i){";
 const char* op_lsp = "}";
-const char* op_add = "h->v+=0x%llXULL;";
-const char* op_sub = "h->v=(h->v>0x%llXULL)?h->v-0x%llXULL:0;";
+const char* op_add = "e[h]+=0x%" PRIX64 "ULL;";
+const char* op_sub = "e[h]=(e[h]>0x%" PRIX64 "ULL)?e[h]-0x%" PRIX64 "ULL:0;";
+const char* op_clr = "c=1;";
+const char* op_last = "h=(h+c-1)&m;c=1;";
 
-// Max length opcode: "h->v=(h->v>0xFFFFFFFFFFFFFFFFULL)?h->v-0xFFFFFFFFFFFFFFFFULL:0;"
-const size_t max_opcode_length = 64;
+// Unmatched loops run their remaining operators at most once
+const char* op_lst_unmatched = "if(e[h]){";
+const char* op_lsp_unmatched = "break;}";
 
-int main(int argc, char* argv[])
+/// Size of the blocks in which (N) source is read.
+#define BLOCK_SIZE 65536
+
+/// Maximum number of operators buffered before they are translated, which bounds the size of the loops which can be optimized.
+#define WINDOW_SIZE 65536
+
+/// Number of buffered top-level operators after which they are translated.
+#define SEGMENT_SIZE 4096
+
+/// Number of operators after which a part of a split program starts a new function, at the next top-level loop boundary.
+#define SPLIT_FUNCTION_SIZE 8192
+
+/// Maximum number of instructions in a loop body which is checked for a closed form.
+#define MAX_AFFINE_BODY 256
+
+/// Maximum number of loop iterations evaluated when translating loops whose count is known.
+#define MAX_EVALUATION_STEPS 65536
+
+/// Kinds of instructions of the intermediate representation.
+enum
+{
+	/// Adds `value` to the first element.
+	NODE_ADD,
+	
+	/// Subtracts `value` from the first element, saturating at zero.
+	NODE_SUB,
+	
+	/// Shifts the sequence left by `offset` elements, or right if negative.
+	NODE_SHIFT,
+	
+	/// Appends `value` copies of the first element.
+	NODE_APPEND,
+	
+	/// Truncates `value` elements, leaving at least one.
+	NODE_TRUNCATE,
+	
+	/// Sets the first element to the number of elements.
+	NODE_COUNT,
+	
+	/// Sets the first element to `value`.
+	NODE_SET,
+	
+	/// Loop whose body is the following instructions up to `end`.
+	NODE_LOOP,
+	
+	/// Loop which is not closed within the window, whose body continues in later windows.
+	NODE_OPEN_LOOP,
+	
+	/// Loop which is never closed, so runs the rest of the program at most once.
+	NODE_UNMATCHED_LOOP,
+	
+	/// Loop with a closed form, followed by `offset` cell instructions, then by its body up to `end` for sequences of at most `value` elements, in which the cells are not distinct.
+	NODE_AFFINE,
+	
+	/// Adds `value` times the loop count to the element at `offset`.
+	NODE_CELL_ADD,
+	
+	/// Subtracts `value` times the loop count from the element at `offset`, saturating at zero.
+	NODE_CELL_SUB,
+	
+	/// Sets the element at `offset` to `value`, if the loop count is non-zero.
+	NODE_CELL_SET,
+	
+	/// Clears the sequence to the zero singleton, as `#[|-]`.
+	NODE_CLEAR_SEQUENCE,
+	
+	/// Keeps only the last element, as `#[<|]`.
+	NODE_KEEP_LAST
+};
+
+/// Instruction of the intermediate representation.
+typedef struct node_t
+{
+	/// Kind of instruction.
+	int kind;
+	
+	/// Shift amount, cell offset, or number of cells.
+	int64_t offset;
+	
+	/// Operand of the instruction.
+	bignum_t value;
+	
+	/// Index after the last instruction of a loop body.
+	size_t end;
+	
+} node_t;
+
+/// Translator state, which buffers operators in a window and tracks what is known about the sequence at the current point of the generated C.
+typedef struct translator_t
+{
+	/// Output C source file, which is the current part of a split program.
+	FILE* output;
+	
+	/// Main C source file of a split program, which calls its parts.
+	FILE* main_output;
+	
+	/// Path of the main C source file of a split program, without its extension, from which the paths of its parts are formed.
+	const char* split_base;
+	
+	/// Number of operators after which a split program starts a new part, or zero if the program is not split.
+	size_t split_size;
+	
+	/// Prefix of the names of the parts of a split program.
+	const char* split_prefix;
+	
+	/// Definition of the failure macro of the generated C.
+	const char* failure;
+	
+	/// Number of parts of a split program.
+	size_t part_count;
+	
+	/// Number of functions in the current part.
+	size_t function_count;
+	
+	/// Number of operators translated into the current part.
+	size_t part_length;
+	
+	/// Number of operators translated into the current function.
+	size_t function_length;
+	
+	/// Non-zero if a part could not be written.
+	int split_error;
+	
+	/// Buffered operators.
+	char window[WINDOW_SIZE];
+	
+	/// Number of buffered operators.
+	size_t window_length;
+	
+	/// Number of loops opened in the window which are not yet closed.
+	size_t window_depth;
+	
+	/// Number of loops opened in the generated C which are not yet closed.
+	size_t open_depth;
+	
+	/// Instructions parsed from the window.
+	node_t nodes[WINDOW_SIZE + 1];
+	
+	/// Optimized instructions, which may also hold the closed forms of loops before their bodies.
+	node_t optimized[2 * WINDOW_SIZE + 2];
+	
+	/// Stack of the indices of open loops while parsing.
+	size_t loops[WINDOW_SIZE + 1];
+	
+	/// Cells of a loop which is checked for a closed form.
+	node_t cells[MAX_AFFINE_BODY];
+	
+	/// Non-zero if the value of the first element is known.
+	int head_known;
+	
+	/// Value of the first element, if known.
+	bignum_t head;
+	
+	/// Non-zero if the known value of the first element has not been stored.
+	int head_dirty;
+	
+	/// Non-zero if the number of elements is known.
+	int count_known;
+	
+	/// Number of elements, if known.
+	bignum_t count;
+	
+	/// Number of elements following the first which are known to equal `ahead_value`.
+	bignum_t ahead;
+	
+	/// Value of the elements following the first, if any are known.
+	bignum_t ahead_value;
+	
+} translator_t;
+
+/// Returns `a + b`, saturating at the largest value.
+static bignum_t add_saturated(bignum_t a, bignum_t b)
+{
+	return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
+/// Returns `a - b`, saturating at zero.
+static bignum_t sub_saturated(bignum_t a, bignum_t b)
+{
+	return (a > b) ? a - b : 0;
+}
+
+/// Parses the buffered operators into instructions, merging runs of operators, and returns the number of instructions. Loops which are not closed are open loops, or unmatched loops at the end of the source.
+size_t parse_window(translator_t* translator, int at_end)
 {
-	if (argc != 2 && argc != 3)
+	node_t* nodes = translator->nodes;
+	size_t count = 0;
+	size_t depth = 0;
+	size_t body_start = 0;
+	
+	for (size_t i = 0; i < translator->window_length; ++i)
 	{
-		printf("Usage: n2c <input file> [output file]");
-		return 1;
+		char c = translator->window[i];
+		node_t node = {NODE_ADD, 0, 1, 0};
+		switch (c)
+		{
+			case '+': node.kind = NODE_ADD; break;
+			case '-': node.kind = NODE_SUB; break;
+			case '<': node.kind = NODE_SHIFT; node.offset = 1; break;
+			case '>': node.kind = NODE_SHIFT; node.offset = -1; break;
+			case ':': node.kind = NODE_APPEND; break;
+			case '|': node.kind = NODE_TRUNCATE; break;
+			case '#': node.kind = NODE_COUNT; break;
+			
+			case '[':
+				translator->loops[depth++] = count;
+				nodes[count].kind = NODE_LOOP;
+				nodes[count].offset = 0;
+				nodes[count].value = 0;
+				body_start = ++count;
+				continue;
+			
+			case ']':
+				// Unmatched loop ends have no effect
+				if (depth)
+				{
+					nodes[translator->loops[--depth]].end = count;
+					body_start = count;
+				}
+				continue;
+		}
+		
+		// Merge with the previous instruction of the same kind
+		node_t* previous = (count > body_start) ? &nodes[count - 1] : 0;
+		if (previous && previous->kind == node.kind)
+		{
+			if (node.kind == NODE_SHIFT)
+			{
+				previous->offset += node.offset;
+				if (!previous->offset)
+					--count;
+			}
+			else if (node.kind == NODE_ADD)
+			{
+				++previous->value;
+			}
+			else if (node.kind != NODE_COUNT)
+			{
+				previous->value = add_saturated(previous->value, 1);
+			}
+			continue;
+		}
+		nodes[count++] = node;
 	}
 	
-	// Open (N) source file
-	FILE* n_source_file = fopen(argv[1], "rb");
-	if (!n_source_file)
+	// Loops which are not closed extend to the end of the window
+	while (depth)
 	{
-		printf("Failed to open input file \"%s\"\n", argv[1]);
-		return 1;
+		node_t* loop = &nodes[translator->loops[--depth]];
+		loop->kind = (at_end) ? NODE_UNMATCHED_LOOP : NODE_OPEN_LOOP;
+		loop->end = count;
 	}
 	
-	// Read (N) source into buffer
-	fseek(n_source_file, 0, SEEK_END);
-	size_t n_source_length = ftell(n_source_file);
-	rewind(n_source_file);
-	char* n_source = malloc(n_source_length + 1);
-	n_source[n_source_length] = '\0';
-	if (fread(n_source, 1, n_source_length, n_source_file) != n_source_length)
+	return count;
+}
+
+/// Appends an optimized instruction, merging it with the previous instruction if it is mergeable.
+void push_node(translator_t* translator, size_t* count, size_t* mergeable, node_t node)
+{
+	node_t* optimized = translator->optimized;
+	node_t* previous = (*count && *mergeable == *count - 1) ? &optimized[*count - 1] : 0;
+	if (previous)
 	{
-		printf("Failed to read input file \"%s\"\n", argv[1]);
-		return 1;
+		int merged = 1;
+		if (previous->kind == NODE_SET && node.kind == NODE_ADD)
+			previous->value += node.value;
+		else if (previous->kind == NODE_SET && node.kind == NODE_SUB)
+			previous->value = sub_saturated(previous->value, node.value);
+		else if ((previous->kind == NODE_SET || previous->kind == NODE_ADD || previous->kind == NODE_SUB) && node.kind == NODE_SET)
+			*previous = node;
+		else if (previous->kind == node.kind && node.kind == NODE_ADD)
+			previous->value += node.value;
+		else if (previous->kind == node.kind && (node.kind == NODE_SUB || node.kind == NODE_APPEND || node.kind == NODE_TRUNCATE))
+			previous->value = add_saturated(previous->value, node.value);
+		else if (previous->kind == node.kind && node.kind == NODE_SHIFT)
+			previous->offset += node.offset;
+		else if (previous->kind == node.kind && node.kind == NODE_COUNT)
+			;
+		else
+			merged = 0;
+		
+		if (merged)
+		{
+			if (previous->kind == NODE_SHIFT && !previous->offset)
+			{
+				--*count;
+				*mergeable = SIZE_MAX;
+			}
+			return;
+		}
 	}
-	fclose(n_source_file);
 	
-	// Preprocess (N) source
-	n_preprocess(&n_source);
-	n_source_length = strlen(n_source);
+	optimized[*count] = node;
+	*mergeable = (*count)++;
+}
+
+/// Finds a closed form for a loop body which only adds to, subtracts from and sets elements at fixed offsets, and shifts back to where it started. Returns the number of cells, or zero if there is no closed form.
+size_t find_closed_form(translator_t* translator, size_t first, size_t last, bignum_t* span)
+{
+	const node_t* optimized = translator->optimized;
+	node_t* cells = translator->cells;
+	if (last - first > MAX_AFFINE_BODY)
+		return 0;
 	
-	// Allocate C source buffer
-	size_t bootstrap_length = strlen(bootstrap_header) + strlen(bootstrap_footer);
-	char* c_source = malloc(bootstrap_length + n_source_length * max_opcode_length + 1);
-	*c_source = '\0';
+	size_t cell_count = 0;
+	int64_t offset = 0;
+	int64_t min_offset = 0;
+	int64_t max_offset = 0;
+	for (size_t i = first; i < last; ++i)
+	{
+		const node_t* node = &optimized[i];
+		if (node->kind == NODE_SHIFT)
+		{
+			offset += node->offset;
+			continue;
+		}
+		if (node->kind != NODE_ADD && node->kind != NODE_SUB && node->kind != NODE_SET)
+			return 0;
+		
+		if (offset < min_offset)
+			min_offset = offset;
+		if (offset > max_offset)
+			max_offset = offset;
+		
+		// Find the cell at this offset, or start a new one
+		size_t j = 0;
+		while (j < cell_count && cells[j].offset != offset)
+			++j;
+		if (j == cell_count)
+		{
+			cells[cell_count].kind = (node->kind == NODE_ADD) ? NODE_CELL_ADD : (node->kind == NODE_SUB) ? NODE_CELL_SUB : NODE_CELL_SET;
+			cells[cell_count].offset = offset;
+			cells[cell_count].value = node->value;
+			cells[cell_count++].end = 0;
+			continue;
+		}
+		
+		// Cells which are set take a constant value, while cells which are both added to and subtracted from have no closed form
+		node_t* cell = &cells[j];
+		if (node->kind == NODE_SET)
+		{
+			cell->kind = NODE_CELL_SET;
+			cell->value = node->value;
+		}
+		else if (cell->kind == NODE_CELL_SET)
+			cell->value = (node->kind == NODE_ADD) ? cell->value + node->value : sub_saturated(cell->value, node->value);
+		else if (cell->kind == NODE_CELL_ADD && node->kind == NODE_ADD)
+			cell->value += node->value;
+		else if (cell->kind == NODE_CELL_SUB && node->kind == NODE_SUB)
+			cell->value = add_saturated(cell->value, node->value);
+		else
+			return 0;
+	}
+	if (offset)
+		return 0;
 	
-	// Copy bootstrap header into C source buffer
-	strcat(c_source, bootstrap_header);
+	*span = (bignum_t)(max_offset - min_offset);
+	return cell_count;
+}
+
+/// Optimizes the parsed instructions in a range, appending them to the optimized instructions. Runs are merged, loops with closed forms are replaced by them, and idioms on the whole sequence are recognized.
+void optimize_range(translator_t* translator, size_t first, size_t last, size_t* count)
+{
+	const node_t* nodes = translator->nodes;
+	node_t* optimized = translator->optimized;
+	size_t mergeable = SIZE_MAX;
 	
-	// Translate opcodes from (N) to C
-	bignum_t consecutive_incs = 0;
-	bignum_t consecutive_decs = 0;
-	for (char* c = n_source; *c; ++c)
+	for (size_t i = first; i < last; ++i)
 	{
-		switch (*c)
+		const node_t* node = &nodes[i];
+		if (node->kind != NODE_LOOP && node->kind != NODE_OPEN_LOOP && node->kind != NODE_UNMATCHED_LOOP)
+		{
+			push_node(translator, count, &mergeable, *node);
+			continue;
+		}
+		
+		// Optimize the loop body first
+		size_t loop = (*count)++;
+		optimize_range(translator, i + 1, node->end, count);
+		size_t body = loop + 1;
+		size_t body_length = *count - body;
+		optimized[loop] = *node;
+		optimized[loop].end = *count;
+		i = node->end - 1;
+		
+		if (node->kind != NODE_LOOP)
+		{
+			mergeable = SIZE_MAX;
+			continue;
+		}
+		
+		// Empty loops have no effect
+		if (!body_length)
+		{
+			*count = loop;
+			continue;
+		}
+		
+		// Clear the sequence with `#[|-]` or `#[-|]`, or keep its last element with `#[<|]`
+		if (body_length == 2 && mergeable == loop - 1 && optimized[loop - 1].kind == NODE_COUNT)
+		{
+			const node_t* a = &optimized[body];
+			const node_t* b = &optimized[body + 1];
+			int truncate_a = (a->kind == NODE_TRUNCATE && a->value == 1);
+			int truncate_b = (b->kind == NODE_TRUNCATE && b->value == 1);
+			int kind = -1;
+			if ((truncate_a && b->kind == NODE_SUB && b->value == 1) || (truncate_b && a->kind == NODE_SUB && a->value == 1))
+				kind = NODE_CLEAR_SEQUENCE;
+			else if (a->kind == NODE_SHIFT && a->offset == 1 && truncate_b)
+				kind = NODE_KEEP_LAST;
+			if (kind >= 0)
+			{
+				// The count only determines the result of keeping the last element of a singleton
+				*count = (kind == NODE_CLEAR_SEQUENCE) ? loop - 1 : loop;
+				mergeable = SIZE_MAX;
+				node_t idiom = {kind, 0, 0, 0};
+				push_node(translator, count, &mergeable, idiom);
+				mergeable = SIZE_MAX;
+				continue;
+			}
+		}
+		
+		// Replace loops which only add, subtract and set at fixed offsets with a closed form, keeping the body for short sequences
+		bignum_t span;
+		size_t cell_count = find_closed_form(translator, body, *count, &span);
+		if (cell_count == 1 && !span && translator->cells[0].kind != NODE_CELL_ADD && !(translator->cells[0].kind == NODE_CELL_SET && translator->cells[0].value))
+		{
+			// Loops which clear the first element, as `[-]`, set it to zero
+			*count = loop;
+			node_t set = {NODE_SET, 0, 0, 0};
+			push_node(translator, count, &mergeable, set);
+			continue;
+		}
+		if (cell_count)
 		{
-			case '+':
-				++consecutive_incs;
+			memmove(&optimized[body + cell_count], &optimized[body], body_length * sizeof(node_t));
+			memcpy(&optimized[body], translator->cells, cell_count * sizeof(node_t));
+			optimized[loop].kind = NODE_AFFINE;
+			optimized[loop].offset = (int64_t)cell_count;
+			optimized[loop].value = span;
+			*count = body + cell_count + ((span) ? body_length : 0);
+			optimized[loop].end = *count;
+		}
+		mergeable = SIZE_MAX;
+	}
+}
+
+/// Returns whether the instructions in a range only change the first element.
+int head_only(const node_t* nodes, size_t first, size_t last)
+{
+	for (size_t i = first; i < last; ++i)
+	{
+		int kind = nodes[i].kind;
+		if (kind == NODE_AFFINE && nodes[i].value == 0)
+			i = nodes[i].end - 1;
+		else if (kind == NODE_LOOP)
+			continue;
+		else if (kind != NODE_ADD && kind != NODE_SUB && kind != NODE_SET)
+			return 0;
+	}
+	
+	return 1;
+}
+
+/// Returns whether the instructions in a range keep every element but the last `depth` ones, which they do if they only shift right of the first element and back, change elements while shifted right, and append elements. Finds the depth and the number of elements appended, which is only exact if it does not saturate.
+int tail_only(const node_t* nodes, size_t first, size_t last, bignum_t* depth, bignum_t* appended)
+{
+	int64_t offset = 0;
+	*depth = 0;
+	*appended = 0;
+	for (size_t i = first; i < last; ++i)
+	{
+		const node_t* node = &nodes[i];
+		int kind = node->kind;
+		if (kind == NODE_SHIFT)
+		{
+			offset += node->offset;
+			if (offset > 0)
+				return 0;
+			if ((bignum_t)-offset > *depth)
+				*depth = (bignum_t)-offset;
+		}
+		else if (kind == NODE_APPEND)
+		{
+			*appended = add_saturated(*appended, node->value);
+		}
+		else if (!offset)
+		{
+			// The first element holds the loop count
+			return 0;
+		}
+		else if ((kind == NODE_AFFINE && node->value == 0) || (kind == NODE_LOOP && head_only(nodes, i + 1, node->end)))
+		{
+			// Loops which only change the first element change the element shifted into its place
+			i = node->end - 1;
+		}
+		else if (kind != NODE_ADD && kind != NODE_SUB && kind != NODE_SET && kind != NODE_COUNT)
+		{
+			return 0;
+		}
+	}
+	
+	return !offset;
+}
+
+/// Applies the cells of a closed form at offset zero to a value, given the loop count.
+bignum_t apply_cells(const node_t* nodes, size_t loop, bignum_t value, bignum_t count)
+{
+	for (size_t i = loop + 1; i < loop + 1 + (size_t)nodes[loop].offset; ++i)
+	{
+		const node_t* cell = &nodes[i];
+		if (cell->offset)
+			continue;
+		if (cell->kind == NODE_CELL_ADD)
+			value += count * cell->value;
+		else if (cell->kind == NODE_CELL_SUB)
+			value = (value / cell->value < count) ? 0 : value - count * cell->value;
+		else if (count)
+			value = cell->value;
+	}
+	
+	return value;
+}
+
+/// Evaluates instructions which only change the first element on a known value, within a budget of loop iterations. Returns zero if the instructions change other elements or the budget is exceeded.
+int evaluate(const node_t* nodes, size_t first, size_t last, bignum_t* value, bignum_t* budget)
+{
+	for (size_t i = first; i < last; ++i)
+	{
+		const node_t* node = &nodes[i];
+		switch (node->kind)
+		{
+			case NODE_ADD: *value += node->value; break;
+			case NODE_SUB: *value = sub_saturated(*value, node->value); break;
+			case NODE_SET: *value = node->value; break;
+			
+			case NODE_AFFINE:
+				if (node->value)
+					return 0;
+				*value = apply_cells(nodes, i, *value, *value);
+				i = node->end - 1;
 				break;
 			
-			case '-':
-				++consecutive_decs;
+			case NODE_LOOP:
+			{
+				bignum_t count = *value;
+				if (count > *budget)
+					return 0;
+				*budget -= count;
+				for (bignum_t j = 0; j < count; ++j)
+					if (!evaluate(nodes, i + 1, node->end, value, budget))
+						return 0;
+				i = node->end - 1;
 				break;
+			}
 			
-			case '#':
-				strcat(c_source, op_car);
+			default:
+				return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/// Stores the known value of the first element, if it has not been stored.
+void store_head(translator_t* translator)
+{
+	if (translator->head_dirty)
+	{
+		fprintf(translator->output, op_set, translator->head);
+		translator->head_dirty = 0;
+	}
+}
+
+/// Forgets everything known about the sequence, after storing the known value of the first element.
+void forget(translator_t* translator)
+{
+	store_head(translator);
+	translator->head_known = 0;
+	translator->count_known = 0;
+	translator->ahead = 0;
+}
+
+/// Writes the index expression of the element at an offset from the first element.
+void write_cell_index(FILE* output, int64_t offset)
+{
+	if (offset > 0)
+		fprintf(output, "(h+%" PRId64 ")&m", offset);
+	else if (offset < 0)
+		fprintf(output, "(h+c-%" PRId64 ")&m", -offset);
+	else
+		fputs("h", output);
+}
+
+void emit_range(translator_t* translator, size_t first, size_t last);
+
+/// Writes a loop with a closed form.
+void emit_affine(translator_t* translator, size_t index)
+{
+	FILE* output = translator->output;
+	const node_t* node = &translator->optimized[index];
+	size_t cells = index + 1;
+	size_t body = cells + (size_t)node->offset;
+	bignum_t span = node->value;
+	
+	// Loops which only change the first element are evaluated if its value is known
+	if (translator->head_known && !span)
+	{
+		translator->head = apply_cells(translator->optimized, index, translator->head, translator->head);
+		translator->head_dirty = 1;
+		return;
+	}
+	
+	store_head(translator);
+	if (translator->head_known)
+		fprintf(output, "{n t=0x%" PRIX64 "ULL;", translator->head);
+	else
+		fputs("{n t=e[h];", output);
+	
+	// The cells are only distinct in sequences longer than the span of their offsets
+	int guarded = span && !(translator->count_known && translator->count > span);
+	if (guarded)
+		fprintf(output, "if(c>%" PRIu64 "){", span);
+	for (size_t i = cells; i < body; ++i)
+	{
+		const node_t* cell = &translator->optimized[i];
+		fputs("e[", output);
+		write_cell_index(output, cell->offset);
+		if (cell->kind == NODE_CELL_ADD)
+		{
+			fprintf(output, "]+=t*0x%" PRIX64 "ULL;", cell->value);
+		}
+		else if (cell->kind == NODE_CELL_SUB)
+		{
+			fputs("]=(e[", output);
+			write_cell_index(output, cell->offset);
+			fprintf(output, "]/0x%" PRIX64 "ULL<t)?0:e[", cell->value);
+			write_cell_index(output, cell->offset);
+			fprintf(output, "]-t*0x%" PRIX64 "ULL;", cell->value);
+		}
+		else
+		{
+			fprintf(output, "]=t?0x%" PRIX64 "ULL:e[", cell->value);
+			write_cell_index(output, cell->offset);
+			fputs("];", output);
+		}
+	}
+	
+	int count_known = translator->count_known;
+	bignum_t count = translator->count;
+	if (guarded)
+	{
+		// Run the loop itself on shorter sequences, about which nothing is known
+		fputs("}else for(n i=t;i;--i){", output);
+		forget(translator);
+		emit_range(translator, body, node->end);
+		store_head(translator);
+		fputs("}}", output);
+		translator->head_known = 0;
+		translator->ahead = 0;
+		translator->count_known = count_known;
+		translator->count = count;
+		return;
+	}
+	fputs("}", output);
+	
+	// Update the known first element, and forget known elements which follow it from the first changed one
+	if (translator->head_known)
+		translator->head = apply_cells(translator->optimized, index, translator->head, translator->head);
+	for (size_t i = cells; i < body; ++i)
+	{
+		int64_t offset = translator->optimized[i].offset;
+		if (offset < 0 && !count_known)
+			translator->ahead = 0;
+		else if (offset)
+		{
+			bignum_t position = (offset > 0) ? (bignum_t)offset : count - (bignum_t)-offset;
+			if (position <= translator->ahead)
+				translator->ahead = position - 1;
+		}
+	}
+}
+
+/// Writes the C translation of the optimized instructions in a range, tracking what is known about the sequence.
+void emit_range(translator_t* translator, size_t first, size_t last)
+{
+	FILE* output = translator->output;
+	const node_t* nodes = translator->optimized;
+	
+	for (size_t i = first; i < last; ++i)
+	{
+		const node_t* node = &nodes[i];
+		switch (node->kind)
+		{
+			case NODE_ADD:
+				if (translator->head_known)
+				{
+					translator->head += node->value;
+					translator->head_dirty = 1;
+				}
+				else if (node->value == 1)
+					fputs(op_inc, output);
+				else
+					fprintf(output, op_add, node->value);
+				break;
+			
+			case NODE_SUB:
+				if (translator->head_known)
+				{
+					translator->head = sub_saturated(translator->head, node->value);
+					translator->head_dirty = 1;
+				}
+				else if (node->value == 1)
+					fputs(op_dec, output);
+				else
+					fprintf(output, op_sub, node->value, node->value);
+				break;
+			
+			case NODE_SET:
+				translator->head_known = 1;
+				translator->head = node->value;
+				translator->head_dirty = 1;
+				break;
+			
+			case NODE_COUNT:
+				translator->head_dirty = 0;
+				if (translator->count_known)
+				{
+					translator->head_known = 1;
+					translator->head = translator->count;
+					translator->head_dirty = 1;
+				}
+				else
+				{
+					fputs(op_car, output);
+					translator->head_known = 0;
+				}
+				break;
+			
+			case NODE_SHIFT:
+			{
+				// Shifts by a multiple of a known number of elements have no effect
+				bignum_t amount = (node->offset > 0) ? (bignum_t)node->offset : (bignum_t)-node->offset;
+				if (translator->count_known && !(amount % translator->count))
+					break;
+				store_head(translator);
+				if (translator->count_known)
+					amount %= translator->count;
+				
+				// Shifts by one element of a sequence which is known to have more are written without loops, since copying the first element to the end of a full ring buffer copies it onto itself
+				if (translator->count_known && amount == 1)
+					fputs((node->offset > 0) ? op_lsh_one : op_rsh_one, output);
+				else
+					fprintf(output, (node->offset > 0) ? op_lsh : op_rsh, amount);
+				
+				// Shifting left moves a known element following the first into its place
+				if (node->offset > 0 && translator->ahead >= amount)
+				{
+					translator->head_known = 1;
+					translator->head = translator->ahead_value;
+					translator->ahead -= amount;
+				}
+				else
+				{
+					translator->head_known = 0;
+					translator->ahead = 0;
+				}
 				break;
+			}
 			
-			case '>':
-				strcat(c_source, op_rsh);
+			case NODE_APPEND:
+				store_head(translator);
+				fprintf(output, op_app, node->value);
+				if (translator->count_known)
+				{
+					// Appended copies of a known first element extend the known elements which follow it, if they reach the end
+					if (translator->head_known && translator->ahead == translator->count - 1 && (!translator->ahead || translator->ahead_value == translator->head))
+					{
+						translator->ahead_value = translator->head;
+						translator->ahead = add_saturated(translator->ahead, node->value);
+					}
+					translator->count_known = (translator->count <= UINT64_MAX - node->value);
+					translator->count += node->value;
+				}
 				break;
 			
-			case '<':
-				strcat(c_source, op_lsh);
+			case NODE_TRUNCATE:
+				store_head(translator);
+				fprintf(output, op_trn, node->value);
+				if (translator->count_known)
+				{
+					translator->count -= (node->value < translator->count) ? node->value : translator->count - 1;
+					if (translator->ahead > translator->count - 1)
+						translator->ahead = translator->count - 1;
+				}
+				else
+				{
+					translator->ahead = 0;
+				}
 				break;
 			
-			case ':':
-				strcat(c_source, op_app);
+			case NODE_CLEAR_SEQUENCE:
+				fputs(op_clr, output);
+				translator->head_known = 1;
+				translator->head = 0;
+				translator->head_dirty = 1;
+				translator->count_known = 1;
+				translator->count = 1;
+				translator->ahead = 0;
 				break;
 			
-			case '|':
-				strcat(c_source, op_trn);
+			case NODE_KEEP_LAST:
+				store_head(translator);
+				fputs(op_last, output);
+				if (translator->count_known && translator->count > 1 && translator->ahead == translator->count - 1)
+				{
+					translator->head_known = 1;
+					translator->head = translator->ahead_value;
+				}
+				else if (!translator->count_known || translator->count != 1)
+					translator->head_known = 0;
+				translator->count_known = 1;
+				translator->count = 1;
+				translator->ahead = 0;
 				break;
+			
+			case NODE_AFFINE:
+				if (!(translator->head_known && translator->head == 0))
+					emit_affine(translator, i);
+				i = node->end - 1;
+				break;
+			
+			case NODE_LOOP:
+			{
+				size_t loop = i;
+				i = node->end - 1;
 				
-			case '[':
-				strcat(c_source, op_lst);
+				// Loops whose count is known to be zero are skipped, and loops which only change a known first element are evaluated
+				if (translator->head_known)
+				{
+					bignum_t value = translator->head;
+					bignum_t budget = MAX_EVALUATION_STEPS;
+					if (!value)
+						break;
+					if (evaluate(nodes, loop, loop + 1, &value, &budget))
+					{
+						translator->head = value;
+						translator->head_dirty = 1;
+						break;
+					}
+				}
+				
+				int head_known = translator->head_known;
+				bignum_t head = translator->head;
+				int count_known = translator->count_known;
+				bignum_t count = translator->count;
+				bignum_t ahead = translator->ahead;
+				int body_head_only = head_only(nodes, loop + 1, node->end);
+				bignum_t depth, appended;
+				int body_tail_only = !body_head_only && count_known && tail_only(nodes, loop + 1, node->end, &depth, &appended) && depth < count;
+				forget(translator);
+				fputs(op_lst, output);
+				emit_range(translator, loop + 1, node->end);
+				store_head(translator);
+				fputs(op_lsp, output);
+				
+				if (body_tail_only)
+				{
+					// Loops which only change and append elements at the end of the sequence, such as the runs and repeated blocks of bin2n, keep the elements before them, and append a known number of elements if the loop count is known
+					translator->head_known = head_known;
+					translator->head = head;
+					translator->count_known = !appended || (head_known && appended < UINT64_MAX && head <= (UINT64_MAX - count) / appended);
+					translator->count = count + ((translator->count_known) ? head * appended : 0);
+					translator->ahead = (ahead < count - 1 - depth) ? ahead : count - 1 - depth;
+					break;
+				}
+				
+				// Loops which only change the first element keep what is known about the rest of the sequence
+				translator->head_known = 0;
+				translator->count_known = body_head_only && count_known;
+				translator->count = count;
+				translator->ahead = (body_head_only) ? ahead : 0;
 				break;
+			}
 			
-			case ']':
-				strcat(c_source, op_lsp);
+			case NODE_OPEN_LOOP:
+				forget(translator);
+				fputs(op_lst, output);
+				emit_range(translator, i + 1, node->end);
+				i = node->end - 1;
+				break;
+			
+			case NODE_UNMATCHED_LOOP:
+				// The rest of the program is skipped if the first element is zero, and otherwise runs once
+				if (translator->head_known)
+				{
+					if (translator->head)
+						emit_range(translator, i + 1, node->end);
+				}
+				else
+				{
+					fputs(op_lst_unmatched, output);
+					emit_range(translator, i + 1, node->end);
+					store_head(translator);
+					fputs(op_lsp, output);
+					forget(translator);
+				}
+				i = node->end - 1;
 				break;
 		}
-		
-		if (consecutive_incs && *(c + 1) != '+')
+	}
+}
+
+/// Opens the next part of a split program, or returns `0` if it could not be opened.
+FILE* open_part(const translator_t* translator)
+{
+	char* path = malloc(strlen(translator->split_base) + 32);
+	if (!path)
+		return 0;
+	sprintf(path, "%s-%zu.c", translator->split_base, translator->part_count + 1);
+	FILE* output = fopen(path, "wb");
+	if (!output)
+		printf("Failed to open output file \"%s\"\n", path);
+	free(path);
+	
+	return output;
+}
+
+/// Starts the next part of a split program, with its first function, and calls it from the main function.
+void begin_part(translator_t* translator, FILE* output)
+{
+	translator->output = output;
+	translator->function_count = 1;
+	translator->part_length = 0;
+	translator->function_length = 0;
+	++translator->part_count;
+	
+	fputs(runtime_header, output);
+	fputs(translator->failure, output);
+	fputs(split_state, output);
+	fprintf(output, part_function_start, translator->function_count);
+	fprintf(translator->main_output, split_call, translator->split_prefix, translator->part_count, translator->split_prefix, translator->part_count);
+}
+
+/// Ends the current part of a split program, with the entry point which calls its functions in turn.
+void end_part(translator_t* translator)
+{
+	FILE* output = translator->output;
+	fputs(part_function_end, output);
+	fprintf(output, "int %s_part_%zu(struct n2c_state*q){return ", translator->split_prefix, translator->part_count);
+	for (size_t i = 1; i <= translator->function_count; ++i)
+		fprintf(output, (i > 1) ? "||f%zu(q)" : "f%zu(q)", i);
+	fputs(";}\n", output);
+	
+	int error = ferror(output);
+	if (fclose(output) || error)
+		translator->split_error = 1;
+	translator->output = 0;
+}
+
+/// Starts a new function of a split program once the current one is large enough, and a new part once the current part is.
+void split_output(translator_t* translator)
+{
+	if (translator->function_length < SPLIT_FUNCTION_SIZE)
+		return;
+	
+	if (translator->part_length < translator->split_size)
+	{
+		fputs(part_function_end, translator->output);
+		fprintf(translator->output, part_function_start, ++translator->function_count);
+		translator->function_length = 0;
+		return;
+	}
+	
+	// Keep writing to the current part if the next part cannot be opened
+	FILE* output = open_part(translator);
+	if (!output)
+	{
+		translator->split_error = 1;
+		translator->split_size = 0;
+		return;
+	}
+	end_part(translator);
+	begin_part(translator, output);
+}
+
+/// Parses, optimizes and translates the buffered operators.
+void flush_window(translator_t* translator, int at_end)
+{
+	// Split the program at top-level boundaries
+	if (translator->split_size && !translator->open_depth && translator->window_length)
+		split_output(translator);
+	translator->part_length += translator->window_length;
+	translator->function_length += translator->window_length;
+	
+	size_t node_count = parse_window(translator, at_end);
+	size_t count = 0;
+	optimize_range(translator, 0, node_count, &count);
+	emit_range(translator, 0, count);
+	store_head(translator);
+	
+	translator->open_depth += (at_end) ? 0 : translator->window_depth;
+	translator->window_length = 0;
+	translator->window_depth = 0;
+}
+
+/// Buffers an operator, translating the buffered operators at top-level boundaries or when the window is full.
+void translate_operator(translator_t* translator, char c)
+{
+	// Translate at top level between runs, or when the window is full
+	size_t length = translator->window_length;
+	if ((!translator->window_depth && length >= SEGMENT_SIZE && translator->window[length - 1] != c) || length == WINDOW_SIZE)
+		flush_window(translator, 0);
+	
+	if (c == ']' && !translator->window_depth)
+	{
+		// Close a loop which was opened by an earlier window, or ignore an unmatched loop end
+		if (translator->open_depth)
+		{
+			flush_window(translator, 0);
+			fputs(op_lsp, translator->output);
+			--translator->open_depth;
+			forget(translator);
+		}
+		return;
+	}
+	
+	translator->window[translator->window_length++] = c;
+	if (c == '[')
+		++translator->window_depth;
+	else if (c == ']')
+		--translator->window_depth;
+}
+
+/// Writes the header which declares a library function.
+int write_declaration(const char* path, const char* name)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return 1;
+	
+	// Name the include guard after the function
+	size_t length = strlen(name);
+	char* guard = malloc(length + 1);
+	if (!guard)
+	{
+		fclose(file);
+		return 1;
+	}
+	for (size_t i = 0; i <= length; ++i)
+		guard[i] = (char)toupper((unsigned char)name[i]);
+	
+	fprintf(file, function_declaration, guard, guard, name, name);
+	free(guard);
+	
+	int error = ferror(file);
+	return (fclose(file) || error);
+}
+
+/// Writes the batch driver of a library function.
+int write_driver(const char* path, const char* name)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return 1;
+	
+	fprintf(file, "#define N_PROGRAM %s\n", name);
+	fputs(driver_source, file);
+	
+	int error = ferror(file);
+	return (fclose(file) || error);
+}
+
+/// Returns the file name of a path.
+const char* file_name(const char* path)
+{
+	const char* name = path;
+	for (; *path; ++path)
+		if (*path == '/' || *path == '\\')
+			name = path + 1;
+	
+	return name;
+}
+
+/// Writes the CMake fragment which lists the C source files of a split program, as the variable `N2C_<NAME>_SOURCES`.
+int write_fragment(const char* base, const char* main_path, size_t part_count)
+{
+	char* path = malloc(strlen(base) + 7);
+	if (!path)
+		return 1;
+	sprintf(path, "%s.cmake", base);
+	FILE* file = fopen(path, "wb");
+	free(path);
+	if (!file)
+		return 1;
+	
+	const char* name = file_name(base);
+	fprintf(file, "# C source files of %s, translated by n2c in %zu part%s\nset(N2C_", name, part_count, (part_count == 1) ? "" : "s");
+	for (const char* c = name; *c; ++c)
+		fputc((isalnum((unsigned char)*c)) ? toupper((unsigned char)*c) : '_', file);
+	fprintf(file, "_SOURCES\n\t${CMAKE_CURRENT_LIST_DIR}/%s", file_name(main_path));
+	for (size_t i = 1; i <= part_count; ++i)
+		fprintf(file, "\n\t${CMAKE_CURRENT_LIST_DIR}/%s-%zu.c", name, i);
+	fputs(")\n", file);
+	
+	int error = ferror(file);
+	return (fclose(file) || error);
+}
+
+/// Specializes the operators of an (N) program against the known elements of its input, and returns the operators of the residual program, which must be freed with `free()`, or `0` if memory could not be allocated.
+char* specialize_operators(const char* operators, size_t length, const n_known_input_t* known, size_t* residual_length)
+{
+	n_program_t* program = n_program_compile(operators, length);
+	n_constant_table_t* table = n_constant_table_create();
+	n_limits_t limits = {0, 0, 0.0};
+	char* residual = (program && table) ? n_program_specialize(program, known, table, limits, residual_length) : 0;
+	n_constant_table_free(table);
+	n_program_free(program);
+	
+	return residual;
+}
+
+/// Returns whether a string is a valid C identifier.
+int is_identifier(const char* name)
+{
+	if (!isalpha((unsigned char)*name) && *name != '_')
+		return 0;
+	while (*(++name))
+		if (!isalnum((unsigned char)*name) && *name != '_')
+			return 0;
+	
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	// Parse command line arguments
+	const char* input_path = 0;
+	const char* output_path = 0;
+	const char* function_name = 0;
+	const char* header_path = 0;
+	const char* driver_path = 0;
+	size_t split_size = 0;
+	int usage_error = 0;
+	n_known_input_t known = {N_UNKNOWN_COUNT, 0, 0, 0};
+	int specialize = 0;
+	
+	// Known elements of the input, whose positions and values share one allocation
+	size_t* known_positions = malloc(argc * (sizeof(size_t) + sizeof(bignum_t)));
+	bignum_t* known_values = (bignum_t*)(known_positions + argc);
+	if (!known_positions)
+	{
+		printf("Failed to allocate memory\n");
+		return 1;
+	}
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--function") && i + 1 < argc)
+			function_name = argv[++i];
+		else if (!strcmp(argv[i], "--header") && i + 1 < argc)
+			header_path = argv[++i];
+		else if (!strcmp(argv[i], "--driver") && i + 1 < argc)
+			driver_path = argv[++i];
+		else if (!strcmp(argv[i], "--split") && i + 1 < argc)
+			usage_error |= !(split_size = strtoull(argv[++i], 0, 10));
+		else if (!strcmp(argv[i], "--known") && i + 1 < argc)
 		{
-			if (consecutive_incs == 1)
-				strcat(c_source, op_inc);
-			else
-				sprintf(c_source + strlen(c_source), op_add, consecutive_incs);
-			consecutive_incs = 0;
+			// Known elements are given as <position>=<value>
+			size_t k = known.known_count;
+			usage_error |= (sscanf(argv[++i], "%zu=%" SCNu64, &known_positions[k], &known_values[k]) != 2);
+			known.known_count += !usage_error;
+			specialize = 1;
 		}
-		else if (consecutive_decs && *(c + 1) != '-')
+		else if (!strcmp(argv[i], "--known-count") && i + 1 < argc)
 		{
-			if (consecutive_decs == 1)
-				strcat(c_source, op_dec);
-			else
-				sprintf(c_source + strlen(c_source), op_sub, consecutive_decs, consecutive_decs);
-			consecutive_decs = 0;
+			known.count = strtoull(argv[++i], 0, 10);
+			specialize = 1;
 		}
+		else if (!input_path)
+			input_path = argv[i];
+		else if (!output_path)
+			output_path = argv[i];
+		else
+			usage_error = 1;
+	}
+	known.known_count = n_known_input_sort(known_positions, known_values, known.known_count);
+	known.positions = known_positions;
+	known.values = known_values;
+	if (!input_path || usage_error || ((header_path || driver_path) && !function_name) || (split_size && !output_path))
+	{
+		printf("Usage: n2c <input file> [output file] [--function <name> [--header <file>] [--driver <file>]] [--split <operators>] [--known <position>=<value>] ... [--known-count <count>]");
+		free(known_positions);
+		return 1;
+	}
+	if (function_name && !is_identifier(function_name))
+	{
+		printf("Invalid function name \"%s\"\n", function_name);
+		free(known_positions);
+		return 1;
 	}
 	
-	// Copy bootstrap footer into C source buffer
-	strcat(c_source, bootstrap_footer);
+	// Write the declaration and batch driver of the library function, if any
+	if (header_path && write_declaration(header_path, function_name))
+	{
+		printf("Failed to write header file \"%s\"\n", header_path);
+		free(known_positions);
+		return 1;
+	}
+	if (driver_path && write_driver(driver_path, function_name))
+	{
+		printf("Failed to write driver file \"%s\"\n", driver_path);
+		free(known_positions);
+		return 1;
+	}
+	
+	// Open (N) source file
+	FILE* n_source_file = fopen(input_path, "rb");
+	if (!n_source_file)
+	{
+		printf("Failed to open input file \"%s\"\n", input_path);
+		free(known_positions);
+		return 1;
+	}
 	
 	// Open output file, if any
 	FILE* c_source_file = stdout;
-	if (argc == 3)
-		c_source_file = fopen(argv[2], "wb");
+	if (output_path)
+	{
+		c_source_file = fopen(output_path, "wb");
+		if (!c_source_file)
+		{
+			printf("Failed to open output file \"%s\"\n", output_path);
+			fclose(n_source_file);
+			free(known_positions);
+			return 1;
+		}
+	}
 	
-	// Print C source to output file
-	if (c_source_file)
-		if (fputs(c_source, c_source_file) < 0)
-			if (argc == 3)
-				printf("Failed to write to output file \"%s\"\n", argv[2]);
+	translator_t* translator = calloc(1, sizeof(translator_t));
+	if (!translator)
+	{
+		printf("Failed to allocate memory\n");
+		fclose(n_source_file);
+		if (c_source_file != stdout)
+			fclose(c_source_file);
+		free(known_positions);
+		return 1;
+	}
+	translator->output = c_source_file;
+	translator->failure = (function_name) ? function_failure : program_failure;
 	
-	// Close output file, if any
-	if (c_source_file != stdout)
-		fclose(c_source_file);
+	// Write runtime and the start of the program or library function
+	fputs(runtime_header, c_source_file);
+	fputs(translator->failure, c_source_file);
+	if (function_name)
+		fprintf(c_source_file, function_header, function_name);
+	else
+		fputs(program_header, c_source_file);
 	
-	// Deallocate buffers
-	free(n_source);
-	free(c_source);
+	// Split the program into parts named after the output file, without its extension, which the main function calls in turn
+	char* split_base = 0;
+	if (split_size)
+	{
+		size_t length = strlen(output_path);
+		split_base = malloc(length + 1);
+		if (split_base)
+		{
+			memcpy(split_base, output_path, length + 1);
+			if (length > 2 && !strcmp(split_base + length - 2, ".c"))
+				split_base[length - 2] = '\0';
+		}
+		
+		translator->main_output = c_source_file;
+		translator->split_base = split_base;
+		translator->split_size = split_size;
+		translator->split_prefix = (function_name) ? function_name : "n2c";
+		FILE* part = (split_base) ? open_part(translator) : 0;
+		if (!part)
+		{
+			free(split_base);
+			free(translator);
+			fclose(n_source_file);
+			fclose(c_source_file);
+			free(known_positions);
+			return 1;
+		}
+		fputs(split_state, c_source_file);
+		fputs(split_start, c_source_file);
+		begin_part(translator, part);
+	}
+	
+	// Read, preprocess and translate (N) source one block at a time, or collect its operators to specialize the whole program first
+	static char block[BLOCK_SIZE];
+	n_preprocessor_t preprocessor = {0};
+	size_t block_size;
+	char* operators = 0;
+	size_t operator_count = 0;
+	int error = 0;
+	while ((block_size = fread(block, 1, BLOCK_SIZE, n_source_file)) > 0)
+	{
+		size_t length = n_preprocess_block(&preprocessor, block, block_size, block);
+		if (!specialize)
+		{
+			for (size_t i = 0; i < length; ++i)
+				translate_operator(translator, block[i]);
+		}
+		else if (!error)
+		{
+			char* grown = realloc(operators, operator_count + length + 1);
+			error = !grown;
+			if (grown)
+			{
+				operators = grown;
+				memcpy(operators + operator_count, block, length);
+				operator_count += length;
+			}
+		}
+	}
+	
+	// Translate the residual program, which evaluates only what depends on the unknown elements of the input
+	if (specialize)
+	{
+		size_t residual_length = 0;
+		char* residual = (!error) ? specialize_operators((operators) ? operators : "", operator_count, &known, &residual_length) : 0;
+		error = !residual;
+		for (size_t i = 0; i < residual_length; ++i)
+			translate_operator(translator, residual[i]);
+		free(residual);
+		free(operators);
+		if (error)
+			printf("Failed to allocate memory\n");
+	}
+	free(known_positions);
+	flush_window(translator, 1);
+	for (; translator->open_depth; --translator->open_depth)
+		fputs(op_lsp_unmatched, translator->output);
+	
+	// End the last part of a split program, and list the C source files of its parts
+	if (split_base)
+	{
+		end_part(translator);
+		fputs(split_end, c_source_file);
+		if (write_fragment(split_base, output_path, translator->part_count))
+		{
+			printf("Failed to write CMake fragment \"%s.cmake\"\n", split_base);
+			error = 1;
+		}
+		else if (translator->split_error)
+		{
+			printf("Failed to write to split output files \"%s-*.c\"\n", split_base);
+			error = 1;
+		}
+		free(split_base);
+	}
+	free(translator);
+	
+	// Write the end of the program or library function
+	fputs((function_name) ? function_footer : program_footer, c_source_file);
+	
+	if (ferror(n_source_file))
+	{
+		printf("Failed to read input file \"%s\"\n", input_path);
+		error = 1;
+	}
+	else if (error)
+		;
+	else if (ferror(c_source_file) || (c_source_file != stdout && fclose(c_source_file)) || (c_source_file == stdout && fflush(stdout)))
+	{
+		printf("Failed to write to output file \"%s\"\n", (output_path) ? output_path : "stdout");
+		error = 1;
+	}
+	fclose(n_source_file);
 	
-	return EXIT_SUCCESS;
+	return (error) ? 1 : EXIT_SUCCESS;
 }
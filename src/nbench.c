@@ -0,0 +1,639 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_BENCH_RUSAGE
+	#include <sys/resource.h>
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "n.h"
+
+#define ERROR_ARGC 1
+#define ERROR_FOPEN 2
+#define ERROR_MEMORY 4
+
+#define FORMAT_JSON 0
+#define FORMAT_CSV 1
+
+#if defined(_WIN32)
+	#define NULL_DEVICE "NUL"
+#else
+	#define NULL_DEVICE "/dev/null"
+#endif
+
+#if !defined(N_EXAMPLES_DIR)
+	#define N_EXAMPLES_DIR "examples"
+#endif
+
+#if !defined(N_BENCH_BIN2N)
+	#define N_BENCH_BIN2N "bin2n"
+#endif
+
+#if !defined(N_BENCH_DIR)
+	#define N_BENCH_DIR "."
+#endif
+
+#if !defined(N_VERSION)
+	#define N_VERSION "unknown"
+#endif
+
+/// Result of a benchmark.
+typedef struct result_t
+{
+	/// Benchmark name.
+	char name[64];
+	
+	/// Number of operations performed by one run of the benchmark.
+	uint64_t ops;
+	
+	/// Run time of the fastest run, in seconds.
+	double seconds;
+	
+	/// Peak resident set size of the benchmark process so far, or of its child processes for benchmarks which run other tools, in KiB.
+	uint64_t peak_rss;
+	
+} result_t;
+
+/// Benchmark settings and results.
+typedef struct bench_t
+{
+	/// Multiplier of workload sizes.
+	size_t scale;
+	
+	/// Number of runs of each benchmark, of which the fastest is reported.
+	int repeat;
+	
+	/// Directory containing the example programs.
+	const char* examples_directory;
+	
+	/// Directory containing the n2c-compiled example programs and temporary files.
+	const char* bench_directory;
+	
+	/// Path to the bin2n executable.
+	const char* bin2n_path;
+	
+	/// Benchmark results.
+	result_t* results;
+	
+	/// Number of benchmark results.
+	size_t result_count;
+	
+	/// Capacity of the results array.
+	size_t result_capacity;
+	
+} bench_t;
+
+/// Example program workload, run with input sequences of increasing size.
+typedef struct example_t
+{
+	/// Example program name.
+	const char* name;
+	
+	/// Input sizes, before scaling.
+	size_t sizes[3];
+	
+	/// Non-zero if sizes are sequence lengths which are multiplied by the scale, or zero if they are values of the first element.
+	int scaled;
+	
+} example_t;
+
+/// Example program workloads.
+static const example_t examples[] =
+{
+	{"factorial", {8, 9, 10}, 0},
+	{"fibonacci", {20, 25, 30}, 0},
+	{"reverse", {25, 50, 100}, 1},
+	{"rot13", {500, 1000, 2000}, 1},
+	{"append-nth", {250, 500, 1000}, 1}
+};
+
+/// Reads a file into a null-terminated buffer, which must be freed with `free()`.
+char* read_file(const char* path, size_t* size);
+
+/// Generates the input sequence of an example program workload of a given size.
+bignum_t* example_input(const char* name, size_t size, size_t* count);
+
+/// Records the result of a benchmark, and reports its progress to standard error.
+void record_result(bench_t* bench, const char* name, uint64_t ops, double seconds, uint64_t peak_rss);
+
+/// Runs a compiled program on an input sequence, or on a shared input sequence if `shared` is non-zero, returning the run time of the fastest run and setting the number of executed instructions.
+double time_program(const bench_t* bench, const n_program_t* program, const bignum_t* input, size_t input_count, const n_shared_input_t* shared, uint64_t* steps);
+
+/// Runs a shell command, returning its run time in seconds, or a negative number if it failed.
+double time_command(const char* command);
+
+/// Returns the peak resident set size of this process, or of its terminated child processes if `children` is non-zero, in KiB.
+uint64_t peak_rss(int children);
+
+/// Benchmarks the example programs in the interpreter and, where available, as compiled by n2c.
+void bench_examples(bench_t* bench);
+
+/// Benchmarks appending, truncating and rotating large sequences.
+void bench_sequence_ops(bench_t* bench);
+
+/// Benchmarks preprocessing and compiling a large source file.
+void bench_preprocess(bench_t* bench);
+
+/// Benchmarks converting a large binary file with bin2n, and interpreting the resulting program.
+void bench_bin2n(bench_t* bench);
+
+/// Writes benchmark results as JSON.
+void write_json(FILE* file, const bench_t* bench);
+
+/// Writes benchmark results as CSV.
+void write_csv(FILE* file, const bench_t* bench);
+
+/// Prints the usage string.
+void usage();
+
+int main(int argc, char* argv[])
+{
+	bench_t bench;
+	bench.scale = 1;
+	bench.repeat = 3;
+	bench.examples_directory = N_EXAMPLES_DIR;
+	bench.bench_directory = N_BENCH_DIR;
+	bench.bin2n_path = N_BENCH_BIN2N;
+	bench.results = 0;
+	bench.result_count = 0;
+	bench.result_capacity = 0;
+	int format = FORMAT_JSON;
+	const char* filter = 0;
+	FILE* output_file = stdout;
+	
+	// Read options
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+			bench.scale = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+			bench.repeat = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--format") && i + 1 < argc)
+			format = (!strcmp(argv[++i], "csv")) ? FORMAT_CSV : FORMAT_JSON;
+		else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+			filter = argv[++i];
+		else if (!strcmp(argv[i], "--examples") && i + 1 < argc)
+			bench.examples_directory = argv[++i];
+		else if (!strcmp(argv[i], "--bench-dir") && i + 1 < argc)
+			bench.bench_directory = argv[++i];
+		else if (!strcmp(argv[i], "--bin2n") && i + 1 < argc)
+			bench.bin2n_path = argv[++i];
+		else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) && i + 1 < argc)
+		{
+			output_file = fopen(argv[++i], "wb");
+			if (!output_file)
+			{
+				printf("Failed to open output file \"%s\"\n", argv[i]);
+				return ERROR_FOPEN;
+			}
+		}
+		else
+		{
+			usage();
+			return ERROR_ARGC;
+		}
+	}
+	if (!bench.scale)
+		bench.scale = 1;
+	if (bench.repeat < 1)
+		bench.repeat = 1;
+	
+	// Run benchmark groups
+	if (!filter || strstr("examples", filter))
+		bench_examples(&bench);
+	if (!filter || strstr("sequence", filter))
+		bench_sequence_ops(&bench);
+	if (!filter || strstr("preprocess", filter))
+		bench_preprocess(&bench);
+	if (!filter || strstr("bin2n", filter))
+		bench_bin2n(&bench);
+	
+	// Write results
+	if (format == FORMAT_CSV)
+		write_csv(output_file, &bench);
+	else
+		write_json(output_file, &bench);
+	
+	if (output_file != stdout)
+		fclose(output_file);
+	free(bench.results);
+	
+	return EXIT_SUCCESS;
+}
+
+char* read_file(const char* path, size_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	char* buffer = malloc(*size + 1);
+	if (buffer && fread(buffer, 1, *size, file) != *size)
+	{
+		free(buffer);
+		buffer = 0;
+	}
+	if (buffer)
+		buffer[*size] = '\0';
+	fclose(file);
+	
+	return buffer;
+}
+
+bignum_t* example_input(const char* name, size_t size, size_t* count)
+{
+	// Sequence workloads are as long as their size, while others are a single element
+	int sequence = strcmp(name, "factorial") && strcmp(name, "fibonacci");
+	*count = (sequence) ? size : 1;
+	bignum_t* input = malloc(*count * sizeof(bignum_t));
+	if (!input)
+		return 0;
+	
+	if (!sequence)
+		input[0] = size;
+	else if (!strcmp(name, "rot13"))
+		for (size_t i = 0; i < size; ++i)
+			input[i] = 'A' + (i * 7) % 58;
+	else
+		for (size_t i = 0; i < size; ++i)
+			input[i] = i + 1;
+	
+	// Append the nth element of the middle of the sequence
+	if (!strcmp(name, "append-nth"))
+		input[0] = size / 2;
+	
+	return input;
+}
+
+void record_result(bench_t* bench, const char* name, uint64_t ops, double seconds, uint64_t peak_rss)
+{
+	if (bench->result_count == bench->result_capacity)
+	{
+		size_t capacity = (bench->result_capacity) ? bench->result_capacity * 2 : 32;
+		result_t* results = realloc(bench->results, capacity * sizeof(result_t));
+		if (!results)
+			return;
+		bench->results = results;
+		bench->result_capacity = capacity;
+	}
+	
+	result_t* result = &bench->results[bench->result_count++];
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	result->ops = ops;
+	result->seconds = seconds;
+	result->peak_rss = peak_rss;
+	
+	// Report progress, as a full run takes a while
+	fprintf(stderr, "%-32s %12.3f ms\n", name, seconds * 1e3);
+}
+
+double time_program(const bench_t* bench, const n_program_t* program, const bignum_t* input, size_t input_count, const n_shared_input_t* shared, uint64_t* steps)
+{
+	n_context_t* context = n_context_create();
+	if (!context)
+		return -1.0;
+	
+	double best = -1.0;
+	for (int i = 0; i < bench->repeat; ++i)
+	{
+		double start_time = n_clock();
+		int status = (shared) ? n_context_run_shared(context, program, shared) : n_context_run(context, program, input, input_count);
+		double seconds = n_clock() - start_time;
+		if (status != N_SUCCESS)
+		{
+			best = -1.0;
+			break;
+		}
+		if (best < 0.0 || seconds < best)
+			best = seconds;
+	}
+	*steps = context->steps;
+	
+	n_context_free(context);
+	return best;
+}
+
+double time_command(const char* command)
+{
+	double start_time = n_clock();
+	int status = system(command);
+	double seconds = n_clock() - start_time;
+	return (status) ? -1.0 : seconds;
+}
+
+uint64_t peak_rss(int children)
+{
+	#if defined(N_BENCH_RUSAGE)
+		struct rusage usage;
+		if (getrusage((children) ? RUSAGE_CHILDREN : RUSAGE_SELF, &usage))
+			return 0;
+		#if defined(__APPLE__)
+			return (uint64_t)usage.ru_maxrss / 1024;
+		#else
+			return (uint64_t)usage.ru_maxrss;
+		#endif
+	#else
+		(void)children;
+		return 0;
+	#endif
+}
+
+void bench_examples(bench_t* bench)
+{
+	char path[1024];
+	char name[64];
+	
+	for (size_t i = 0; i < sizeof(examples) / sizeof(example_t); ++i)
+	{
+		const example_t* example = &examples[i];
+		
+		// Compile example program
+		size_t source_size;
+		snprintf(path, sizeof(path), "%s/%s.n", bench->examples_directory, example->name);
+		char* source = read_file(path, &source_size);
+		n_program_t* program = (source) ? n_program_compile(source, source_size) : 0;
+		free(source);
+		if (!program)
+		{
+			fprintf(stderr, "Failed to load example \"%s\"\n", path);
+			continue;
+		}
+		
+		for (size_t j = 0; j < sizeof(example->sizes) / sizeof(size_t); ++j)
+		{
+			size_t size = example->sizes[j] * ((example->scaled) ? bench->scale : 1);
+			size_t input_count;
+			bignum_t* input = example_input(example->name, size, &input_count);
+			if (!input)
+				continue;
+			
+			// Interpret example
+			uint64_t steps = 0;
+			double seconds = time_program(bench, program, input, input_count, 0, &steps);
+			snprintf(name, sizeof(name), "n/%s/%zu", example->name, size);
+			if (seconds >= 0.0)
+				record_result(bench, name, steps, seconds, peak_rss(0));
+			
+			// Run n2c-compiled example, counting the interpreter's instructions as its operations so that their rates can be compared
+			int length = snprintf(path, sizeof(path), "\"%s/nbench-%s\"", bench->bench_directory, example->name);
+			char* command = malloc(length + input_count * 21 + sizeof(" > " NULL_DEVICE));
+			if (command && seconds >= 0.0)
+			{
+				strcpy(command, path);
+				for (size_t k = 0; k < input_count; ++k)
+					length += sprintf(command + length, " %" PRIu64, input[k]);
+				strcpy(command + length, " > " NULL_DEVICE);
+				
+				double best = -1.0;
+				for (int k = 0; k < bench->repeat; ++k)
+				{
+					double command_seconds = time_command(command);
+					if (command_seconds < 0.0)
+					{
+						best = -1.0;
+						break;
+					}
+					if (best < 0.0 || command_seconds < best)
+						best = command_seconds;
+				}
+				
+				snprintf(name, sizeof(name), "n2c/%s/%zu", example->name, size);
+				if (best >= 0.0)
+					record_result(bench, name, steps, best, peak_rss(1));
+			}
+			free(command);
+			free(input);
+		}
+		
+		n_program_free(program);
+	}
+}
+
+void bench_sequence_ops(bench_t* bench)
+{
+	// Each workload starts from a long sequence, then repeats an operator as many times as the sequence is long. The load workload only copies the input sequence into the context, which every other workload includes, while shared workloads map it copy-on-write.
+	static const char* const workloads[][2] =
+	{
+		{"sequence/load", ""},
+		{"sequence/load-shared", ""},
+		{"sequence/append", "[:]"},
+		{"sequence/truncate", "#[|]"},
+		{"sequence/rotate-left", "#[<]"},
+		{"sequence/rotate-left-shared", "#[<]"},
+		{"sequence/rotate-right", "#[>]"},
+		{"sequence/rotate-full", ":#[<]"}
+	};
+	
+	// Rotation of a sequence which fills its ring buffer only moves its head, while others move an element. The full workload appends one element to fill the ring buffer when the scale is a power of two.
+	size_t count = ((size_t)1 << 22) * bench->scale - 1;
+	bignum_t* input = calloc(count, sizeof(bignum_t));
+	n_shared_input_t* shared = (input) ? n_shared_input_create(input, count) : 0;
+	if (!shared)
+	{
+		free(input);
+		return;
+	}
+	
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i)
+	{
+		n_program_t* program = n_program_compile(workloads[i][1], strlen(workloads[i][1]));
+		if (!program)
+			continue;
+		
+		// Appends start from a single element with the sequence length as its value
+		uint64_t steps = 0;
+		double seconds;
+		if (!strcmp(workloads[i][0], "sequence/append"))
+		{
+			bignum_t length = count;
+			seconds = time_program(bench, program, &length, 1, 0, &steps);
+		}
+		else
+		{
+			seconds = time_program(bench, program, input, count, (strstr(workloads[i][0], "-shared")) ? shared : 0, &steps);
+		}
+		
+		if (seconds >= 0.0)
+			record_result(bench, workloads[i][0], count, seconds, peak_rss(0));
+		n_program_free(program);
+	}
+	
+	n_shared_input_free(shared);
+	free(input);
+}
+
+void bench_preprocess(bench_t* bench)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/rot13.n", bench->examples_directory);
+	size_t example_size;
+	char* example = read_file(path, &example_size);
+	if (!example || !example_size)
+	{
+		free(example);
+		return;
+	}
+	
+	// Concatenate copies of a commented example into a large source
+	size_t source_size = ((size_t)16 << 20) * bench->scale;
+	char* source = malloc(source_size + 1);
+	char* copy = malloc(source_size + 1);
+	if (!source || !copy)
+	{
+		free(example);
+		free(source);
+		free(copy);
+		return;
+	}
+	for (size_t i = 0; i < source_size; i += example_size)
+		memcpy(source + i, example, (source_size - i < example_size) ? source_size - i : example_size);
+	source[source_size] = '\0';
+	free(example);
+	
+	double preprocess_best = -1.0;
+	double compile_best = -1.0;
+	for (int i = 0; i < bench->repeat; ++i)
+	{
+		// Preprocess a copy of the source, as it is modified in place
+		memcpy(copy, source, source_size + 1);
+		double start_time = n_clock();
+		n_preprocess(&copy);
+		double seconds = n_clock() - start_time;
+		if (preprocess_best < 0.0 || seconds < preprocess_best)
+			preprocess_best = seconds;
+		free(copy);
+		
+		start_time = n_clock();
+		n_program_t* program = n_program_compile(source, source_size);
+		seconds = n_clock() - start_time;
+		if (program && (compile_best < 0.0 || seconds < compile_best))
+			compile_best = seconds;
+		n_program_free(program);
+		
+		copy = malloc(source_size + 1);
+		if (!copy)
+			break;
+	}
+	
+	record_result(bench, "preprocess", source_size, preprocess_best, peak_rss(0));
+	if (compile_best >= 0.0)
+		record_result(bench, "compile", source_size, compile_best, peak_rss(0));
+	
+	free(source);
+	free(copy);
+}
+
+void bench_bin2n(bench_t* bench)
+{
+	char binary_path[1024];
+	char program_path[1024];
+	char command[4096];
+	snprintf(binary_path, sizeof(binary_path), "%s/nbench.bin", bench->bench_directory);
+	snprintf(program_path, sizeof(program_path), "%s/nbench.bin.n", bench->bench_directory);
+	
+	// Write a pseudorandom binary file, from a fixed seed so that runs are reproducible
+	size_t size = ((size_t)1 << 20) * bench->scale;
+	FILE* file = fopen(binary_path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open benchmark file \"%s\"\n", binary_path);
+		return;
+	}
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	for (size_t i = 0; i < size; ++i)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		fputc((int)(state & 0xFF), file);
+	}
+	fclose(file);
+	
+	// Convert binary file into a program
+	snprintf(command, sizeof(command), "\"%s\" \"%s\" \"%s\"", bench->bin2n_path, binary_path, program_path);
+	double best = -1.0;
+	for (int i = 0; i < bench->repeat; ++i)
+	{
+		double seconds = time_command(command);
+		if (seconds < 0.0)
+		{
+			best = -1.0;
+			break;
+		}
+		if (best < 0.0 || seconds < best)
+			best = seconds;
+	}
+	if (best >= 0.0)
+		record_result(bench, "bin2n", size, best, peak_rss(1));
+	
+	// Interpret the converted program
+	size_t source_size;
+	char* source = (best >= 0.0) ? read_file(program_path, &source_size) : 0;
+	n_program_t* program = (source) ? n_program_compile(source, source_size) : 0;
+	free(source);
+	if (program)
+	{
+		uint64_t steps = 0;
+		double seconds = time_program(bench, program, 0, 0, 0, &steps);
+		if (seconds >= 0.0)
+			record_result(bench, "n/bin2n", steps, seconds, peak_rss(0));
+		n_program_free(program);
+	}
+	
+	remove(binary_path);
+	remove(program_path);
+}
+
+void write_json(FILE* file, const bench_t* bench)
+{
+	fprintf(file, "{\n\t\"version\": \"%s\",\n\t\"scale\": %zu,\n\t\"repeat\": %d,\n\t\"results\": [", N_VERSION, bench->scale, bench->repeat);
+	for (size_t i = 0; i < bench->result_count; ++i)
+	{
+		const result_t* result = &bench->results[i];
+		double rate = (result->seconds > 0.0) ? (double)result->ops / result->seconds : 0.0;
+		double ns = (result->ops) ? result->seconds * 1e9 / (double)result->ops : 0.0;
+		fprintf(file, "%s\n\t\t{\"name\": \"%s\", \"ops\": %" PRIu64 ", \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"ns_per_op\": %.3f, \"peak_rss_kib\": %" PRIu64 "}",
+			(i) ? "," : "", result->name, result->ops, result->seconds, rate, ns, result->peak_rss);
+	}
+	fprintf(file, "%s]\n}\n", (bench->result_count) ? "\n\t" : "");
+}
+
+void write_csv(FILE* file, const bench_t* bench)
+{
+	fprintf(file, "name,ops,seconds,ops_per_sec,ns_per_op,peak_rss_kib\n");
+	for (size_t i = 0; i < bench->result_count; ++i)
+	{
+		const result_t* result = &bench->results[i];
+		double rate = (result->seconds > 0.0) ? (double)result->ops / result->seconds : 0.0;
+		double ns = (result->ops) ? result->seconds * 1e9 / (double)result->ops : 0.0;
+		fprintf(file, "%s,%" PRIu64 ",%.6f,%.1f,%.3f,%" PRIu64 "\n", result->name, result->ops, result->seconds, rate, ns, result->peak_rss);
+	}
+}
+
+void usage()
+{
+	printf("Usage: nbench [--scale <factor>] [--repeat <count>] [--format json|csv] [--filter examples|sequence|preprocess|bin2n] [--output <file>]\n");
+}
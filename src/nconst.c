@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "n.h"
+
+#define ERROR_ARGC 1
+#define ERROR_FOPEN 2
+#define ERROR_MEMORY 3
+#define ERROR_FWRITE 4
+
+/// Writes a C header with the operations and their lengths for every value of a bit width.
+int write_table(FILE* output, const n_constant_table_t* table, size_t bits, const char* name);
+
+/// Prints the usage string.
+void usage();
+
+int main(int argc, char* argv[])
+{
+	size_t table_bits = 0;
+	const char* name = "n_constant";
+	FILE* output_file = stdout;
+	int value_count = 0;
+	
+	// Read options, leaving values in place
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--table") && i + 1 < argc)
+		{
+			table_bits = strtoull(argv[++i], 0, 10);
+			if (table_bits != 8 && table_bits != N_CONSTANT_TABLE_BITS)
+			{
+				printf("Table bit width must be 8 or %d\n", N_CONSTANT_TABLE_BITS);
+				return ERROR_ARGC;
+			}
+		}
+		else if (!strcmp(argv[i], "--name") && i + 1 < argc)
+		{
+			name = argv[++i];
+		}
+		else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) && i + 1 < argc)
+		{
+			output_file = fopen(argv[++i], "wb");
+			if (!output_file)
+			{
+				printf("Failed to open output file \"%s\"\n", argv[i]);
+				return ERROR_FOPEN;
+			}
+		}
+		else if (isdigit((unsigned char)argv[i][0]))
+		{
+			++value_count;
+		}
+		else
+		{
+			usage();
+			return ERROR_ARGC;
+		}
+	}
+	if (!table_bits == !value_count)
+	{
+		usage();
+		return ERROR_ARGC;
+	}
+	
+	n_constant_table_t* table = n_constant_table_create();
+	if (!table)
+	{
+		printf("Failed to allocate memory\n");
+		return ERROR_MEMORY;
+	}
+	
+	int error = 0;
+	if (table_bits)
+	{
+		error = write_table(output_file, table, table_bits, name);
+	}
+	else
+	{
+		// Write the operations of each value on its own line
+		for (int i = 1; i < argc && !error; ++i)
+		{
+			if (!strcmp(argv[i], "--name") || !strcmp(argv[i], "-o") || !strcmp(argv[i], "--output"))
+			{
+				++i;
+				continue;
+			}
+			
+			char* operations = n_constant_synthesize(table, strtoull(argv[i], 0, 0), 0);
+			if (!operations)
+				error = ERROR_MEMORY;
+			else if (fprintf(output_file, "%s\n", operations) < 0)
+				error = ERROR_FWRITE;
+			free(operations);
+		}
+	}
+	n_constant_table_free(table);
+	
+	if (output_file != stdout && fclose(output_file) && !error)
+		error = ERROR_FWRITE;
+	if (error == ERROR_MEMORY)
+		printf("Failed to allocate memory\n");
+	else if (error == ERROR_FWRITE)
+		printf("Failed to write data to output\n");
+	
+	return (error) ? error : EXIT_SUCCESS;
+}
+
+int write_table(FILE* output, const n_constant_table_t* table, size_t bits, const char* name)
+{
+	size_t value_count = (size_t)1 << bits;
+	
+	// Header guard from the upper case name
+	char* guard = malloc(strlen(name) + 3);
+	if (!guard)
+		return ERROR_MEMORY;
+	for (size_t i = 0; name[i]; ++i)
+		guard[i] = (char)toupper((unsigned char)name[i]);
+	strcpy(guard + strlen(name), "_H");
+	fprintf(output, "#ifndef %s\n#define %s\n\nconst char* const %s_operations[] =\n{\n", guard, guard, name);
+	
+	for (size_t value = 0; value < value_count; ++value)
+	{
+		char* operations = n_constant_synthesize(table, value, 0);
+		if (!operations)
+		{
+			free(guard);
+			return ERROR_MEMORY;
+		}
+		fprintf(output, "\t\"%s\"%s\n", operations, (value + 1 < value_count) ? "," : "");
+		free(operations);
+	}
+	
+	fprintf(output, "};\n\nsize_t %s_lengths[%zu] =\n{\n", name, value_count);
+	for (size_t value = 0; value < value_count; ++value)
+		fprintf(output, "\t%u%s\n", (unsigned)table->lengths[value], (value + 1 < value_count) ? "," : "");
+	
+	int error = (fprintf(output, "};\n\n#endif // %s\n", guard) < 0) ? ERROR_FWRITE : 0;
+	free(guard);
+	
+	return error;
+}
+
+void usage()
+{
+	printf("Usage: nconst <value>... [--output <file>]\n       nconst --table <bits> [--name <name>] [--output <file>]\n");
+}
@@ -0,0 +1,709 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_EVAL_SYSCONF
+	#include <unistd.h>
+#endif
+
+#if defined(N_EVAL_THREADS)
+	#include <pthread.h>
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "n.h"
+
+#define ERROR_ARGC 1
+#define ERROR_FOPEN 2
+#define ERROR_FREAD 3
+#define ERROR_MEMORY 4
+#define ERROR_FORMAT 5
+
+/// Number of distinct programs which a thread takes at a time.
+#define CHUNK_SIZE 256
+
+/// Maximum number of nested shared prefixes whose states are kept by each thread.
+#define MAX_PREFIXES 16
+
+/// Test case, whose input and expected output sequences are stored in an array of test case elements.
+typedef struct test_case_t
+{
+	/// Index of the first input element.
+	size_t input;
+	
+	/// Number of input elements.
+	size_t input_count;
+	
+	/// Index of the first expected output element.
+	size_t expected;
+	
+	/// Number of expected output elements.
+	size_t expected_count;
+	
+} test_case_t;
+
+/// Fitness of a program over every test case.
+typedef struct fitness_t
+{
+	/// Number of test cases whose output matched exactly.
+	uint64_t exact;
+	
+	/// Number of test cases on which the program was stopped by a limit.
+	uint64_t failed;
+	
+	/// Total distance between outputs and expected outputs, saturating at 2^64 - 1. Failed test cases have the largest distance.
+	uint64_t distance;
+	
+	/// Total number of executed instructions.
+	uint64_t steps;
+	
+} fitness_t;
+
+/// Program line, ordered by compiled instructions when deduplicating.
+typedef struct program_line_t
+{
+	/// Compiled program.
+	n_program_t* program;
+	
+	/// Index of the line in the programs file.
+	size_t line;
+	
+} program_line_t;
+
+/// State of one test case after running a prefix.
+typedef struct prefix_state_t
+{
+	/// Status of the prefix run.
+	int status;
+	
+	/// Number of instructions executed by the prefix.
+	uint64_t steps;
+	
+	/// Largest number of elements in the sequence during the prefix.
+	size_t peak_count;
+	
+	/// Number of elements in the sequence.
+	size_t count;
+	
+	/// Index of the first element in the prefix's element array.
+	size_t offset;
+	
+} prefix_state_t;
+
+/// States of every test case after running a loop-balanced prefix of instructions which consecutive programs share.
+typedef struct prefix_t
+{
+	/// Number of instructions in the prefix.
+	size_t length;
+	
+	/// State of each test case.
+	prefix_state_t* states;
+	
+	/// Sequence elements of every test case.
+	bignum_t* elements;
+	
+	/// Capacity of the element array.
+	size_t element_capacity;
+	
+} prefix_t;
+
+/// Evaluation shared between threads.
+typedef struct evaluator_t
+{
+	/// Distinct programs, ordered by their instructions so that programs with shared prefixes are adjacent.
+	program_line_t* programs;
+	
+	/// Number of distinct programs.
+	size_t program_count;
+	
+	/// Fitness of each distinct program.
+	fitness_t* fitness;
+	
+	/// Test cases.
+	const test_case_t* cases;
+	
+	/// Number of test cases.
+	size_t case_count;
+	
+	/// Input and expected output elements of the test cases.
+	const bignum_t* elements;
+	
+	/// Execution limits of each run.
+	n_limits_t limits;
+	
+	/// Index of the next distinct program to be taken by a thread.
+	size_t next;
+	
+	#if defined(N_EVAL_THREADS)
+		/// Mutex which guards the index of the next distinct program.
+		pthread_mutex_t mutex;
+	#endif
+	
+} evaluator_t;
+
+/// Thread of an evaluation, which owns all storage used while evaluating programs.
+typedef struct worker_t
+{
+	/// Evaluation shared between threads.
+	evaluator_t* evaluator;
+	
+	/// Execution context.
+	n_context_t* context;
+	
+	/// Stack of nested shared prefixes of the last evaluated program.
+	prefix_t prefixes[MAX_PREFIXES];
+	
+	/// Number of prefixes on the stack.
+	size_t prefix_count;
+	
+	/// Non-zero if storage could not be allocated.
+	int failed;
+	
+	#if defined(N_EVAL_THREADS)
+		/// Thread handle.
+		pthread_t thread;
+	#endif
+	
+} worker_t;
+
+/// Reads a file into a null-terminated buffer, which must be freed with `free()`.
+char* read_file(const char* path, size_t* size);
+
+/// Reads test cases, one per line with input elements and expected output elements separated by `->`, and returns zero or an error code.
+int read_cases(const char* text, test_case_t** cases, size_t* case_count, bignum_t** elements);
+
+/// Orders programs by compiled instructions.
+int compare_instructions(const n_program_t* a, const n_program_t* b);
+
+/// Orders program lines by compiled instructions, then by line.
+int compare_programs(const void* a, const void* b);
+
+/// Returns the length of the longest prefix of two programs which is identical and has no unmatched loops.
+size_t common_prefix(const n_program_t* a, const n_program_t* b);
+
+/// Returns the distance between an output sequence and an expected output sequence, as the sum of the differences between their elements plus one for each element which only one of them has.
+uint64_t sequence_distance(const bignum_t* output, size_t output_count, const bignum_t* expected, size_t expected_count);
+
+/// Runs the first instructions of a program on every test case, starting from the previous prefix on the stack, and pushes the states as a new prefix.
+void push_prefix(worker_t* worker, const n_program_t* program, size_t length);
+
+/// Evaluates a program on every test case, starting from the prefix on top of the stack.
+void evaluate_program(worker_t* worker, const n_program_t* program, fitness_t* fitness);
+
+/// Evaluates chunks of distinct programs until none remain.
+void* run_worker(void* worker);
+
+/// Prints the usage string.
+void usage();
+
+int main(int argc, char* argv[])
+{
+	n_limits_t limits = {10000, 4096, 0.0};
+	size_t thread_count = 1;
+	FILE* output_file = stdout;
+	
+	#if defined(N_EVAL_SYSCONF) && defined(N_EVAL_THREADS)
+		long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+		if (processor_count > 0)
+			thread_count = (size_t)processor_count;
+	#endif
+	
+	if (argc < 3)
+	{
+		usage();
+		return ERROR_ARGC;
+	}
+	
+	// Read options
+	for (int i = 3; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--max-steps") && i + 1 < argc)
+			limits.max_steps = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--max-elements") && i + 1 < argc)
+			limits.max_elements = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			thread_count = strtoull(argv[++i], 0, 10);
+		else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) && i + 1 < argc)
+		{
+			output_file = fopen(argv[++i], "wb");
+			if (!output_file)
+			{
+				printf("Failed to open output file \"%s\"\n", argv[i]);
+				return ERROR_FOPEN;
+			}
+		}
+		else
+		{
+			usage();
+			return ERROR_ARGC;
+		}
+	}
+	if (!thread_count)
+		thread_count = 1;
+	#if !defined(N_EVAL_THREADS)
+		thread_count = 1;
+	#endif
+	
+	// Read programs and test cases
+	size_t programs_size = 0;
+	size_t cases_size = 0;
+	char* programs_text = read_file(argv[1], &programs_size);
+	char* cases_text = read_file(argv[2], &cases_size);
+	if (!programs_text || !cases_text)
+	{
+		printf("Failed to read %s file \"%s\"\n", (programs_text) ? "test case" : "programs", (programs_text) ? argv[2] : argv[1]);
+		free(programs_text);
+		free(cases_text);
+		return ERROR_FREAD;
+	}
+	
+	evaluator_t evaluator;
+	memset(&evaluator, 0, sizeof(evaluator));
+	evaluator.limits = limits;
+	test_case_t* cases = 0;
+	bignum_t* elements = 0;
+	int error = read_cases(cases_text, &cases, &evaluator.case_count, &elements);
+	free(cases_text);
+	evaluator.cases = cases;
+	evaluator.elements = elements;
+	
+	// Compile one program per line, ignoring a final newline
+	size_t line_count = (programs_size && programs_text[programs_size - 1] != '\n');
+	for (size_t i = 0; i < programs_size; ++i)
+		line_count += (programs_text[i] == '\n');
+	program_line_t* programs = calloc(line_count + 1, sizeof(program_line_t));
+	size_t* distinct = malloc((line_count + 1) * sizeof(size_t));
+	if (!error && (!programs || !distinct))
+		error = ERROR_MEMORY;
+	const char* line = programs_text;
+	for (size_t i = 0; i < line_count && !error; ++i)
+	{
+		const char* line_end = memchr(line, '\n', programs_text + programs_size - line);
+		if (!line_end)
+			line_end = programs_text + programs_size;
+		programs[i].program = n_program_compile(line, line_end - line);
+		programs[i].line = i;
+		if (!programs[i].program)
+			error = ERROR_MEMORY;
+		line = line_end + 1;
+	}
+	free(programs_text);
+	
+	// Deduplicate programs with identical instructions, which leaves programs with shared prefixes adjacent
+	if (!error && line_count)
+	{
+		qsort(programs, line_count, sizeof(program_line_t), compare_programs);
+		for (size_t i = 0; i < line_count; ++i)
+		{
+			if (evaluator.program_count && !compare_instructions(programs[i].program, programs[evaluator.program_count - 1].program))
+			{
+				distinct[programs[i].line] = evaluator.program_count - 1;
+				n_program_free(programs[i].program);
+				continue;
+			}
+			distinct[programs[i].line] = evaluator.program_count;
+			programs[evaluator.program_count++] = programs[i];
+		}
+		for (size_t i = evaluator.program_count; i < line_count; ++i)
+			programs[i].program = 0;
+		
+		evaluator.programs = programs;
+		evaluator.fitness = calloc(evaluator.program_count, sizeof(fitness_t));
+		if (!evaluator.fitness)
+			error = ERROR_MEMORY;
+	}
+	
+	// Evaluate distinct programs in parallel
+	worker_t* workers = (!error) ? calloc(thread_count, sizeof(worker_t)) : 0;
+	if (!error && !workers)
+		error = ERROR_MEMORY;
+	if (!error)
+	{
+		#if defined(N_EVAL_THREADS)
+			pthread_mutex_init(&evaluator.mutex, 0);
+		#endif
+		for (size_t i = 0; i < thread_count; ++i)
+		{
+			workers[i].evaluator = &evaluator;
+			workers[i].context = n_context_create();
+			if (workers[i].context)
+				workers[i].context->limits = limits;
+			else
+				workers[i].failed = 1;
+		}
+		
+		#if defined(N_EVAL_THREADS)
+			for (size_t i = 1; i < thread_count; ++i)
+				if (pthread_create(&workers[i].thread, 0, run_worker, &workers[i]))
+					workers[i].failed = 2;
+			run_worker(&workers[0]);
+			for (size_t i = 1; i < thread_count; ++i)
+				if (workers[i].failed != 2)
+					pthread_join(workers[i].thread, 0);
+			pthread_mutex_destroy(&evaluator.mutex);
+		#else
+			run_worker(&workers[0]);
+		#endif
+		
+		for (size_t i = 0; i < thread_count; ++i)
+		{
+			if (workers[i].failed == 1)
+				error = ERROR_MEMORY;
+			n_context_free(workers[i].context);
+			for (size_t j = 0; j < MAX_PREFIXES; ++j)
+			{
+				free(workers[i].prefixes[j].states);
+				free(workers[i].prefixes[j].elements);
+			}
+		}
+		
+		// Every distinct program is evaluated as long as one thread started
+		if (evaluator.next < evaluator.program_count)
+			error = ERROR_MEMORY;
+	}
+	free(workers);
+	
+	// Write the fitness of each program line
+	if (!error)
+	{
+		fprintf(output_file, "line,exact,failed,distance,steps\n");
+		for (size_t i = 0; i < line_count; ++i)
+		{
+			const fitness_t* fitness = &evaluator.fitness[distinct[i]];
+			fprintf(output_file, "%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", i + 1, fitness->exact, fitness->failed, fitness->distance, fitness->steps);
+		}
+	}
+	else if (error == ERROR_MEMORY)
+	{
+		printf("Failed to allocate memory\n");
+	}
+	
+	if (output_file != stdout)
+		fclose(output_file);
+	for (size_t i = 0; programs && i < line_count; ++i)
+		n_program_free(programs[i].program);
+	free(programs);
+	free(distinct);
+	free(evaluator.fitness);
+	free(cases);
+	free(elements);
+	
+	return error;
+}
+
+char* read_file(const char* path, size_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	char* buffer = malloc(*size + 1);
+	if (buffer && fread(buffer, 1, *size, file) != *size)
+	{
+		free(buffer);
+		buffer = 0;
+	}
+	if (buffer)
+		buffer[*size] = '\0';
+	fclose(file);
+	
+	return buffer;
+}
+
+int read_cases(const char* text, test_case_t** cases, size_t* case_count, bignum_t** elements)
+{
+	// Every element takes at least two characters, and every test case at least one line
+	size_t length = strlen(text);
+	size_t line_count = 1;
+	for (size_t i = 0; i < length; ++i)
+		line_count += (text[i] == '\n');
+	*cases = malloc(line_count * sizeof(test_case_t));
+	*elements = malloc((length / 2 + 1) * sizeof(bignum_t));
+	*case_count = 0;
+	if (!*cases || !*elements)
+		return ERROR_MEMORY;
+	
+	size_t element_count = 0;
+	const char* line = text;
+	for (size_t i = 0; i < line_count; ++i)
+	{
+		const char* line_end = strchr(line, '\n');
+		if (!line_end)
+			line_end = text + length;
+		
+		// Skip blank lines
+		const char* c = line;
+		while (c < line_end && (*c == ' ' || *c == '\t' || *c == '\r'))
+			++c;
+		if (c < line_end)
+		{
+			test_case_t* test_case = &(*cases)[(*case_count)++];
+			const char* arrow = strstr(line, "->");
+			if (!arrow || arrow > line_end)
+			{
+				printf("Missing \"->\" in test case on line %zu\n", i + 1);
+				return ERROR_FORMAT;
+			}
+			
+			// Read input elements, then expected output elements
+			test_case->input = element_count;
+			for (c = line; c < arrow;)
+			{
+				if (*c >= '0' && *c <= '9')
+					(*elements)[element_count++] = strtoull(c, (char**)&c, 10);
+				else
+					++c;
+			}
+			test_case->input_count = element_count - test_case->input;
+			test_case->expected = element_count;
+			for (c = arrow + 2; c < line_end;)
+			{
+				if (*c >= '0' && *c <= '9')
+					(*elements)[element_count++] = strtoull(c, (char**)&c, 10);
+				else
+					++c;
+			}
+			test_case->expected_count = element_count - test_case->expected;
+		}
+		
+		line = line_end + 1;
+	}
+	
+	return 0;
+}
+
+int compare_instructions(const n_program_t* p, const n_program_t* q)
+{
+	for (size_t i = 0; i < p->instruction_count && i < q->instruction_count; ++i)
+	{
+		if (p->instructions[i].opcode != q->instructions[i].opcode)
+			return (p->instructions[i].opcode < q->instructions[i].opcode) ? -1 : 1;
+		if (p->instructions[i].operand != q->instructions[i].operand)
+			return (p->instructions[i].operand < q->instructions[i].operand) ? -1 : 1;
+	}
+	if (p->instruction_count != q->instruction_count)
+		return (p->instruction_count < q->instruction_count) ? -1 : 1;
+	return 0;
+}
+
+int compare_programs(const void* a, const void* b)
+{
+	const program_line_t* x = a;
+	const program_line_t* y = b;
+	int order = compare_instructions(x->program, y->program);
+	if (order)
+		return order;
+	return (x->line < y->line) ? -1 : (x->line > y->line);
+}
+
+size_t common_prefix(const n_program_t* a, const n_program_t* b)
+{
+	size_t prefix = 0;
+	size_t loop_depth = 0;
+	for (size_t i = 0; i < a->instruction_count && i < b->instruction_count; ++i)
+	{
+		if (a->instructions[i].opcode != b->instructions[i].opcode || a->instructions[i].operand != b->instructions[i].operand)
+			break;
+		
+		if (a->instructions[i].opcode == N_OP_LOOP_START)
+			++loop_depth;
+		else if (a->instructions[i].opcode == N_OP_LOOP_END)
+			--loop_depth;
+		if (!loop_depth)
+			prefix = i + 1;
+	}
+	return prefix;
+}
+
+uint64_t sequence_distance(const bignum_t* output, size_t output_count, const bignum_t* expected, size_t expected_count)
+{
+	uint64_t distance = 0;
+	size_t count = (output_count > expected_count) ? output_count : expected_count;
+	for (size_t i = 0; i < count; ++i)
+	{
+		bignum_t a = (i < output_count) ? output[i] : 0;
+		bignum_t b = (i < expected_count) ? expected[i] : 0;
+		uint64_t difference = (a > b) ? a - b : b - a;
+		if (i >= output_count || i >= expected_count)
+			difference += (difference != UINT64_MAX);
+		distance = (difference > UINT64_MAX - distance) ? UINT64_MAX : distance + difference;
+	}
+	return distance;
+}
+
+/// Restores a context to the state of a test case after a prefix, then continues running a program from the end of the prefix.
+static int resume_prefix(n_context_t* context, const n_program_t* program, const prefix_t* prefix, const prefix_state_t* state)
+{
+	if (state->status != N_SUCCESS)
+	{
+		context->steps = state->steps;
+		return state->status;
+	}
+	
+	context->count = 0;
+	context->head = 0;
+	if (n_context_prepare(context, program, state->count) != N_SUCCESS)
+		return N_ERROR_MEMORY;
+	memcpy(context->elements, prefix->elements + state->offset, state->count * sizeof(bignum_t));
+	context->count = state->count;
+	context->peak_count = state->peak_count;
+	context->steps = state->steps;
+	context->ip = prefix->length;
+	context->loop_depth = 0;
+	
+	return n_context_resume(context, program);
+}
+
+void push_prefix(worker_t* worker, const n_program_t* program, size_t length)
+{
+	const evaluator_t* evaluator = worker->evaluator;
+	const prefix_t* parent = (worker->prefix_count) ? &worker->prefixes[worker->prefix_count - 1] : 0;
+	prefix_t* prefix = &worker->prefixes[worker->prefix_count];
+	if (!prefix->states)
+	{
+		prefix->states = malloc((evaluator->case_count + 1) * sizeof(prefix_state_t));
+		if (!prefix->states)
+			return;
+	}
+	
+	// The prefix is a valid program of its own, since it has no unmatched loops
+	n_program_t prefix_program = *program;
+	prefix_program.instruction_count = length;
+	prefix_program.mapping = 0;
+	
+	size_t element_count = 0;
+	for (size_t i = 0; i < evaluator->case_count; ++i)
+	{
+		const test_case_t* test_case = &evaluator->cases[i];
+		n_context_t* context = worker->context;
+		int status = (parent) ? resume_prefix(context, &prefix_program, parent, &parent->states[i]) : n_context_run(context, &prefix_program, evaluator->elements + test_case->input, test_case->input_count);
+		if (status == N_ERROR_MEMORY)
+			return;
+		
+		// Store the test case's sequence, growing the element array if necessary
+		prefix_state_t* state = &prefix->states[i];
+		state->status = status;
+		state->steps = context->steps;
+		state->peak_count = context->peak_count;
+		state->count = 0;
+		state->offset = element_count;
+		if (status == N_SUCCESS)
+		{
+			size_t count;
+			const bignum_t* sequence = n_context_result(context, &count);
+			if (element_count + count > prefix->element_capacity)
+			{
+				size_t capacity = (prefix->element_capacity) ? prefix->element_capacity : 1024;
+				while (capacity < element_count + count)
+					capacity <<= 1;
+				bignum_t* elements = realloc(prefix->elements, capacity * sizeof(bignum_t));
+				if (!elements)
+					return;
+				prefix->elements = elements;
+				prefix->element_capacity = capacity;
+			}
+			memcpy(prefix->elements + element_count, sequence, count * sizeof(bignum_t));
+			state->count = count;
+			element_count += count;
+		}
+	}
+	
+	prefix->length = length;
+	++worker->prefix_count;
+}
+
+void evaluate_program(worker_t* worker, const n_program_t* program, fitness_t* fitness)
+{
+	const evaluator_t* evaluator = worker->evaluator;
+	const prefix_t* prefix = (worker->prefix_count) ? &worker->prefixes[worker->prefix_count - 1] : 0;
+	n_context_t* context = worker->context;
+	
+	for (size_t i = 0; i < evaluator->case_count; ++i)
+	{
+		const test_case_t* test_case = &evaluator->cases[i];
+		int status = (prefix) ? resume_prefix(context, program, prefix, &prefix->states[i]) : n_context_run(context, program, evaluator->elements + test_case->input, test_case->input_count);
+		if (status == N_ERROR_MEMORY)
+			worker->failed = 1;
+		
+		uint64_t distance = UINT64_MAX;
+		if (status == N_SUCCESS)
+		{
+			size_t count;
+			const bignum_t* output = n_context_result(context, &count);
+			distance = sequence_distance(output, count, evaluator->elements + test_case->expected, test_case->expected_count);
+			fitness->exact += (!distance);
+		}
+		else
+		{
+			++fitness->failed;
+		}
+		fitness->distance = (distance > UINT64_MAX - fitness->distance) ? UINT64_MAX : fitness->distance + distance;
+		fitness->steps += context->steps;
+	}
+}
+
+void* run_worker(void* data)
+{
+	worker_t* worker = data;
+	evaluator_t* evaluator = worker->evaluator;
+	
+	while (!worker->failed)
+	{
+		// Take the next chunk of distinct programs
+		#if defined(N_EVAL_THREADS)
+			pthread_mutex_lock(&evaluator->mutex);
+		#endif
+		size_t first = evaluator->next;
+		size_t last = (evaluator->program_count - first < CHUNK_SIZE) ? evaluator->program_count : first + CHUNK_SIZE;
+		evaluator->next = last;
+		#if defined(N_EVAL_THREADS)
+			pthread_mutex_unlock(&evaluator->mutex);
+		#endif
+		if (first == last)
+			break;
+		
+		worker->prefix_count = 0;
+		for (size_t i = first; i < last; ++i)
+		{
+			const n_program_t* program = evaluator->programs[i].program;
+			
+			// Keep the states of prefixes shared with the previous program, and of a longer one if it is shared too
+			size_t length = (i > first) ? common_prefix(evaluator->programs[i - 1].program, program) : 0;
+			while (worker->prefix_count && worker->prefixes[worker->prefix_count - 1].length > length)
+				--worker->prefix_count;
+			if (length && worker->prefix_count < MAX_PREFIXES && (!worker->prefix_count || worker->prefixes[worker->prefix_count - 1].length < length))
+				push_prefix(worker, program, length);
+			
+			evaluate_program(worker, program, &evaluator->fitness[i]);
+		}
+	}
+	
+	return 0;
+}
+
+void usage()
+{
+	printf("Usage: neval <programs file> <test cases file> [--max-steps <count>] [--max-elements <count>] [--threads <count>] [--output <file>]\n");
+}
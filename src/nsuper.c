@@ -0,0 +1,687 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_SUPER_SYSCONF
+	#include <unistd.h>
+#endif
+
+#if defined(N_SUPER_THREADS)
+	#include <pthread.h>
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "n.h"
+
+#define ERROR_ARGC 1
+#define ERROR_FOPEN 2
+#define ERROR_FREAD 3
+#define ERROR_MEMORY 4
+#define ERROR_DOMAIN 5
+
+/// Operators in the order in which candidates are enumerated.
+static const char operators[] = "+-<>#:|[]";
+
+/// Number of operators.
+#define OPERATOR_COUNT 9
+
+/// Number of test vectors against which every candidate is first run, before the rest are run on the candidates which pass them.
+#define QUICK_VECTORS 16
+
+/// Length of the candidate prefixes into which each length is divided between threads.
+#define ITEM_PREFIX_LENGTH 3
+
+/// Longest candidate which can be enumerated.
+#define MAX_LENGTH 32
+
+/// Candidate which is equivalent to the target.
+typedef struct result_t
+{
+	/// Operators of the candidate.
+	char source[MAX_LENGTH + 1];
+	
+	/// Total number of executed instructions over every test vector.
+	uint64_t steps;
+	
+} result_t;
+
+/// Search shared between threads.
+typedef struct search_t
+{
+	/// Input sequence elements of every test vector.
+	bignum_t* inputs;
+	
+	/// Expected output sequence elements of every test vector.
+	bignum_t* outputs;
+	
+	/// Index of the first input element of each test vector, followed by the total number of input elements.
+	size_t* input_offsets;
+	
+	/// Index of the first output element of each test vector, followed by the total number of output elements.
+	size_t* output_offsets;
+	
+	/// Number of test vectors.
+	size_t vector_count;
+	
+	/// Execution limits of each run.
+	n_limits_t limits;
+	
+	/// Length of the candidates currently enumerated.
+	size_t length;
+	
+	/// Number of operators fixed by each work item.
+	size_t item_length;
+	
+	/// Number of work items of the current length.
+	size_t item_count;
+	
+	/// Index of the next work item to be taken by a thread.
+	size_t next_item;
+	
+	/// Equivalent candidates found.
+	result_t* results;
+	
+	/// Number of equivalent candidates found.
+	size_t result_count;
+	
+	/// Capacity of the result arrays.
+	size_t result_capacity;
+	
+	/// Number of candidates run on at least one test vector.
+	uint64_t candidate_count;
+	
+	/// Time after which no more work items are taken, or zero for none.
+	double deadline;
+	
+	/// Non-zero if the search was stopped by its deadline, or storage could not be allocated.
+	int stopped;
+	
+	#if defined(N_SUPER_THREADS)
+		/// Mutex which guards the work items and results.
+		pthread_mutex_t mutex;
+	#endif
+	
+} search_t;
+
+/// Reads a file into a null-terminated buffer, which must be freed with `free()`.
+char* read_file(const char* path, size_t* size);
+
+/// Generates test vectors covering a domain of input sequences, and runs the target program on them to find their expected outputs. Inputs on which the target is stopped by a limit are left out of the domain.
+int generate_vectors(search_t* search, const n_program_t* target, size_t min_count, size_t max_count, bignum_t max_value, size_t max_vectors, uint64_t* target_steps);
+
+/// Returns whether a candidate contains operators which are provably equivalent to a shorter candidate, namely a shift immediately undone, an empty loop, or an unmatched loop end.
+int redundant(const char* candidate, size_t length);
+
+/// Runs a candidate on the test vectors in a range, and returns whether it matched every expected output, adding its executed instructions to a total.
+int run_vectors(const search_t* search, n_context_t* context, const n_program_t* program, size_t first, size_t last, uint64_t* steps);
+
+/// Enumerates the candidates of work items until none remain, recording those which are equivalent to the target.
+void* run_worker(void* search);
+
+/// Orders equivalent candidates by executed instructions, then alphabetically.
+int compare_results(const void* a, const void* b);
+
+/// Prints the usage string.
+void usage();
+
+int main(int argc, char* argv[])
+{
+	n_limits_t limits = {100000, 4096, 0.0};
+	size_t min_count = 1;
+	size_t max_count = 3;
+	bignum_t max_value = 8;
+	size_t max_vectors = 4096;
+	size_t max_length = 0;
+	double max_time = 0.0;
+	int all = 0;
+	size_t thread_count = 1;
+	FILE* output_file = stdout;
+	
+	#if defined(N_SUPER_SYSCONF) && defined(N_SUPER_THREADS)
+		long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+		if (processor_count > 0)
+			thread_count = (size_t)processor_count;
+	#endif
+	
+	if (argc < 2)
+	{
+		usage();
+		return ERROR_ARGC;
+	}
+	
+	// Read options
+	for (int i = 2; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--max-length") && i + 1 < argc)
+			max_length = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--min-count") && i + 1 < argc)
+			min_count = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--max-count") && i + 1 < argc)
+			max_count = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--max-value") && i + 1 < argc)
+			max_value = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--vectors") && i + 1 < argc)
+			max_vectors = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--max-steps") && i + 1 < argc)
+			limits.max_steps = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--max-time") && i + 1 < argc)
+			max_time = strtod(argv[++i], 0);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			thread_count = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--all"))
+			all = 1;
+		else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) && i + 1 < argc)
+		{
+			output_file = fopen(argv[++i], "wb");
+			if (!output_file)
+			{
+				printf("Failed to open output file \"%s\"\n", argv[i]);
+				return ERROR_FOPEN;
+			}
+		}
+		else
+		{
+			usage();
+			return ERROR_ARGC;
+		}
+	}
+	if (!thread_count)
+		thread_count = 1;
+	#if !defined(N_SUPER_THREADS)
+		thread_count = 1;
+	#endif
+	if (!max_vectors)
+		max_vectors = 1;
+	if (!min_count)
+		min_count = 1;
+	if (max_count < min_count)
+		max_count = min_count;
+	
+	// Read and compile target snippet
+	size_t source_size = 0;
+	char* source = read_file(argv[1], &source_size);
+	if (!source)
+	{
+		printf("Failed to read source file \"%s\"\n", argv[1]);
+		return ERROR_FREAD;
+	}
+	n_preprocess(&source);
+	size_t target_length = strlen(source);
+	n_program_t* target = n_program_compile(source, target_length);
+	if (!target)
+	{
+		printf("Failed to allocate memory\n");
+		free(source);
+		return ERROR_MEMORY;
+	}
+	
+	// Only search for candidates shorter than the target
+	if (!max_length || max_length >= target_length)
+		max_length = (target_length) ? target_length - 1 : 0;
+	if (max_length > MAX_LENGTH)
+		max_length = MAX_LENGTH;
+	
+	search_t search;
+	memset(&search, 0, sizeof(search));
+	search.limits = limits;
+	uint64_t target_steps = 0;
+	int error = generate_vectors(&search, target, min_count, max_count, max_value, max_vectors, &target_steps);
+	n_program_free(target);
+	if (!error && !search.vector_count)
+	{
+		printf("Target is stopped by a limit on every input of the domain\n");
+		error = ERROR_DOMAIN;
+	}
+	if (error)
+	{
+		if (error == ERROR_MEMORY)
+			printf("Failed to allocate memory\n");
+		free(source);
+		free(search.inputs);
+		free(search.outputs);
+		free(search.input_offsets);
+		free(search.output_offsets);
+		return error;
+	}
+	
+	fprintf(output_file, "target %s length %zu steps %" PRIu64 " vectors %zu\n", source, target_length, target_steps, search.vector_count);
+	fflush(output_file);
+	free(source);
+	
+	// Enumerate candidates in order of increasing length, stopping after the first length with equivalents unless all are requested
+	if (max_time > 0.0)
+		search.deadline = n_clock() + max_time;
+	#if defined(N_SUPER_THREADS)
+		pthread_mutex_init(&search.mutex, 0);
+	#endif
+	size_t length = 0;
+	size_t found_count = 0;
+	while (length < max_length && !search.stopped && (all || !found_count))
+	{
+		++length;
+		search.length = length;
+		search.item_length = (length < ITEM_PREFIX_LENGTH) ? length : ITEM_PREFIX_LENGTH;
+		search.item_count = 1;
+		for (size_t i = 0; i < search.item_length; ++i)
+			search.item_count *= OPERATOR_COUNT;
+		search.next_item = 0;
+		search.result_count = 0;
+		search.candidate_count = 0;
+		
+		#if defined(N_SUPER_THREADS)
+			pthread_t* threads = malloc(thread_count * sizeof(pthread_t));
+			size_t started_count = 0;
+			for (size_t i = 1; threads && i < thread_count; ++i)
+				if (!pthread_create(&threads[started_count], 0, run_worker, &search))
+					++started_count;
+			run_worker(&search);
+			for (size_t i = 0; i < started_count; ++i)
+				pthread_join(threads[i], 0);
+			free(threads);
+		#else
+			run_worker(&search);
+		#endif
+		
+		// Report equivalents, most efficient first
+		qsort(search.results, search.result_count, sizeof(result_t), compare_results);
+		for (size_t i = 0; i < search.result_count; ++i)
+			fprintf(output_file, "found %s length %zu steps %" PRIu64 "\n", search.results[i].source, length, search.results[i].steps);
+		found_count += search.result_count;
+		
+		fprintf(stderr, "length %zu: %" PRIu64 " candidates run, %zu equivalent\n", length, search.candidate_count, search.result_count);
+		fflush(output_file);
+	}
+	#if defined(N_SUPER_THREADS)
+		pthread_mutex_destroy(&search.mutex);
+	#endif
+	
+	if (search.stopped)
+		fprintf(output_file, "stopped during length %zu\n", length);
+	else
+		fprintf(output_file, "searched up to length %zu\n", length);
+	
+	if (output_file != stdout)
+		fclose(output_file);
+	free(search.inputs);
+	free(search.outputs);
+	free(search.input_offsets);
+	free(search.output_offsets);
+	free(search.results);
+	
+	return EXIT_SUCCESS;
+}
+
+char* read_file(const char* path, size_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	char* buffer = malloc(*size + 1);
+	if (buffer && fread(buffer, 1, *size, file) != *size)
+	{
+		free(buffer);
+		buffer = 0;
+	}
+	if (buffer)
+		buffer[*size] = '\0';
+	fclose(file);
+	
+	return buffer;
+}
+
+/// Advances a xorshift generator, returning its next value.
+static uint64_t next_random(uint64_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+int generate_vectors(search_t* search, const n_program_t* target, size_t min_count, size_t max_count, bignum_t max_value, size_t max_vectors, uint64_t* target_steps)
+{
+	// Enumerate the whole domain if it is small enough, otherwise sample it
+	size_t domain_size = 0;
+	int exhaustive = 1;
+	for (size_t count = min_count; count <= max_count && exhaustive; ++count)
+	{
+		size_t size = 1;
+		for (size_t i = 0; i < count && exhaustive; ++i)
+		{
+			if (max_value >= SIZE_MAX / size)
+				exhaustive = 0;
+			else
+				size *= (size_t)max_value + 1;
+		}
+		if (exhaustive && size <= max_vectors - domain_size)
+			domain_size += size;
+		else
+			exhaustive = 0;
+	}
+	size_t candidate_count = (exhaustive) ? domain_size : max_vectors;
+	
+	bignum_t* candidates = malloc((candidate_count * max_count + 1) * sizeof(bignum_t));
+	size_t* lengths = malloc((candidate_count + 1) * sizeof(size_t));
+	size_t* order = malloc((candidate_count + 1) * sizeof(size_t));
+	bignum_t* digits = calloc(max_count + 1, sizeof(bignum_t));
+	search->inputs = malloc((candidate_count * max_count + 1) * sizeof(bignum_t));
+	search->input_offsets = malloc((candidate_count + 1) * sizeof(size_t));
+	search->output_offsets = malloc((candidate_count + 1) * sizeof(size_t));
+	n_context_t* context = n_context_create();
+	int error = 0;
+	if (!candidates || !lengths || !order || !digits || !search->inputs || !search->input_offsets || !search->output_offsets || !context)
+		error = ERROR_MEMORY;
+	
+	// Generate inputs of up to `max_count` elements, counting through every sequence of each length, or drawing them from a seeded generator
+	uint64_t state = 0x9E3779B97F4A7C15;
+	size_t count = min_count;
+	for (size_t i = 0; !error && i < candidate_count; ++i)
+	{
+		bignum_t* input = candidates + i * max_count;
+		order[i] = i;
+		if (exhaustive)
+		{
+			memcpy(input, digits, count * sizeof(bignum_t));
+			lengths[i] = count;
+			
+			// Count in base `max_value + 1`, moving to the next length after the largest sequence
+			size_t j = 0;
+			while (j < count && digits[j] == max_value)
+				digits[j++] = 0;
+			if (j < count)
+				++digits[j];
+			else
+				++count;
+		}
+		else
+		{
+			lengths[i] = min_count + (size_t)(next_random(&state) % (max_count - min_count + 1));
+			for (size_t j = 0; j < lengths[i]; ++j)
+				input[j] = (max_value == UINT64_MAX) ? next_random(&state) : next_random(&state) % (max_value + 1);
+		}
+	}
+	free(digits);
+	
+	// Shuffle vectors so that those run first are varied
+	for (size_t i = candidate_count; !error && i > 1; --i)
+	{
+		size_t j = (size_t)(next_random(&state) % i);
+		size_t swap = order[i - 1];
+		order[i - 1] = order[j];
+		order[j] = swap;
+	}
+	
+	// Run the target on each input to find its expected output, leaving out inputs on which it is stopped by a limit
+	size_t output_capacity = 0;
+	size_t input_count = 0;
+	size_t output_count = 0;
+	*target_steps = 0;
+	if (!error)
+		context->limits = search->limits;
+	for (size_t i = 0; !error && i < candidate_count; ++i)
+	{
+		const bignum_t* input = candidates + order[i] * max_count;
+		size_t length = lengths[order[i]];
+		int status = n_context_run(context, target, input, length);
+		if (status == N_ERROR_MEMORY)
+			error = ERROR_MEMORY;
+		if (status != N_SUCCESS)
+			continue;
+		
+		size_t result_count;
+		const bignum_t* result = n_context_result(context, &result_count);
+		if (output_count + result_count > output_capacity)
+		{
+			size_t capacity = (output_capacity) ? output_capacity : 1024;
+			while (capacity < output_count + result_count)
+				capacity <<= 1;
+			bignum_t* outputs = realloc(search->outputs, capacity * sizeof(bignum_t));
+			if (!outputs)
+			{
+				error = ERROR_MEMORY;
+				break;
+			}
+			search->outputs = outputs;
+			output_capacity = capacity;
+		}
+		
+		search->input_offsets[search->vector_count] = input_count;
+		search->output_offsets[search->vector_count] = output_count;
+		memcpy(search->inputs + input_count, input, length * sizeof(bignum_t));
+		memcpy(search->outputs + output_count, result, result_count * sizeof(bignum_t));
+		input_count += length;
+		output_count += result_count;
+		*target_steps += context->steps;
+		++search->vector_count;
+	}
+	if (!error)
+	{
+		search->input_offsets[search->vector_count] = input_count;
+		search->output_offsets[search->vector_count] = output_count;
+	}
+	
+	n_context_free(context);
+	free(order);
+	free(lengths);
+	free(candidates);
+	
+	return error;
+}
+
+int redundant(const char* candidate, size_t length)
+{
+	size_t depth = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		char c = candidate[i];
+		if (c == '[')
+		{
+			++depth;
+		}
+		else if (c == ']')
+		{
+			if (!depth)
+				return 1;
+			--depth;
+		}
+		
+		if (i + 1 < length)
+		{
+			char next = candidate[i + 1];
+			if ((c == '<' && next == '>') || (c == '>' && next == '<') || (c == '[' && next == ']'))
+				return 1;
+		}
+	}
+	
+	return 0;
+}
+
+int run_vectors(const search_t* search, n_context_t* context, const n_program_t* program, size_t first, size_t last, uint64_t* steps)
+{
+	for (size_t i = first; i < last; ++i)
+	{
+		const bignum_t* input = search->inputs + search->input_offsets[i];
+		size_t input_count = search->input_offsets[i + 1] - search->input_offsets[i];
+		if (n_context_run(context, program, input, input_count) != N_SUCCESS)
+			return 0;
+		
+		size_t count;
+		const bignum_t* result = n_context_result(context, &count);
+		const bignum_t* expected = search->outputs + search->output_offsets[i];
+		if (count != search->output_offsets[i + 1] - search->output_offsets[i] || memcmp(result, expected, count * sizeof(bignum_t)))
+			return 0;
+		*steps += context->steps;
+	}
+	
+	return 1;
+}
+
+/// Stops a search after storage could not be allocated.
+static void stop_search(search_t* search)
+{
+	#if defined(N_SUPER_THREADS)
+		pthread_mutex_lock(&search->mutex);
+	#endif
+	search->stopped = 1;
+	#if defined(N_SUPER_THREADS)
+		pthread_mutex_unlock(&search->mutex);
+	#endif
+}
+
+void* run_worker(void* data)
+{
+	search_t* search = data;
+	n_context_t* context = n_context_create();
+	if (!context)
+	{
+		stop_search(search);
+		return 0;
+	}
+	context->limits = search->limits;
+	
+	size_t length = search->length;
+	size_t item_length = search->item_length;
+	size_t quick_count = (search->vector_count < QUICK_VECTORS) ? search->vector_count : QUICK_VECTORS;
+	size_t digits[MAX_LENGTH];
+	char candidate[MAX_LENGTH + 1];
+	candidate[length] = '\0';
+	uint64_t candidate_count = 0;
+	
+	for (;;)
+	{
+		// Take the next work item, unless the search has been stopped
+		#if defined(N_SUPER_THREADS)
+			pthread_mutex_lock(&search->mutex);
+		#endif
+		if (!search->stopped && search->deadline > 0.0 && n_clock() > search->deadline)
+			search->stopped = 1;
+		size_t item = search->next_item;
+		int done = search->stopped || item >= search->item_count;
+		if (!done)
+			++search->next_item;
+		#if defined(N_SUPER_THREADS)
+			pthread_mutex_unlock(&search->mutex);
+		#endif
+		if (done)
+			break;
+		
+		// Fix the operators of the item's prefix, then count through every suffix
+		for (size_t i = 0; i < item_length; ++i)
+		{
+			digits[item_length - 1 - i] = item % OPERATOR_COUNT;
+			item /= OPERATOR_COUNT;
+		}
+		for (size_t i = item_length; i < length; ++i)
+			digits[i] = 0;
+		
+		int more = 1;
+		while (more)
+		{
+			for (size_t i = 0; i < length; ++i)
+				candidate[i] = operators[digits[i]];
+			
+			if (!redundant(candidate, length))
+			{
+				n_program_t* program = n_program_compile(candidate, length);
+				if (!program)
+				{
+					stop_search(search);
+					break;
+				}
+				
+				// Filter on a few vectors first, since almost every candidate fails one of them
+				uint64_t steps = 0;
+				int equivalent = run_vectors(search, context, program, 0, quick_count, &steps) && run_vectors(search, context, program, quick_count, search->vector_count, &steps);
+				n_program_free(program);
+				++candidate_count;
+				
+				if (equivalent)
+				{
+					#if defined(N_SUPER_THREADS)
+						pthread_mutex_lock(&search->mutex);
+					#endif
+					if (search->result_count == search->result_capacity)
+					{
+						size_t capacity = (search->result_capacity) ? search->result_capacity << 1 : 16;
+						result_t* results = realloc(search->results, capacity * sizeof(result_t));
+						if (results)
+						{
+							search->results = results;
+							search->result_capacity = capacity;
+						}
+					}
+					if (search->result_count < search->result_capacity)
+					{
+						memcpy(search->results[search->result_count].source, candidate, length + 1);
+						search->results[search->result_count].steps = steps;
+						++search->result_count;
+					}
+					else
+					{
+						search->stopped = 1;
+					}
+					#if defined(N_SUPER_THREADS)
+						pthread_mutex_unlock(&search->mutex);
+					#endif
+				}
+			}
+			
+			// Advance the suffix to the next candidate
+			size_t i = length;
+			while (i > item_length && digits[i - 1] == OPERATOR_COUNT - 1)
+				digits[--i] = 0;
+			if (i > item_length)
+				++digits[i - 1];
+			else
+				more = 0;
+		}
+	}
+	
+	#if defined(N_SUPER_THREADS)
+		pthread_mutex_lock(&search->mutex);
+	#endif
+	search->candidate_count += candidate_count;
+	#if defined(N_SUPER_THREADS)
+		pthread_mutex_unlock(&search->mutex);
+	#endif
+	n_context_free(context);
+	
+	return 0;
+}
+
+int compare_results(const void* a, const void* b)
+{
+	const result_t* first = a;
+	const result_t* second = b;
+	if (first->steps != second->steps)
+		return (first->steps < second->steps) ? -1 : 1;
+	return strcmp(first->source, second->source);
+}
+
+void usage()
+{
+	printf("Usage: nsuper <source file> [--max-length <length>] [--min-count <count>] [--max-count <count>] [--max-value <value>] [--vectors <count>] [--max-steps <steps>] [--max-time <seconds>] [--threads <count>] [--all] [--output <file>]\n");
+}
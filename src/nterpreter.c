@@ -18,188 +18,1057 @@
  */
 
 #include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "batch.h"
+#include "cache.h"
+#include "clock.h"
+#include "context.h"
+#include "estimate.h"
+#include "memo.h"
 #include "preprocess.h"
-#include "sequence.h"
+#include "profile.h"
+#include "program.h"
+#include "sample.h"
+#include "snapshot.h"
+#include "specialize.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <unistd.h>
+	#define N_CHECKPOINT_ALARM
+#endif
 
 #define ERROR_ARGC 1
 #define ERROR_FOPEN 2
 #define ERROR_FREAD 3
+#define ERROR_MEMORY 4
+#define ERROR_STEP_LIMIT 5
+#define ERROR_ELEMENT_LIMIT 6
+#define ERROR_TIME_LIMIT 7
+#define ERROR_INTERRUPTED 8
+#define ERROR_SNAPSHOT 9
 
 #define MODE_NUMBERS 0
 #define MODE_BYTES 1
+#define MODE_WORDS 2
+
+/// Number of batch file lines which are run at a time.
+#define BATCH_CHUNK 4096
+
+/// Set by signal handlers to stop the running program at its next check and write a checkpoint.
+static volatile sig_atomic_t checkpoint_requested = 0;
+
+/// Set by signal handlers to exit once the checkpoint has been written.
+static volatile sig_atomic_t checkpoint_exit = 0;
+
+/// Interval between periodic checkpoints, in seconds, or zero for none.
+static unsigned checkpoint_interval = 0;
+
+/// Number of bytes into which each element is unpacked when writing words.
+static size_t output_word_size = 8;
+
+/// Options read from the command line.
+typedef struct options_t
+{
+	/// Format of input sequence elements.
+	int input_mode;
+	
+	/// Format of the output sequence.
+	int output_mode;
+	
+	/// Path of the output file, or null for standard output.
+	const char* output_path;
+	
+	/// Directory of compiled programs, or null for none.
+	const char* cache_directory;
+	
+	/// Directory of memoized output sequences, or null for none.
+	const char* memo_directory;
+	
+	/// Maximum total size of memoized output sequences, in bytes.
+	uint64_t memo_size;
+	
+	/// Minimum run time of memoized output sequences, in seconds.
+	double memo_min_time;
+	
+	/// Non-zero if memoization statistics are reported.
+	int memo_stats;
+	
+	/// Execution limits of the program.
+	n_limits_t limits;
+	
+	/// Non-zero if cost bounds are estimated instead of running the program.
+	int estimate;
+	
+	/// Input sequence length of the estimate, or null to use that of the input sequence.
+	const char* estimate_count;
+	
+	/// Maximum input element value of the estimate, or null to use that of the input sequence.
+	const char* estimate_max;
+	
+	/// Non-zero if a residual program is written instead of running the program.
+	int specialize;
+	
+	/// Input sequence length of the specialization, or null if unknown.
+	const char* known_count;
+	
+	/// Path of the profile, or null for none.
+	const char* profile_path;
+	
+	/// Path of the sampled hot-spot report, or null for none.
+	const char* sample_path;
+	
+	/// Interval between samples, in seconds.
+	double sample_interval;
+	
+	/// Path of the checkpoint to write, or null for none.
+	const char* checkpoint_path;
+	
+	/// Path of the snapshot to resume, or null for none.
+	const char* resume_path;
+	
+	/// Path of the batch file, or null for none.
+	const char* batch_path;
+	
+	/// Indices into argv of input sequence elements.
+	int* element_args;
+	
+	/// Number of input sequence elements in argv.
+	int element_arg_count;
+	
+	/// Indices into argv of the source files of later pipeline stages.
+	int* stage_args;
+	
+	/// Number of later pipeline stages.
+	int stage_arg_count;
+	
+	/// Indices into argv of known input elements.
+	int* known_args;
+	
+	/// Number of known input elements in argv.
+	int known_arg_count;
+	
+} options_t;
+
+/// Reads the options which follow the source file, and returns zero or an error code. The options must be freed with `free_options()`, even on failure.
+int parse_options(int argc, char* argv[], options_t* options);
+
+/// Deallocates the argument indices of options.
+void free_options(options_t* options);
+
+/// Runs a pipeline on an input sequence, or resumes its program from a snapshot, and writes the output sequence and profiles. Returns zero or an error code.
+int run_program(n_program_t** programs, size_t program_count, const bignum_t* input, size_t input_count, const options_t* options, n_profile_t* profile, n_sampler_t* sampler, const char* source, size_t source_size, FILE* output_file);
+
+/// Writes the estimated cost bounds and growth classes of a program.
+void run_estimate(const n_program_t* program, const bignum_t* input, size_t input_count, const options_t* options, FILE* output_file);
+
+/// Writes a residual program specialized to the known elements of the input, and returns zero or an error code.
+int run_specialize(const n_program_t* program, char* argv[], const options_t* options, FILE* output_file);
+
+/// Reads a source or batch file into a null-terminated buffer, which must be freed with `free()`, and returns zero or an error code.
+int read_file(const char* path, const char* kind, char** buffer, size_t* size);
+
+/// Reads a source file into a null-terminated buffer, which must be freed with `free()`, and returns zero or an error code. If the full source is not needed, only its operators are read, from a mapping of the file where possible.
+int read_source(const char* path, int operators_only, char** buffer, size_t* size);
+
+/// Runs a pipeline on each line of a batch file, writing one output sequence per line, and returns zero or the error code of the first failed line.
+int run_batch(const char* path, n_program_t** programs, size_t program_count, int input_mode, int output_mode, n_limits_t limits, FILE* output_file);
+
+/// Deallocates the programs of a pipeline and the array which holds them.
+void free_programs(n_program_t** programs, size_t program_count);
+
+/// Handles signals which request a checkpoint.
+void request_checkpoint(int signal_number);
+
+/// Installs signal handlers which request checkpoints, and starts the periodic checkpoint timer.
+void start_checkpoints(void);
 
 /// Writes a sequence to a file stream in text mode, with space-delimeted numbers.
-void write_sequence_numbers(FILE* file, element_t* head);
+void write_sequence_numbers(FILE* file, const bignum_t* elements, size_t count);
 
 /// Writes a sequence to a file stream in binary mode, with element values translated to bytes.
-void write_sequence_bytes(FILE* file, element_t* head);
+void write_sequence_bytes(FILE* file, const bignum_t* elements, size_t count);
+
+/// Writes a sequence to a file stream in binary mode, with each element unpacked into little-endian bytes, except the last, which is the number of bytes of the last word to write.
+void write_sequence_words(FILE* file, const bignum_t* elements, size_t count, size_t word_size);
+
+/// Writes an estimated upper bound to a file stream as a key-value line.
+void write_bound(FILE* file, const char* key, uint64_t bound);
+
+/// Writes an estimated growth class to a file stream as a key-value line.
+void write_growth(FILE* file, const char* key, int degree);
+
+/// Writes a profile as JSON to a file, or to standard error if the path is "-".
+void write_profile(const char* path, const n_profile_t* profile, const n_program_t* program, const char* source, size_t source_size);
+
+/// Writes a sampled hot-spot report to a file, or to standard error if the path is "-".
+void write_samples(const char* path, const n_sampler_t* sampler, const n_program_t* program, const char* source, size_t source_size);
 
 /// Prints the usage string.
 void usage();
 
 int main(int argc, char* argv[])
 {
-	int input_mode = MODE_NUMBERS;
-	int output_mode = MODE_NUMBERS;
-	int first_element_arg = -1;
-	
-	FILE* output_file = stdout;
-	
 	if (argc < 2)
 	{
 		usage();
 		return ERROR_ARGC;
 	}
 	
-	// Open source file
-	FILE* source_file = fopen(argv[1], "rb");
-	if (!source_file)
+	// Resources are released together at the end, so each step only needs to set the error code
+	FILE* output_file = stdout;
+	char* source = 0;
+	size_t source_size = 0;
+	bignum_t* input = 0;
+	size_t input_count = 0;
+	n_program_t** programs = 0;
+	size_t program_count = 0;
+	n_program_t* program = 0;
+	n_profile_t* profile = 0;
+	n_sampler_t* sampler = 0;
+	
+	// Read options
+	options_t options;
+	int error = parse_options(argc, argv, &options);
+	if (error)
+		goto cleanup;
+	
+	// Open output file
+	if (options.output_path)
 	{
-		printf("Failed to open source file \"%s\"\n", argv[1]);
-		return ERROR_FOPEN;
+		output_file = fopen(options.output_path, "wb");
+		if (!output_file)
+		{
+			printf("Failed to open output file \"%s\"\n", options.output_path);
+			error = ERROR_FOPEN;
+			goto cleanup;
+		}
+	}
+	
+	// Read source file, keeping the full source only where it is hashed by the cache or used to locate instructions in profiles
+	error = read_source(argv[1], !options.cache_directory && !options.profile_path && !options.sample_path, &source, &source_size);
+	if (error)
+		goto cleanup;
+	
+	// Count sequence elements in argv
+	size_t input_capacity = 0;
+	for (int i = 0; i < options.element_arg_count; ++i)
+		input_capacity += (options.input_mode == MODE_NUMBERS) ? 1 : strlen(argv[options.element_args[i]]);
+	
+	// Read sequence elements from argv
+	input = malloc((input_capacity + 1) * sizeof(bignum_t));
+	if (!input)
+	{
+		printf("Failed to allocate memory\n");
+		error = ERROR_MEMORY;
+		goto cleanup;
+	}
+	for (int i = 0; i < options.element_arg_count; ++i)
+	{
+		const char* arg = argv[options.element_args[i]];
+		if (options.input_mode == MODE_NUMBERS)
+		{
+			bignum_t value = 0;
+			if (sscanf(arg, "%" SCNu64, &value) == 1)
+				input[input_count++] = value;
+		}
+		else
+		{
+			for (size_t j = 0; arg[j]; ++j)
+				input[input_count++] = (bignum_t)arg[j];
+		}
 	}
 	
-	// Allocate source buffer
-	fseek(source_file, 0, SEEK_END);
-	size_t source_size = ftell(source_file);
-	rewind(source_file);
-	char* source = malloc(source_size + 1);
-	source[source_size] = '\0';
+	// Compile program, or load it from the cache. The source buffer is kept to locate instructions in profiles.
+	program = (options.cache_directory) ? n_program_compile_cached(options.cache_directory, source, source_size) : n_program_compile(source, source_size);
 	
-	// Read source file into source buffer then close source file
-	size_t read_bytes = fread(source, 1, source_size, source_file);
-	fclose(source_file);
+	// Compile the programs of later pipeline stages, fusing each into the previous program where possible
+	programs = malloc((options.stage_arg_count + 1) * sizeof(n_program_t*));
+	if (programs && program)
+		programs[program_count++] = program;
+	else
+		n_program_free(program);
+	for (int i = 0; i < options.stage_arg_count && program_count; ++i)
+	{
+		char* stage_source = 0;
+		size_t stage_size = 0;
+		error = read_source(argv[options.stage_args[i]], !options.cache_directory, &stage_source, &stage_size);
+		if (error)
+			goto cleanup;
+		n_program_t* stage = (options.cache_directory) ? n_program_compile_cached(options.cache_directory, stage_source, stage_size) : n_program_compile(stage_source, stage_size);
+		free(stage_source);
+		if (!stage)
+		{
+			printf("Failed to allocate memory\n");
+			error = ERROR_MEMORY;
+			goto cleanup;
+		}
+		
+		n_program_t* fused = n_program_fuse(programs[program_count - 1], stage);
+		if (fused)
+		{
+			n_program_free(programs[program_count - 1]);
+			n_program_free(stage);
+			programs[program_count - 1] = fused;
+		}
+		else
+		{
+			programs[program_count++] = stage;
+		}
+	}
+	program = (program_count) ? programs[0] : 0;
 	
-	if (read_bytes != source_size)
+	// Profiles locate instructions in the source of a single program, and the other modes require the pipeline to have fused into one program
+	int single_mode = (options.estimate || options.specialize || options.memo_directory || options.checkpoint_path || options.resume_path);
+	int profiling = (options.profile_path || options.sample_path);
+	if (program && ((options.stage_arg_count && profiling) || (program_count > 1 && single_mode)))
+	{
+		printf("Options for profiling, estimating, specializing, memoizing and checkpointing require a single program\n");
+		error = ERROR_ARGC;
+		goto cleanup;
+	}
+	if (program && options.batch_path && (profiling || single_mode))
+	{
+		printf("Options for profiling, estimating, specializing, memoizing and checkpointing cannot be used with a batch\n");
+		error = ERROR_ARGC;
+		goto cleanup;
+	}
+	if (!profiling)
 	{
-		printf("Failed to read source file \"%s\"\n", argv[1]);
 		free(source);
-		return ERROR_FREAD;
+		source = 0;
+	}
+	
+	// Create profile and sampler
+	profile = (program && options.profile_path) ? n_profile_create(program) : 0;
+	sampler = (program && options.sample_path) ? n_sampler_create(program, options.sample_interval) : 0;
+	if (!program || (options.profile_path && !profile) || (options.sample_path && !sampler))
+	{
+		printf("Failed to allocate memory\n");
+		error = ERROR_MEMORY;
+		goto cleanup;
+	}
+	
+	// Run the pipeline on each line of a batch file, estimate cost bounds, or write a residual program instead of running the pipeline on the input sequence
+	if (options.batch_path)
+		error = run_batch(options.batch_path, programs, program_count, options.input_mode, options.output_mode, options.limits, output_file);
+	else if (options.estimate)
+		run_estimate(program, input, input_count, &options, output_file);
+	else if (options.specialize)
+		error = run_specialize(program, argv, &options, output_file);
+	else
+		error = run_program(programs, program_count, input, input_count, &options, profile, sampler, source, source_size, output_file);
+
+cleanup:
+	// Close output file, and free profiles, programs, source, input sequence and options
+	if (output_file && output_file != stdout)
+		fclose(output_file);
+	n_profile_free(profile);
+	n_sampler_free(sampler);
+	free_programs(programs, program_count);
+	free(source);
+	free(input);
+	free_options(&options);
+	
+	return error;
+}
+
+int parse_options(int argc, char* argv[], options_t* options)
+{
+	options->input_mode = MODE_NUMBERS;
+	options->output_mode = MODE_NUMBERS;
+	options->output_path = 0;
+	options->cache_directory = 0;
+	options->memo_directory = 0;
+	options->memo_size = 256 * 1024 * 1024;
+	options->memo_min_time = 0.0;
+	options->memo_stats = 0;
+	options->limits = (n_limits_t){0, 0, 0.0};
+	options->estimate = 0;
+	options->estimate_count = 0;
+	options->estimate_max = 0;
+	options->specialize = 0;
+	options->known_count = 0;
+	options->profile_path = 0;
+	options->sample_path = 0;
+	options->sample_interval = 0.001;
+	options->checkpoint_path = 0;
+	options->resume_path = 0;
+	options->batch_path = 0;
+	options->element_args = malloc(argc * sizeof(int));
+	options->element_arg_count = 0;
+	options->stage_args = malloc(argc * sizeof(int));
+	options->stage_arg_count = 0;
+	options->known_args = malloc(argc * sizeof(int));
+	options->known_arg_count = 0;
+	if (!options->element_args || !options->stage_args || !options->known_args)
+	{
+		printf("Failed to allocate memory\n");
+		return ERROR_MEMORY;
 	}
 	
-	// Read options
 	for (int i = 2; i < argc; ++i)
 	{
 		if (!strcmp(argv[i], "-ob") || !strcmp(argv[i], "--output-bytes"))
-			output_mode = MODE_BYTES;
+			options->output_mode = MODE_BYTES;
 		else if (!strcmp(argv[i], "-on") || !strcmp(argv[i], "--output-numbers"))
-			output_mode = MODE_NUMBERS;
+			options->output_mode = MODE_NUMBERS;
+		else if (!strcmp(argv[i], "-ow") || !strcmp(argv[i], "--output-words"))
+		{
+			if (++i < argc)
+			{
+				options->output_mode = MODE_WORDS;
+				output_word_size = strtoull(argv[i], 0, 10);
+				if (!output_word_size || output_word_size > sizeof(bignum_t))
+					output_word_size = sizeof(bignum_t);
+			}
+		}
 		else if (!strcmp(argv[i], "-ib") || !strcmp(argv[i], "--input-bytes"))
-			input_mode = MODE_BYTES;
+			options->input_mode = MODE_BYTES;
 		else if (!strcmp(argv[i], "-in") || !strcmp(argv[i], "--input-numbers"))
-			input_mode = MODE_NUMBERS;
+			options->input_mode = MODE_NUMBERS;
 		else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output"))
 		{
 			if (++i < argc)
-			{
-				// Open output file
-				output_file = fopen(argv[i], "wb");
-				if (!output_file)
-				{
-					printf("Failed to open output file \"%s\"\n", argv[i]);
-					free(source);
-					return ERROR_FOPEN;
-				}
-			}
+				options->output_path = argv[i];
+		}
+		else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--then"))
+		{
+			if (++i < argc)
+				options->stage_args[options->stage_arg_count++] = i;
+		}
+		else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--batch"))
+		{
+			if (++i < argc)
+				options->batch_path = argv[i];
+		}
+		else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--cache"))
+		{
+			if (++i < argc)
+				options->cache_directory = argv[i];
+		}
+		else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--memo"))
+		{
+			if (++i < argc)
+				options->memo_directory = argv[i];
+		}
+		else if (!strcmp(argv[i], "--memo-size"))
+		{
+			if (++i < argc)
+				options->memo_size = strtoull(argv[i], 0, 10);
+		}
+		else if (!strcmp(argv[i], "--memo-min-time"))
+		{
+			if (++i < argc)
+				options->memo_min_time = strtod(argv[i], 0);
+		}
+		else if (!strcmp(argv[i], "--memo-stats"))
+		{
+			options->memo_stats = 1;
+		}
+		else if (!strcmp(argv[i], "--max-steps"))
+		{
+			if (++i < argc)
+				options->limits.max_steps = strtoull(argv[i], 0, 10);
+		}
+		else if (!strcmp(argv[i], "--max-elements"))
+		{
+			if (++i < argc)
+				options->limits.max_elements = strtoull(argv[i], 0, 10);
+		}
+		else if (!strcmp(argv[i], "--max-time"))
+		{
+			if (++i < argc)
+				options->limits.max_time = strtod(argv[i], 0);
+		}
+		else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--profile"))
+		{
+			if (++i < argc)
+				options->profile_path = argv[i];
+		}
+		else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--sample"))
+		{
+			if (++i < argc)
+				options->sample_path = argv[i];
+		}
+		else if (!strcmp(argv[i], "--sample-interval"))
+		{
+			if (++i < argc)
+				options->sample_interval = strtod(argv[i], 0) * 1e-3;
+		}
+		else if (!strcmp(argv[i], "--checkpoint"))
+		{
+			if (++i < argc)
+				options->checkpoint_path = argv[i];
+		}
+		else if (!strcmp(argv[i], "--checkpoint-interval"))
+		{
+			if (++i < argc)
+				checkpoint_interval = (unsigned)strtoul(argv[i], 0, 10);
+		}
+		else if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--resume"))
+		{
+			if (++i < argc)
+				options->resume_path = argv[i];
+		}
+		else if (!strcmp(argv[i], "-e") || !strcmp(argv[i], "--estimate"))
+		{
+			options->estimate = 1;
+		}
+		else if (!strcmp(argv[i], "--input-count"))
+		{
+			if (++i < argc)
+				options->estimate_count = argv[i];
+		}
+		else if (!strcmp(argv[i], "--input-max"))
+		{
+			if (++i < argc)
+				options->estimate_max = argv[i];
+		}
+		else if (!strcmp(argv[i], "-S") || !strcmp(argv[i], "--specialize"))
+		{
+			options->specialize = 1;
 		}
-		else if (first_element_arg < 0)
+		else if (!strcmp(argv[i], "--known"))
 		{
-			first_element_arg = i;
+			if (++i < argc)
+				options->known_args[options->known_arg_count++] = i;
+		}
+		else if (!strcmp(argv[i], "--known-count"))
+		{
+			if (++i < argc)
+				options->known_count = argv[i];
+		}
+		else
+		{
+			// Arguments which are not options or option values are sequence elements
+			options->element_args[options->element_arg_count++] = i;
 		}
 	}
 	
-	// Read sequence elements from argv
-	element_t* head = 0;
-	if (first_element_arg > 0)
+	return 0;
+}
+
+void free_options(options_t* options)
+{
+	free(options->element_args);
+	free(options->stage_args);
+	free(options->known_args);
+}
+
+int run_program(n_program_t** programs, size_t program_count, const bignum_t* input, size_t input_count, const options_t* options, n_profile_t* profile, n_sampler_t* sampler, const char* source, size_t source_size, FILE* output_file)
+{
+	n_program_t* program = programs[0];
+	int error = EXIT_SUCCESS;
+	
+	// Look up memoized output sequence, unless profiling requires the program to run or the input is a snapshot
+	n_memo_t* memo = (options->memo_directory && !profile && !sampler && !options->resume_path) ? n_memo_open(options->memo_directory, options->memo_size, options->memo_min_time) : 0;
+	n_memo_entry_t memo_entry = {0, 0, 0, 0};
+	uint64_t program_hash = 0;
+	int memo_hit = 0;
+	if (memo)
+	{
+		program_hash = n_program_hash(program);
+		memo_hit = n_memo_lookup(memo, program_hash, input, input_count, &options->limits, &memo_entry);
+	}
+	
+	const bignum_t* output = memo_entry.output;
+	size_t output_count = memo_entry.output_count;
+	n_context_t* context = 0;
+	if (!memo_hit)
 	{
-		for (int i = argc - 1; i >= first_element_arg; --i)
+		// Interpret program, or resume it from a snapshot. An empty initial sequence is replaced by the zero singleton.
+		double start_time = n_clock();
+		context = n_context_create();
+		int status = (context) ? N_SUCCESS : N_ERROR_MEMORY;
+		if (context)
 		{
-			if (input_mode == MODE_NUMBERS)
+			context->limits = options->limits;
+			context->profile = profile;
+			context->sampler = sampler;
+			if (options->checkpoint_path)
+			{
+				context->interrupt = &checkpoint_requested;
+				start_checkpoints();
+			}
+			if (sampler && n_sampler_start(sampler))
+				fprintf(stderr, "Sampling is not supported on this platform\n");
+			
+			if (options->resume_path)
 			{
-				bignum_t value = 0;
-				if (sscanf(argv[i], "%" SCNu64, &value) == 1)
-					head = append_sequence(head, value);
+				status = n_context_load(context, program, options->resume_path);
+				if (status == N_SUCCESS)
+					status = n_context_resume(context, program);
 			}
 			else
 			{
-				for (int j = strlen(argv[i]) - 1; j >= 0; --j)
-					head = append_sequence(head, (bignum_t)argv[i][j]);
+				status = n_context_run(context, program, input, input_count);
+				for (size_t i = 1; i < program_count && status == N_SUCCESS; ++i)
+					status = n_context_chain(context, programs[i]);
+			}
+			
+			// Write checkpoints when interrupted, then continue unless asked to exit. Programs stopped by a limit are also checkpointed, so they can be resumed with a higher limit.
+			while (options->checkpoint_path && status != N_SUCCESS && status != N_ERROR_MEMORY && status != N_ERROR_SNAPSHOT)
+			{
+				checkpoint_requested = 0;
+				if (n_context_save(context, program, options->checkpoint_path))
+					fprintf(stderr, "Failed to write checkpoint \"%s\"\n", options->checkpoint_path);
+				if (status != N_INTERRUPTED || checkpoint_exit)
+					break;
+				
+				#if defined(N_CHECKPOINT_ALARM)
+					if (checkpoint_interval)
+						alarm(checkpoint_interval);
+				#endif
+				status = n_context_resume(context, program);
+			}
+			
+			n_sampler_stop(sampler);
+		}
+		
+		// Write profiles, including those of a program stopped by a limit
+		if (profile && status != N_ERROR_MEMORY)
+			write_profile(options->profile_path, profile, program, source, source_size);
+		if (sampler && status != N_ERROR_MEMORY)
+			write_samples(options->sample_path, sampler, program, source, source_size);
+		
+		if (status != N_SUCCESS)
+		{
+			error = ERROR_MEMORY;
+			if (status == N_ERROR_MEMORY)
+			{
+				printf("Failed to allocate memory\n");
+			}
+			else if (status == N_ERROR_SNAPSHOT)
+			{
+				printf("Failed to load snapshot \"%s\" of this program\n", options->resume_path);
+				error = ERROR_SNAPSHOT;
+			}
+			else if (status == N_INTERRUPTED)
+			{
+				fprintf(stderr, "Program interrupted after %" PRIu64 " instructions, with %zu elements (peak %zu)\n", context->steps, context->count, context->peak_count);
+				error = ERROR_INTERRUPTED;
+			}
+			else
+			{
+				// Report statistics of the stopped program
+				const char* limit = "time";
+				error = ERROR_TIME_LIMIT;
+				if (status == N_ERROR_STEP_LIMIT)
+				{
+					limit = "step";
+					error = ERROR_STEP_LIMIT;
+				}
+				else if (status == N_ERROR_ELEMENT_LIMIT)
+				{
+					limit = "element";
+					error = ERROR_ELEMENT_LIMIT;
+				}
+				fprintf(stderr, "Program exceeded %s limit after %" PRIu64 " instructions, %.3f seconds, with %zu elements (peak %zu)\n", limit, context->steps, n_clock() - start_time, context->count, context->peak_count);
 			}
+			goto cleanup;
 		}
+		output = n_context_result(context, &output_count);
+		
+		// Memoize output sequence
+		if (memo)
+			n_memo_store(memo, program_hash, input, input_count, output, output_count, context->steps, context->peak_count, n_clock() - start_time);
 	}
 	
-	// Create zero singleton if no initial sequence was given
-	if (!head)
-		head = append_sequence(0, 0);
+	// Write sequence to file stream
+	if (options->output_mode == MODE_BYTES)
+		write_sequence_bytes(output_file, output, output_count);
+	else if (options->output_mode == MODE_WORDS)
+		write_sequence_words(output_file, output, output_count, output_word_size);
+	else
+		write_sequence_numbers(output_file, output, output_count);
 	
-	// Preprocess source code
-	n_preprocess(&source);
+	// Report memoization statistics
+	if (memo && options->memo_stats)
+	{
+		n_memo_stats_t stats;
+		n_memo_stats(memo, &stats);
+		fprintf(stderr, "memo: %s, hits %" PRIu64 ", misses %" PRIu64 ", stores %" PRIu64 ", skips %" PRIu64 "\n", (memo_hit) ? "hit" : "miss", stats.hits, stats.misses, stats.stores, stats.skips);
+	}
+
+cleanup:
+	// Free memoized result and context
+	n_memo_release(&memo_entry);
+	n_memo_close(memo);
+	n_context_free(context);
 	
-	// Interpret program
-	n_interpret(source, &head);
+	return error;
+}
+
+void run_estimate(const n_program_t* program, const bignum_t* input, size_t input_count, const options_t* options, FILE* output_file)
+{
+	bignum_t input_max = 0;
+	for (size_t i = 0; i < input_count; ++i)
+		if (input[i] > input_max)
+			input_max = input[i];
+	size_t count = (options->estimate_count) ? (size_t)strtoull(options->estimate_count, 0, 10) : input_count;
+	if (options->estimate_max)
+		input_max = strtoull(options->estimate_max, 0, 10);
 	
-	// Write sequence to file stream
-	if (output_mode == MODE_BYTES)
-		write_sequence_bytes(output_file, head);
+	n_estimate_t bounds;
+	int steps_degree, elements_degree;
+	n_program_estimate(program, count, input_max, &bounds);
+	n_program_growth(program, &steps_degree, &elements_degree);
+	
+	write_bound(output_file, "steps", bounds.max_steps);
+	write_bound(output_file, "elements", bounds.max_elements);
+	write_bound(output_file, "value", bounds.max_value);
+	write_growth(output_file, "steps_growth", steps_degree);
+	write_growth(output_file, "elements_growth", elements_degree);
+}
+
+int run_specialize(const n_program_t* program, char* argv[], const options_t* options, FILE* output_file)
+{
+	n_known_input_t known = {(options->known_count) ? (size_t)strtoull(options->known_count, 0, 10) : N_UNKNOWN_COUNT, 0, 0, 0};
+	size_t* positions = malloc((options->known_arg_count + 1) * sizeof(size_t));
+	bignum_t* values = malloc((options->known_arg_count + 1) * sizeof(bignum_t));
+	n_constant_table_t* table = n_constant_table_create();
+	char* residual = 0;
+	size_t residual_length = 0;
+	if (positions && values && table)
+	{
+		// Known elements are given as <position>=<value>
+		size_t count = 0;
+		for (int i = 0; i < options->known_arg_count; ++i)
+			if (sscanf(argv[options->known_args[i]], "%zu=%" SCNu64, &positions[count], &values[count]) == 2)
+				++count;
+		known.positions = positions;
+		known.values = values;
+		known.known_count = n_known_input_sort(positions, values, count);
+		residual = n_program_specialize(program, &known, table, options->limits, &residual_length);
+	}
+	
+	int error = EXIT_SUCCESS;
+	if (residual)
+	{
+		fwrite(residual, 1, residual_length, output_file);
+		fputc('\n', output_file);
+	}
 	else
-		write_sequence_numbers(output_file, head);
+	{
+		printf("Failed to allocate memory\n");
+		error = ERROR_MEMORY;
+	}
 	
-	// Close output file
-	if (output_file != stdout)
-		fclose(output_file);
+	free(residual);
+	n_constant_table_free(table);
+	free(values);
+	free(positions);
 	
-	// Free source buffer
-	free(source);
+	return error;
+}
+
+int read_file(const char* path, const char* kind, char** buffer, size_t* size)
+{
+	// Open file
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		printf("Failed to open %s file \"%s\"\n", kind, path);
+		return ERROR_FOPEN;
+	}
 	
-	// Free sequence
-	free_sequence(head);
+	// Allocate buffer
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	*buffer = malloc(*size + 1);
+	if (!*buffer)
+	{
+		printf("Failed to allocate memory\n");
+		fclose(file);
+		return ERROR_MEMORY;
+	}
+	(*buffer)[*size] = '\0';
 	
-	return EXIT_SUCCESS;
+	// Read file into buffer then close file
+	size_t read_bytes = fread(*buffer, 1, *size, file);
+	fclose(file);
+	
+	if (read_bytes != *size)
+	{
+		printf("Failed to read %s file \"%s\"\n", kind, path);
+		free(*buffer);
+		*buffer = 0;
+		return ERROR_FREAD;
+	}
+	
+	return 0;
 }
 
-void write_sequence_numbers(FILE* file, element_t* head)
+int read_source(const char* path, int operators_only, char** buffer, size_t* size)
 {
-	if (!head)
-		return;
+	// Files which cannot be mapped, such as empty files, are read instead
+	if (operators_only && !n_preprocess_file(path, 0, buffer, size))
+		return 0;
+	
+	return read_file(path, "source", buffer, size);
+}
+
+int run_batch(const char* path, n_program_t** programs, size_t program_count, int input_mode, int output_mode, n_limits_t limits, FILE* output_file)
+{
+	char* batch = 0;
+	size_t batch_size = 0;
+	int error = read_file(path, "batch", &batch, &batch_size);
+	if (error)
+		return error;
 	
-	element_t* element = head;
-	do
+	// Count lines, ignoring a final newline
+	size_t line_count = (batch_size && batch[batch_size - 1] != '\n');
+	for (size_t i = 0; i < batch_size; ++i)
+		line_count += (batch[i] == '\n');
+	
+	// Allocate storage for one chunk of lines, and an input sequence as long as the batch file
+	n_context_t** contexts = calloc(BATCH_CHUNK, sizeof(n_context_t*));
+	bignum_t** inputs = malloc(BATCH_CHUNK * sizeof(bignum_t*));
+	size_t* input_counts = malloc(BATCH_CHUNK * sizeof(size_t));
+	int* statuses = malloc(BATCH_CHUNK * sizeof(int));
+	bignum_t* elements = malloc((batch_size + 1) * sizeof(bignum_t));
+	int allocated = (contexts && inputs && input_counts && statuses && elements);
+	for (size_t i = 0; i < BATCH_CHUNK && allocated; ++i)
+	{
+		contexts[i] = n_context_create();
+		if (contexts[i])
+			contexts[i]->limits = limits;
+		else
+			allocated = 0;
+	}
+	
+	const char* line = batch;
+	const char* end = batch + batch_size;
+	for (size_t first_line = 0; first_line < line_count && allocated; first_line += BATCH_CHUNK)
 	{
-		fprintf(file, "%" PRIu64, element->value);
+		// Read input sequences of the chunk's lines
+		size_t chunk_count = (line_count - first_line < BATCH_CHUNK) ? line_count - first_line : BATCH_CHUNK;
+		size_t element_count = 0;
+		for (size_t i = 0; i < chunk_count; ++i)
+		{
+			const char* line_end = memchr(line, '\n', end - line);
+			if (!line_end)
+				line_end = end;
+			
+			inputs[i] = elements + element_count;
+			if (input_mode == MODE_NUMBERS)
+			{
+				for (const char* c = line; c < line_end;)
+				{
+					if (*c >= '0' && *c <= '9')
+						elements[element_count++] = strtoull(c, (char**)&c, 10);
+					else
+						++c;
+				}
+			}
+			else
+			{
+				for (const char* c = line; c < line_end; ++c)
+					elements[element_count++] = (bignum_t)(unsigned char)*c;
+			}
+			input_counts[i] = elements + element_count - inputs[i];
+			line = (line_end < end) ? line_end + 1 : end;
+		}
+		
+		// Run the first stage in lockstep, and the others on each line's result
+		n_batch_run(programs[0], contexts, (const bignum_t* const*)inputs, input_counts, chunk_count, statuses);
+		for (size_t i = 0; i < chunk_count; ++i)
+			for (size_t j = 1; j < program_count && statuses[i] == N_SUCCESS; ++j)
+				statuses[i] = n_context_chain(contexts[i], programs[j]);
 		
-		element = element->next;
-		if (element != head)
-			fprintf(file, " ");	
+		// Write one output sequence per line, or an empty line for failed runs
+		for (size_t i = 0; i < chunk_count; ++i)
+		{
+			size_t output_count;
+			if (statuses[i] == N_SUCCESS)
+			{
+				const bignum_t* output = n_context_result(contexts[i], &output_count);
+				if (output_mode == MODE_BYTES)
+					write_sequence_bytes(output_file, output, output_count);
+				else if (output_mode == MODE_WORDS)
+					write_sequence_words(output_file, output, output_count, output_word_size);
+				else
+					write_sequence_numbers(output_file, output, output_count);
+			}
+			else
+			{
+				const char* reason = "ran out of memory";
+				int line_error = ERROR_MEMORY;
+				if (statuses[i] == N_ERROR_STEP_LIMIT)
+				{
+					reason = "exceeded step limit";
+					line_error = ERROR_STEP_LIMIT;
+				}
+				else if (statuses[i] == N_ERROR_ELEMENT_LIMIT)
+				{
+					reason = "exceeded element limit";
+					line_error = ERROR_ELEMENT_LIMIT;
+				}
+				else if (statuses[i] == N_ERROR_TIME_LIMIT)
+				{
+					reason = "exceeded time limit";
+					line_error = ERROR_TIME_LIMIT;
+				}
+				fprintf(stderr, "Program %s on line %zu\n", reason, first_line + i + 1);
+				if (!error)
+					error = line_error;
+			}
+			fputc('\n', output_file);
+		}
+	}
+	
+	if (!allocated)
+	{
+		printf("Failed to allocate memory\n");
+		error = ERROR_MEMORY;
 	}
-	while (element != head);
+	
+	for (size_t i = 0; contexts && i < BATCH_CHUNK; ++i)
+		n_context_free(contexts[i]);
+	free(contexts);
+	free(inputs);
+	free(input_counts);
+	free(statuses);
+	free(elements);
+	free(batch);
+	
+	return error;
 }
 
-void write_sequence_bytes(FILE* file, element_t* head)
+void free_programs(n_program_t** programs, size_t program_count)
 {
-	if (!head)
+	if (!programs)
 		return;
+	for (size_t i = 0; i < program_count; ++i)
+		n_program_free(programs[i]);
+	free(programs);
+}
+
+void request_checkpoint(int signal_number)
+{
+	// Reinstall handler, for platforms which reset it before calling it
+	signal(signal_number, request_checkpoint);
 	
-	element_t* element = head;
-	do
+	checkpoint_requested = 1;
+	if (signal_number == SIGINT || signal_number == SIGTERM)
+		checkpoint_exit = 1;
+}
+
+void start_checkpoints(void)
+{
+	signal(SIGINT, request_checkpoint);
+	signal(SIGTERM, request_checkpoint);
+	#if defined(N_CHECKPOINT_ALARM)
+		signal(SIGUSR1, request_checkpoint);
+		signal(SIGALRM, request_checkpoint);
+		if (checkpoint_interval)
+			alarm(checkpoint_interval);
+	#endif
+}
+
+void write_sequence_numbers(FILE* file, const bignum_t* elements, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
 	{
-		if (element->value <= UINT8_MAX)
-			fwrite(&element->value, sizeof(uint8_t), 1, file);
-		else if (element->value <= UINT16_MAX)
-			fwrite(&element->value, sizeof(uint16_t), 1, file);
-		else if (element->value <= UINT32_MAX)
-			fwrite(&element->value, sizeof(uint32_t), 1, file);
-		else
-			fwrite(&element->value, sizeof(uint64_t), 1, file);
+		fprintf(file, "%" PRIu64, elements[i]);
 		
-		element = element->next;
+		if (i + 1 != count)
+			fprintf(file, " ");
 	}
-	while (element != head);
+}
+
+void write_sequence_bytes(FILE* file, const bignum_t* elements, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (elements[i] <= UINT8_MAX)
+			fwrite(&elements[i], sizeof(uint8_t), 1, file);
+		else if (elements[i] <= UINT16_MAX)
+			fwrite(&elements[i], sizeof(uint16_t), 1, file);
+		else if (elements[i] <= UINT32_MAX)
+			fwrite(&elements[i], sizeof(uint32_t), 1, file);
+		else
+			fwrite(&elements[i], sizeof(uint64_t), 1, file);
+	}
+}
+
+void write_sequence_words(FILE* file, const bignum_t* elements, size_t count, size_t word_size)
+{
+	if (count < 2)
+		return;
+	
+	size_t last_size = (elements[count - 1] < word_size) ? (size_t)elements[count - 1] : word_size;
+	unsigned char buffer[4096];
+	size_t length = 0;
+	for (size_t i = 0; i + 1 < count; ++i)
+	{
+		size_t size = (i + 2 == count) ? last_size : word_size;
+		for (size_t j = 0; j < size; ++j)
+			buffer[length++] = (unsigned char)(elements[i] >> (8 * j));
+		if (length > sizeof(buffer) - sizeof(bignum_t))
+		{
+			fwrite(buffer, 1, length, file);
+			length = 0;
+		}
+	}
+	fwrite(buffer, 1, length, file);
+}
+
+void write_bound(FILE* file, const char* key, uint64_t bound)
+{
+	if (bound == UINT64_MAX)
+		fprintf(file, "%s unbounded\n", key);
+	else
+		fprintf(file, "%s %" PRIu64 "\n", key, bound);
+}
+
+void write_growth(FILE* file, const char* key, int degree)
+{
+	if (degree == N_GROWTH_EXPONENTIAL)
+		fprintf(file, "%s exponential\n", key);
+	else if (!degree)
+		fprintf(file, "%s constant\n", key);
+	else
+		fprintf(file, "%s n^%d\n", key, degree);
+}
+
+void write_profile(const char* path, const n_profile_t* profile, const n_program_t* program, const char* source, size_t source_size)
+{
+	FILE* file = (strcmp(path, "-")) ? fopen(path, "wb") : stderr;
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open profile file \"%s\"\n", path);
+		return;
+	}
+	
+	if (n_profile_write_json(profile, program, source, source_size, file))
+		fprintf(stderr, "Failed to write profile\n");
+	
+	if (file != stderr)
+		fclose(file);
+}
+
+void write_samples(const char* path, const n_sampler_t* sampler, const n_program_t* program, const char* source, size_t source_size)
+{
+	FILE* file = (strcmp(path, "-")) ? fopen(path, "wb") : stderr;
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open sample file \"%s\"\n", path);
+		return;
+	}
+	
+	if (n_sampler_write_report(sampler, program, source, source_size, 20, file))
+		fprintf(stderr, "Failed to write sample report\n");
+	
+	if (file != stderr)
+		fclose(file);
 }
 
 void usage()
 {
-	printf("Usage: n <source file> [options] [first element] ... [nth element]\n");
+	printf("Usage: n <source file> [-t <source file>] ... [options] [first element] ... [nth element]\n");
 }
@@ -18,12 +18,98 @@
  */
 
 #include "preprocess.h"
+#include "cache.h"
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_PREPROCESS_SYSCONF
+	#include <unistd.h>
+#endif
+
+#if defined(N_PREPROCESS_THREADS)
+	#include <pthread.h>
+#endif
+
+// Classify characters a vector at a time where SIMD instructions are available
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define VECTOR_SIZE 32
+	#define VECTOR_MASK UINT32_C(0xFFFFFFFF)
+	typedef __m256i vector_t;
+	#define vector_load(input) _mm256_loadu_si256((const __m256i*)(input))
+	#define vector_match(vector, character) _mm256_cmpeq_epi8((vector), _mm256_set1_epi8(character))
+	#define vector_or(a, b) _mm256_or_si256((a), (b))
+	#define vector_bits(vector) (uint32_t)_mm256_movemask_epi8(vector)
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+	#define VECTOR_SIZE 16
+	#define VECTOR_MASK UINT32_C(0xFFFF)
+	typedef __m128i vector_t;
+	#define vector_load(input) _mm_loadu_si128((const __m128i*)(input))
+	#define vector_match(vector, character) _mm_cmpeq_epi8((vector), _mm_set1_epi8(character))
+	#define vector_or(a, b) _mm_or_si128((a), (b))
+	#define vector_bits(vector) (uint32_t)_mm_movemask_epi8(vector)
+#endif
+
+/// Minimum size of the chunk of a source file preprocessed by each thread, so that small sources are not split.
+#define MIN_THREAD_CHUNK_SIZE (16 << 20)
+
+/// Maximum number of threads which preprocess a source file.
+#define MAX_THREADS 64
+
+/// Chunk of a source file which is preprocessed by one thread.
+typedef struct chunk_t
+{
+	/// Start of the chunk.
+	const char* input;
+	
+	/// Size of the chunk, in bytes.
+	size_t size;
+	
+	/// Buffer which receives the operators of the chunk.
+	char* output;
+	
+	/// Number of operators in the chunk.
+	size_t length;
+	
+	/// Non-zero if the chunk contains a newline.
+	int newline;
+	
+	/// Non-zero if a comment is open at the end of the chunk, when none was open at its start.
+	int open;
+	
+	/// Non-zero if a comment is open at the start of the chunk.
+	int comment;
+	
+	#if defined(N_PREPROCESS_THREADS)
+		/// Thread which preprocesses the chunk.
+		pthread_t thread;
+		
+		/// Non-zero if the thread was started.
+		int started;
+	#endif
+	
+} chunk_t;
 
 void n_preprocess(char** source)
+{
+	// Compact operators in place, then release the rest of the buffer
+	n_preprocessor_t preprocessor = {0};
+	size_t length = n_preprocess_block(&preprocessor, *source, strlen(*source), *source);
+	(*source)[length] = '\0';
+	
+	char* operators = realloc(*source, length + 1);
+	if (operators)
+		*source = operators;
+}
+
+int n_preprocess_mapped(char** source, n_source_map_t* map)
 {
 	char* operators, *c;
 	size_t length = 0;
+	size_t line_count = 0;
+	int line_has_operators = 0;
 	
 	// Remove all comments and non-operator characters from source
 	for (c = *source; *c != '\0'; ++c)
@@ -40,6 +126,8 @@ void n_preprocess(char** source)
 			case '|':
 			case '#':
 				++length;
+				line_count += !line_has_operators;
+				line_has_operators = 1;
 				break;
 			
 			case ';':
@@ -48,15 +136,47 @@ void n_preprocess(char** source)
 				--c;
 				break;
 			
+			case '\n':
+				line_has_operators = 0;
+				if (map)
+					break;
+				// Fall through
+			
 			default:
 				*c = ' ';
 				break;
 		}
 	}
 	
+	// Allocate source map
+	if (map)
+	{
+		map->operator_count = length;
+		map->line_count = line_count;
+		map->columns = malloc((length + 1) * sizeof(uint32_t));
+		map->lines = malloc((line_count + 1) * sizeof(size_t));
+		map->line_operators = malloc((line_count + 1) * sizeof(size_t));
+		if (!map->columns || !map->lines || !map->line_operators)
+		{
+			n_source_map_free(map);
+			return -1;
+		}
+	}
+	
 	// Copy operators into new buffer
 	operators = malloc(length + 1);
+	if (!operators)
+	{
+		n_source_map_free(map);
+		return -1;
+	}
 	operators[length] = '\0';
+	
+	size_t index = 0;
+	size_t line = 1;
+	const char* line_start = *source;
+	line_count = 0;
+	line_has_operators = 0;
 	for (c = *source; *c != '\0'; ++c)
 	{
 		switch (*c)
@@ -64,16 +184,304 @@ void n_preprocess(char** source)
 			case ' ':
 				break;
 			
+			case '\n':
+				++line;
+				line_start = c + 1;
+				line_has_operators = 0;
+				break;
+			
 			default:
-				*(operators++) = *c;
+				if (map)
+				{
+					// Record the position of the operator, and of the first operator on each line
+					if (!line_has_operators)
+					{
+						map->lines[line_count] = line;
+						map->line_operators[line_count++] = index;
+						line_has_operators = 1;
+					}
+					map->columns[index] = (uint32_t)(c - line_start + 1);
+				}
+				operators[index++] = *c;
 				break;
 		}
 	}
-	operators -= length;
 	
 	// Free source buffer
 	free(*source);
 	
 	// Set source buffer to operator buffer
 	*source = operators;
+	
+	return 0;
+}
+
+#if defined(VECTOR_SIZE)
+	/// Classifies a vector of source characters, setting a bit for each of its operators, comment starts and newlines.
+	static inline void classify_vector(const char* input, uint32_t* operators, uint32_t* comments, uint32_t* newlines)
+	{
+		vector_t characters = vector_load(input);
+		vector_t matches = vector_or(vector_match(characters, '+'), vector_match(characters, '-'));
+		matches = vector_or(matches, vector_or(vector_match(characters, '>'), vector_match(characters, '<')));
+		matches = vector_or(matches, vector_or(vector_match(characters, '['), vector_match(characters, ']')));
+		matches = vector_or(matches, vector_or(vector_match(characters, ':'), vector_match(characters, '|')));
+		matches = vector_or(matches, vector_match(characters, '#'));
+		
+		*operators = vector_bits(matches);
+		*comments = vector_bits(vector_match(characters, ';'));
+		*newlines = vector_bits(vector_match(characters, '\n'));
+	}
+	
+	/// Copies the characters of a vector whose bits are set in a mask, and returns the number of characters copied. The output may overlap the vector, as long as it does not start after it.
+	static inline size_t copy_vector(const char* input, uint32_t mask, char* output)
+	{
+		if (mask == VECTOR_MASK)
+		{
+			memmove(output, input, VECTOR_SIZE);
+			return VECTOR_SIZE;
+		}
+		
+		size_t count = 0;
+		for (; mask; mask &= mask - 1)
+			output[count++] = input[__builtin_ctz(mask)];
+		return count;
+	}
+#endif
+
+size_t n_preprocess_block(n_preprocessor_t* preprocessor, const char* input, size_t size, char* output)
+{
+	size_t length = 0;
+	size_t i = 0;
+	int comment = preprocessor->comment;
+	
+	#if defined(VECTOR_SIZE)
+		for (; i + VECTOR_SIZE <= size; i += VECTOR_SIZE)
+		{
+			uint32_t operators, comments, newlines;
+			classify_vector(input + i, &operators, &comments, &newlines);
+			
+			// Alternate between comments and code within the vector, copying the operators of code
+			uint32_t remaining = VECTOR_MASK;
+			while (remaining)
+			{
+				if (comment)
+				{
+					// Skip the comment up to and including the end of its line
+					uint32_t end = newlines & remaining;
+					if (!end)
+						break;
+					end &= -end;
+					remaining &= ~(end | (end - 1));
+					comment = 0;
+				}
+				else
+				{
+					// Copy operators up to the start of the next comment
+					uint32_t start = comments & remaining;
+					uint32_t copied = operators & remaining;
+					if (start)
+					{
+						start &= -start;
+						copied &= start - 1;
+						remaining &= ~(start | (start - 1));
+						comment = 1;
+					}
+					else
+					{
+						remaining = 0;
+					}
+					length += copy_vector(input + i, copied, output + length);
+				}
+			}
+		}
+	#endif
+	
+	// Preprocess the remaining characters one at a time
+	for (; i < size; ++i)
+	{
+		// Skip comments up to the end of their line
+		if (comment)
+		{
+			comment = (input[i] != '\n');
+			continue;
+		}
+		
+		switch (input[i])
+		{
+			case '+':
+			case '-':
+			case '>':
+			case '<':
+			case '[':
+			case ']':
+			case ':':
+			case '|':
+			case '#':
+				output[length++] = input[i];
+				break;
+			
+			case ';':
+				comment = 1;
+				break;
+		}
+	}
+	
+	preprocessor->comment = comment;
+	return length;
+}
+
+/// Finds whether a chunk of a source file contains a newline, and whether a comment is open at its end when none was open at its start.
+static void* classify_chunk(void* data)
+{
+	chunk_t* chunk = data;
+	
+	// Only a comment started after the last newline is open at the end
+	if (!memchr(chunk->input, '\n', chunk->size))
+	{
+		chunk->newline = 0;
+		chunk->open = (memchr(chunk->input, ';', chunk->size) != 0);
+	}
+	else
+	{
+		const char* c = chunk->input + chunk->size;
+		chunk->newline = 1;
+		chunk->open = 0;
+		while (*--c != '\n')
+			chunk->open |= (*c == ';');
+	}
+	
+	return 0;
+}
+
+/// Preprocesses a chunk of a source file, starting inside a comment if the chunk splits one.
+static void* preprocess_chunk(void* data)
+{
+	chunk_t* chunk = data;
+	n_preprocessor_t preprocessor = {chunk->comment};
+	chunk->length = n_preprocess_block(&preprocessor, chunk->input, chunk->size, chunk->output);
+	return 0;
+}
+
+/// Runs a function on each chunk of a source file, in parallel where threads are available, running it on this thread for any chunk whose thread could not be started.
+static void run_chunks(chunk_t* chunks, size_t chunk_count, void* (*function)(void*))
+{
+	#if defined(N_PREPROCESS_THREADS)
+		for (size_t i = 1; i < chunk_count; ++i)
+			chunks[i].started = !pthread_create(&chunks[i].thread, 0, function, &chunks[i]);
+		function(&chunks[0]);
+		for (size_t i = 1; i < chunk_count; ++i)
+		{
+			if (chunks[i].started)
+				pthread_join(chunks[i].thread, 0);
+			else
+				function(&chunks[i]);
+		}
+	#else
+		for (size_t i = 0; i < chunk_count; ++i)
+			function(&chunks[i]);
+	#endif
+}
+
+int n_preprocess_file(const char* path, size_t thread_count, char** operators, size_t* length)
+{
+	// Map source file, which need not be copied since it is only read
+	size_t size = 0;
+	char* source = n_cache_map(path, &size);
+	if (!source)
+		return -1;
+	
+	char* output = malloc(size + 1);
+	if (!output)
+	{
+		n_cache_unmap(source, size);
+		return -1;
+	}
+	
+	// Choose the number of threads, giving each at least a minimum size of source
+	#if defined(N_PREPROCESS_THREADS)
+		#if defined(N_PREPROCESS_SYSCONF)
+			if (!thread_count)
+			{
+				long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+				thread_count = (processor_count > 0) ? (size_t)processor_count : 1;
+			}
+		#endif
+		if (thread_count > size / MIN_THREAD_CHUNK_SIZE)
+			thread_count = size / MIN_THREAD_CHUNK_SIZE;
+		if (thread_count > MAX_THREADS)
+			thread_count = MAX_THREADS;
+		if (!thread_count)
+			thread_count = 1;
+	#else
+		thread_count = 1;
+	#endif
+	
+	// Split the source into chunks, each of which writes its operators to the output at the offset of its source
+	chunk_t chunks[MAX_THREADS];
+	for (size_t i = 0; i < thread_count; ++i)
+	{
+		size_t start = size / thread_count * i;
+		size_t end = (i + 1 < thread_count) ? size / thread_count * (i + 1) : size;
+		chunks[i].input = source + start;
+		chunks[i].size = end - start;
+		chunks[i].output = output + start;
+	}
+	
+	// Find whether each chunk starts inside a comment, from the comments left open by the chunks before it, then preprocess the chunks
+	if (thread_count > 1)
+		run_chunks(chunks, thread_count, classify_chunk);
+	chunks[0].comment = 0;
+	for (size_t i = 1; i < thread_count; ++i)
+		chunks[i].comment = chunks[i - 1].open || (!chunks[i - 1].newline && chunks[i - 1].comment);
+	run_chunks(chunks, thread_count, preprocess_chunk);
+	n_cache_unmap(source, size);
+	
+	// Join the operators of each chunk
+	size_t total = chunks[0].length;
+	for (size_t i = 1; i < thread_count; ++i)
+	{
+		memmove(output + total, chunks[i].output, chunks[i].length);
+		total += chunks[i].length;
+	}
+	output[total] = '\0';
+	
+	// Release the rest of the output buffer
+	*operators = output;
+	char* shrunk_output = realloc(output, total + 1);
+	if (shrunk_output)
+		*operators = shrunk_output;
+	*length = total;
+	
+	return 0;
+}
+
+void n_source_map_find(const n_source_map_t* map, size_t index, size_t* line, size_t* column)
+{
+	// Find the last line whose first operator is not after the given operator
+	size_t first = 0;
+	size_t last = map->line_count;
+	while (last - first > 1)
+	{
+		size_t middle = first + (last - first) / 2;
+		if (map->line_operators[middle] <= index)
+			first = middle;
+		else
+			last = middle;
+	}
+	
+	*line = (map->line_count) ? map->lines[first] : 1;
+	*column = (index < map->operator_count) ? map->columns[index] : 1;
+}
+
+void n_source_map_free(n_source_map_t* map)
+{
+	if (!map)
+		return;
+	
+	free(map->columns);
+	free(map->lines);
+	free(map->line_operators);
+	map->columns = 0;
+	map->lines = 0;
+	map->line_operators = 0;
 }
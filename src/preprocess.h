@@ -20,11 +20,93 @@
 #ifndef N_PREPROCESS_H
 #define N_PREPROCESS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
- * Preprocesses an (N) program source, removing comments and non-operators.
+ * Map from the operators of a preprocessed (N) program to their positions in the original source code.
+ *
+ * The map stores a 32-bit column for each operator, and the index of the first operator on each line which contains operators, so positions are found by a binary search over lines.
+ */
+typedef struct n_source_map_t
+{
+	/// Number of mapped operators.
+	size_t operator_count;
+	
+	/// Column of each operator, starting from 1.
+	uint32_t* columns;
+	
+	/// Number of lines which contain operators.
+	size_t line_count;
+	
+	/// Line number of each line which contains operators, starting from 1.
+	size_t* lines;
+	
+	/// Index of the first operator on each line which contains operators.
+	size_t* line_operators;
+	
+} n_source_map_t;
+
+/// State of a preprocessor which reads (N) source in blocks, so that comments may span blocks.
+typedef struct n_preprocessor_t
+{
+	/// Non-zero if the last block ended inside a comment.
+	int comment;
+	
+} n_preprocessor_t;
+
+/**
+ * Preprocesses an (N) program source, removing comments and non-operators. Operators are compacted in place in a single pass, and the buffer is then shrunk to fit them.
  *
  * @param[in,out] (N) source code buffer.
  */
 void n_preprocess(char** source);
 
+/**
+ * Preprocesses an (N) program source, removing comments and non-operators, and maps each remaining operator to its position in the original source.
+ *
+ * @param[in,out] (N) source code buffer.
+ * @param[out] map Source map, which must be freed with `n_source_map_free()`.
+ *
+ * @return `0` on success, or `-1` if memory could not be allocated, in which case the source buffer is kept with its comments and non-operators blanked out.
+ */
+int n_preprocess_mapped(char** source, n_source_map_t* map);
+
+/**
+ * Preprocesses a block of (N) source, removing comments and non-operators, so that sources of any size can be preprocessed in bounded memory.
+ *
+ * @param preprocessor Preprocessor state, which must be zeroed before the first block.
+ * @param input Block of (N) source code.
+ * @param size Size of the block, in bytes.
+ * @param[out] output Buffer of at least `size` bytes, which receives the operators of the block and may be the same as `input`.
+ *
+ * @return Number of operators written to the output buffer.
+ */
+size_t n_preprocess_block(n_preprocessor_t* preprocessor, const char* input, size_t size, char* output);
+
+/**
+ * Preprocesses an (N) source file, removing comments and non-operators. The file is memory-mapped and read once, a vector of characters at a time where SIMD instructions are available, so only the operators are copied into memory. Large files are split into chunks which are preprocessed in parallel where threads are available, after a first parallel pass finds whether each chunk contains a newline and leaves a comment open, from which the comment state at the start of each chunk follows.
+ *
+ * @param path Path to the source file.
+ * @param thread_count Maximum number of threads, or `0` for one per processor.
+ * @param[out] operators Null-terminated buffer of the operators of the source, which must be freed with `free()`.
+ * @param[out] length Number of operators.
+ *
+ * @return `0` on success, or `-1` if the file could not be mapped, which includes empty files, or memory could not be allocated.
+ */
+int n_preprocess_file(const char* path, size_t thread_count, char** operators, size_t* length);
+
+/**
+ * Finds the position of an operator in the original source.
+ *
+ * @param map Source map.
+ * @param index Index of the operator in the preprocessed source.
+ * @param[out] line Line number of the operator, starting from 1.
+ * @param[out] column Column of the operator, starting from 1.
+ */
+void n_source_map_find(const n_source_map_t* map, size_t index, size_t* line, size_t* column);
+
+/// Deallocates the arrays of a source map.
+void n_source_map_free(n_source_map_t* map);
+
 #endif // N_PREPROCESS_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profile.h"
+#include <inttypes.h>
+#include <stdlib.h>
+
+/// Source characters of each opcode.
+static const char operator_names[] = "+-<>#:|[]";
+
+n_profile_t* n_profile_create(const n_program_t* program)
+{
+	n_profile_t* profile = malloc(sizeof(n_profile_t));
+	if (!profile)
+		return 0;
+	
+	size_t count = program->instruction_count + 1;
+	profile->instruction_count = program->instruction_count;
+	profile->counts = calloc(count, sizeof(uint64_t));
+	profile->skips = calloc(count, sizeof(uint64_t));
+	profile->max_trips = calloc(count, sizeof(bignum_t));
+	if (!profile->counts || !profile->skips || !profile->max_trips)
+	{
+		n_profile_free(profile);
+		return 0;
+	}
+	
+	return profile;
+}
+
+void n_profile_free(n_profile_t* profile)
+{
+	if (!profile)
+		return;
+	
+	free(profile->counts);
+	free(profile->skips);
+	free(profile->max_trips);
+	free(profile);
+}
+
+/// Returns the number of operators executed by an instruction, counting each repetition of a folded instruction.
+static uint64_t operator_count(const n_profile_t* profile, const n_instruction_t* instruction, size_t ip)
+{
+	if (instruction->opcode == N_OP_LOOP_START || instruction->opcode == N_OP_LOOP_END || instruction->opcode == N_OP_COUNT)
+		return profile->counts[ip];
+	return profile->counts[ip] * instruction->operand;
+}
+
+int n_profile_write_json(const n_profile_t* profile, const n_program_t* program, const char* source, size_t length, FILE* file)
+{
+	if (profile->instruction_count != program->instruction_count)
+		return -1;
+	
+	size_t* lines;
+	size_t* columns;
+	if (n_program_source_positions(source, length, &lines, &columns))
+		return -1;
+	
+	const n_instruction_t* instructions = program->instructions;
+	uint64_t steps = 0;
+	uint64_t operator_totals[sizeof(operator_names) - 1] = {0};
+	for (size_t ip = 0; ip < program->instruction_count; ++ip)
+	{
+		steps += profile->counts[ip];
+		operator_totals[instructions[ip].opcode] += operator_count(profile, &instructions[ip], ip);
+	}
+	
+	fprintf(file, "{\n\t\"instructions\": %" PRIu64 ",\n\t\"operators\": {", steps);
+	for (size_t i = 0; i < sizeof(operator_names) - 1; ++i)
+		fprintf(file, "%s\"%c\": %" PRIu64, (i) ? ", " : "", operator_names[i], operator_totals[i]);
+	fprintf(file, "},\n\t\"loops\": {");
+	
+	// Key each loop by the line and column of its start
+	int first = 1;
+	for (size_t ip = 0; ip < program->instruction_count; ++ip)
+	{
+		if (instructions[ip].opcode != N_OP_LOOP_START)
+			continue;
+		
+		// Unmatched loops run their body once, through to the end of the program
+		size_t end = instructions[ip].operand;
+		uint64_t entries = profile->counts[ip] - profile->skips[ip];
+		uint64_t trips = (end < program->instruction_count) ? profile->counts[end] : entries;
+		uint64_t operators = 0;
+		for (size_t i = ip + 1; i <= end && i < program->instruction_count; ++i)
+			operators += operator_count(profile, &instructions[i], i);
+		
+		fprintf(file, "%s\n\t\t\"%zu:%zu\": {\"entries\": %" PRIu64 ", \"skips\": %" PRIu64 ", \"trips\": %" PRIu64 ", \"max_trips\": %" PRIu64 ", \"operators\": %" PRIu64 "}",
+			(first) ? "" : ",", lines[ip], columns[ip], entries, profile->skips[ip], trips, profile->max_trips[ip], operators);
+		first = 0;
+	}
+	fprintf(file, "%s}\n}\n", (first) ? "" : "\n\t");
+	
+	free(lines);
+	free(columns);
+	return 0;
+}
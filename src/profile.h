@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_PROFILE_H
+#define N_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bignum.h"
+#include "program.h"
+
+/**
+ * Execution profile of a program, accumulated over every run of a context whose `profile` is set.
+ *
+ * Counts are recorded per compiled instruction, so runs of repeated operators are counted once per execution of their folded instruction. Contexts without a profile run a separate instantiation of the interpreter, so profiling has no cost when disabled.
+ */
+typedef struct n_profile_t
+{
+	/// Number of instructions in the profiled program.
+	size_t instruction_count;
+	
+	/// Number of times each instruction was executed.
+	uint64_t* counts;
+	
+	/// Number of times each loop start instruction skipped its loop.
+	uint64_t* skips;
+	
+	/// Largest trip count with which each loop start instruction entered its loop.
+	bignum_t* max_trips;
+	
+} n_profile_t;
+
+/**
+ * Creates an empty profile for a program.
+ *
+ * @return Profile, or `0` if memory could not be allocated.
+ */
+n_profile_t* n_profile_create(const n_program_t* program);
+
+/// Deallocates a profile.
+void n_profile_free(n_profile_t* profile);
+
+/**
+ * Writes a profile as JSON, with per-operator totals and per-loop statistics keyed by the source line and column of each loop.
+ *
+ * @param profile Profile of a program.
+ * @param program Profiled program.
+ * @param source (N) source code from which the program was compiled.
+ * @param length Length of the source code, in bytes.
+ * @param file File stream to write to.
+ *
+ * @return `0` on success, or `-1` if memory could not be allocated or the source does not match the program.
+ */
+int n_profile_write_json(const n_profile_t* profile, const n_program_t* program, const char* source, size_t length, FILE* file);
+
+#endif // N_PROFILE_H
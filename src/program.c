@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "program.h"
+#include "cache.h"
+#include "preprocess.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// Appends an instruction to a program, folding it into the previous instruction where possible. Changes to the folding must increment `N_CACHE_FORMAT`.
+static void emit_instruction(n_program_t* program, uint32_t opcode, bignum_t operand)
+{
+	n_instruction_t* previous = (program->instruction_count) ? &program->instructions[program->instruction_count - 1] : 0;
+	
+	if (previous && opcode != N_OP_LOOP_START && opcode != N_OP_LOOP_END)
+	{
+		// Fold repeated operators
+		if (previous->opcode == opcode)
+		{
+			previous->operand += operand;
+			return;
+		}
+		
+		// Cancel opposing shifts
+		if ((previous->opcode == N_OP_SHIFT_LEFT && opcode == N_OP_SHIFT_RIGHT) ||
+			(previous->opcode == N_OP_SHIFT_RIGHT && opcode == N_OP_SHIFT_LEFT))
+		{
+			if (previous->operand > operand)
+			{
+				previous->operand -= operand;
+			}
+			else if (previous->operand < operand)
+			{
+				previous->opcode = opcode;
+				previous->operand = operand - previous->operand;
+			}
+			else
+			{
+				--program->instruction_count;
+			}
+			return;
+		}
+	}
+	
+	n_instruction_t* instruction = &program->instructions[program->instruction_count++];
+	instruction->opcode = opcode;
+	instruction->operand = operand;
+}
+
+/**
+ * Compiles an (N) program.
+ *
+ * @param source (N) source code.
+ * @param length Length of the source code, in bytes.
+ * @param[out] offsets If not null, set to an array of the source offsets of each instruction's first operator.
+ */
+static n_program_t* compile(const char* source, size_t length, size_t** offsets)
+{
+	const char* end = source + length;
+	size_t operator_count = 0;
+	size_t loop_depth = 0;
+	size_t max_loop_depth = 0;
+	
+	// Count operators and max loop depth
+	for (const char* c = source; c != end; ++c)
+	{
+		switch (*c)
+		{
+			case '[':
+				max_loop_depth += (++loop_depth > max_loop_depth);
+				++operator_count;
+				break;
+			
+			case ']':
+				loop_depth -= !!loop_depth;
+				++operator_count;
+				break;
+			
+			case '+':
+			case '-':
+			case '>':
+			case '<':
+			case ':':
+			case '|':
+			case '#':
+				++operator_count;
+				break;
+			
+			case ';':
+				while (c + 1 != end && *(c + 1) != '\n')
+					++c;
+				break;
+		}
+	}
+	
+	// Allocate program
+	n_program_t* program = malloc(sizeof(n_program_t));
+	size_t* loop_starts = malloc((max_loop_depth + 1) * sizeof(size_t));
+	if (!program || !loop_starts)
+	{
+		free(program);
+		free(loop_starts);
+		return 0;
+	}
+	program->instructions = malloc((operator_count + 1) * sizeof(n_instruction_t));
+	program->instruction_count = 0;
+	program->max_loop_depth = max_loop_depth;
+	program->mapping = 0;
+	program->mapping_size = 0;
+	if (offsets)
+		*offsets = malloc((operator_count + 1) * sizeof(size_t));
+	if (!program->instructions || (offsets && !*offsets))
+	{
+		if (offsets)
+			free(*offsets);
+		free(program->instructions);
+		free(program);
+		free(loop_starts);
+		return 0;
+	}
+	
+	// Translate operators into instructions
+	loop_depth = 0;
+	for (const char* c = source; c != end; ++c)
+	{
+		size_t instruction_count = program->instruction_count;
+		
+		switch (*c)
+		{
+			case '+':
+				emit_instruction(program, N_OP_ADD, 1);
+				break;
+			
+			case '-':
+				emit_instruction(program, N_OP_SUB, 1);
+				break;
+			
+			case '<':
+				emit_instruction(program, N_OP_SHIFT_LEFT, 1);
+				break;
+			
+			case '>':
+				emit_instruction(program, N_OP_SHIFT_RIGHT, 1);
+				break;
+			
+			case '#':
+				emit_instruction(program, N_OP_COUNT, 1);
+				break;
+			
+			case ':':
+				emit_instruction(program, N_OP_APPEND, 1);
+				break;
+			
+			case '|':
+				emit_instruction(program, N_OP_TRUNCATE, 1);
+				break;
+			
+			case '[':
+				loop_starts[++loop_depth] = program->instruction_count;
+				emit_instruction(program, N_OP_LOOP_START, 1);
+				break;
+			
+			case ']':
+				// Unmatched loop ends are no-ops
+				if (loop_depth)
+				{
+					size_t start = loop_starts[loop_depth--];
+					program->instructions[start].operand = program->instruction_count;
+					emit_instruction(program, N_OP_LOOP_END, 1);
+					program->instructions[program->instruction_count - 1].operand = start;
+				}
+				break;
+			
+			case ';':
+				while (c + 1 != end && *(c + 1) != '\n')
+					++c;
+				break;
+		}
+		
+		// Record the offset of operators which began a new instruction
+		if (offsets && program->instruction_count > instruction_count)
+			(*offsets)[instruction_count] = c - source;
+	}
+	
+	// Unmatched loop starts skip to the end of the program
+	while (loop_depth)
+		program->instructions[loop_starts[loop_depth--]].operand = program->instruction_count;
+	
+	free(loop_starts);
+	
+	return program;
+}
+
+n_program_t* n_program_compile(const char* source, size_t length)
+{
+	return compile(source, length, 0);
+}
+
+int n_program_source_positions(const char* source, size_t length, size_t** lines, size_t** columns)
+{
+	// Preprocess a copy of the source, mapping each operator to its position
+	char* operators = malloc(length + 1);
+	if (!operators)
+		return -1;
+	memcpy(operators, source, length);
+	operators[length] = '\0';
+	n_source_map_t map;
+	if (n_preprocess_mapped(&operators, &map))
+	{
+		free(operators);
+		return -1;
+	}
+	
+	// Find the operator at which each instruction starts
+	size_t* offsets = 0;
+	n_program_t* program = compile(operators, map.operator_count, &offsets);
+	free(operators);
+	size_t instruction_count = (program) ? program->instruction_count : 0;
+	n_program_free(program);
+	*lines = malloc((instruction_count + 1) * sizeof(size_t));
+	*columns = malloc((instruction_count + 1) * sizeof(size_t));
+	if (!program || !*lines || !*columns)
+	{
+		n_source_map_free(&map);
+		free(offsets);
+		free(*lines);
+		free(*columns);
+		return -1;
+	}
+	
+	for (size_t ip = 0; ip < instruction_count; ++ip)
+		n_source_map_find(&map, offsets[ip], &(*lines)[ip], &(*columns)[ip]);
+	
+	n_source_map_free(&map);
+	free(offsets);
+	return 0;
+}
+
+/// Appends compiled instructions to a program, folding them into the previous instructions and matching their loops.
+static void append_instructions(n_program_t* program, const n_instruction_t* instructions, size_t count, size_t* loop_starts, size_t* loop_depth)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint32_t opcode = instructions[i].opcode;
+		if (opcode == N_OP_LOOP_START)
+		{
+			loop_starts[++*loop_depth] = program->instruction_count;
+			program->max_loop_depth += (*loop_depth > program->max_loop_depth);
+			emit_instruction(program, opcode, 0);
+		}
+		else if (opcode == N_OP_LOOP_END)
+		{
+			size_t start = loop_starts[(*loop_depth)--];
+			program->instructions[start].operand = program->instruction_count;
+			emit_instruction(program, opcode, start);
+		}
+		else
+		{
+			emit_instruction(program, opcode, instructions[i].operand);
+		}
+	}
+}
+
+/**
+ * Finds the last instruction of a program which clears the sequence to the zero singleton, with the idiom `#[|-]`, whenever the program is run. Everything the program does before it has no effect on the output.
+ *
+ * @return Index of the count instruction which starts the clear, or the number of instructions if there is none.
+ */
+static size_t find_clear(const n_program_t* program)
+{
+	const n_instruction_t* instructions = program->instructions;
+	size_t clear = program->instruction_count;
+	
+	for (size_t i = 0; i < program->instruction_count; ++i)
+	{
+		uint32_t opcode = instructions[i].opcode;
+		
+		// Instructions after an unmatched loop start may never run
+		if (opcode == N_OP_LOOP_START && instructions[i].operand >= program->instruction_count)
+			break;
+		
+		// A count followed by a loop which both truncates and decrements leaves only a zero
+		if (opcode == N_OP_COUNT && i + 4 < program->instruction_count &&
+			instructions[i + 1].opcode == N_OP_LOOP_START && instructions[i + 1].operand == i + 4 &&
+			instructions[i + 2].opcode != instructions[i + 3].opcode &&
+			(instructions[i + 2].opcode == N_OP_TRUNCATE || instructions[i + 2].opcode == N_OP_SUB) &&
+			(instructions[i + 3].opcode == N_OP_TRUNCATE || instructions[i + 3].opcode == N_OP_SUB))
+			clear = i;
+		
+		// Skip over loops, so that only clears at the top level are found
+		if (opcode == N_OP_LOOP_START)
+			i = instructions[i].operand;
+	}
+	
+	return clear;
+}
+
+n_program_t* n_program_fuse(const n_program_t* first, const n_program_t* second)
+{
+	// A clear in the second program makes the first dead, otherwise the first program must not end inside an unmatched loop
+	int first_dead = (find_clear(second) < second->instruction_count);
+	for (size_t i = 0; i < first->instruction_count && !first_dead; ++i)
+		if (first->instructions[i].opcode == N_OP_LOOP_START && first->instructions[i].operand >= first->instruction_count)
+			return 0;
+	
+	// Allocate program
+	n_program_t* program = malloc(sizeof(n_program_t));
+	size_t* loop_starts = malloc((first->max_loop_depth + second->max_loop_depth + 1) * sizeof(size_t));
+	if (!program || !loop_starts)
+	{
+		free(program);
+		free(loop_starts);
+		return 0;
+	}
+	program->instructions = malloc((first->instruction_count + second->instruction_count + 1) * sizeof(n_instruction_t));
+	program->instruction_count = 0;
+	program->max_loop_depth = 0;
+	program->mapping = 0;
+	program->mapping_size = 0;
+	if (!program->instructions)
+	{
+		free(program);
+		free(loop_starts);
+		return 0;
+	}
+	
+	// Concatenate instructions
+	size_t loop_depth = 0;
+	if (!first_dead)
+		append_instructions(program, first->instructions, first->instruction_count, loop_starts, &loop_depth);
+	append_instructions(program, second->instructions, second->instruction_count, loop_starts, &loop_depth);
+	while (loop_depth)
+		program->instructions[loop_starts[loop_depth--]].operand = program->instruction_count;
+	free(loop_starts);
+	
+	// Remove instructions before the last clear
+	size_t clear = find_clear(program);
+	if (clear && clear < program->instruction_count)
+	{
+		program->instruction_count -= clear;
+		memmove(program->instructions, program->instructions + clear, program->instruction_count * sizeof(n_instruction_t));
+		for (size_t i = 0; i < program->instruction_count; ++i)
+			if (program->instructions[i].opcode == N_OP_LOOP_START || program->instructions[i].opcode == N_OP_LOOP_END)
+				program->instructions[i].operand -= clear;
+	}
+	
+	return program;
+}
+
+void n_program_free(n_program_t* program)
+{
+	if (!program)
+		return;
+	
+	if (program->mapping)
+		n_cache_unmap(program->mapping, program->mapping_size);
+	else
+		free(program->instructions);
+	free(program);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_PROGRAM_H
+#define N_PROGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bignum.h"
+
+/// Opcodes of compiled (N) instructions.
+typedef enum n_opcode_t
+{
+	/// Adds the operand to the first element (`+`).
+	N_OP_ADD,
+	
+	/// Subtracts the operand from the first element, saturating at zero (`-`).
+	N_OP_SUB,
+	
+	/// Left circular shifts the sequence by the operand (`<`).
+	N_OP_SHIFT_LEFT,
+	
+	/// Right circular shifts the sequence by the operand (`>`).
+	N_OP_SHIFT_RIGHT,
+	
+	/// Sets the first element to the length of the sequence (`#`).
+	N_OP_COUNT,
+	
+	/// Appends the operand number of copies of the first element (`:`).
+	N_OP_APPEND,
+	
+	/// Removes up to the operand number of elements from the end of the sequence (`|`).
+	N_OP_TRUNCATE,
+	
+	/// Enters a loop, or jumps past the instruction indexed by the operand if the first element is zero (`[`).
+	N_OP_LOOP_START,
+	
+	/// Jumps back to the instruction following the loop start indexed by the operand while the loop counter is non-zero (`]`).
+	N_OP_LOOP_END
+	
+} n_opcode_t;
+
+/// Compiled (N) instruction.
+typedef struct n_instruction_t
+{
+	/// Instruction opcode.
+	uint32_t opcode;
+	
+	/// Repeat count of the instruction, or index of the matching loop instruction.
+	bignum_t operand;
+	
+} n_instruction_t;
+
+/// Immutable compiled (N) program, which may be shared between threads.
+typedef struct n_program_t
+{
+	/// Array of compiled instructions.
+	n_instruction_t* instructions;
+	
+	/// Number of compiled instructions.
+	size_t instruction_count;
+	
+	/// Maximum loop nesting depth of the program.
+	size_t max_loop_depth;
+	
+	/// Memory-mapped file containing the instructions, if the program was loaded from a cache.
+	void* mapping;
+	
+	/// Size of the memory-mapped file, in bytes.
+	size_t mapping_size;
+	
+} n_program_t;
+
+/**
+ * Compiles an (N) program. Comments and non-operator characters are ignored, runs of repeated operators are folded into single instructions, and loops are matched.
+ *
+ * @param source (N) source code.
+ * @param length Length of the source code, in bytes.
+ *
+ * @return Compiled program, or `0` if memory could not be allocated.
+ */
+n_program_t* n_program_compile(const char* source, size_t length);
+
+/**
+ * Finds the source position of each instruction of an (N) program, using the preprocessor's source map.
+ *
+ * @param source (N) source code, as passed to `n_program_compile()`.
+ * @param length Length of the source code, in bytes.
+ * @param[out] lines Array containing the line of the first operator of each instruction, starting from 1, which must be freed with `free()`.
+ * @param[out] columns Array containing the column of the first operator of each instruction, starting from 1, which must be freed with `free()`.
+ *
+ * @return `0` on success, or `-1` if memory could not be allocated.
+ */
+int n_program_source_positions(const char* source, size_t length, size_t** lines, size_t** columns);
+
+/**
+ * Fuses two compiled programs into one which has the same effect as running the first program and then running the second on its result.
+ *
+ * Instructions at the boundary are folded as in compilation, so that for example `+` followed by `+` becomes a single instruction, and opposing shifts such as `<` followed by `>` cancel. A top-level clear of the sequence with the idiom `#[|-]` makes everything before it dead, so such instructions are removed, which can reduce a pipeline whose later stage discards its input to that stage alone.
+ *
+ * @param first First program, which is run first.
+ * @param second Second program, which is run on the result of the first.
+ *
+ * @return Fused program, or `0` if memory could not be allocated or the first program contains an unmatched loop start, after which the second program could not simply be appended.
+ */
+n_program_t* n_program_fuse(const n_program_t* first, const n_program_t* second);
+
+/// Deallocates a compiled program.
+void n_program_free(n_program_t* program);
+
+#endif // N_PROGRAM_H
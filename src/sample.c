@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define _POSIX_C_SOURCE 199309L
+	#define N_SAMPLE_SIGPROF
+#endif
+
+#include "sample.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(N_SAMPLE_SIGPROF)
+	#include <signal.h>
+	#include <sys/time.h>
+#endif
+
+/// Maximum number of source characters printed for each line of a hot-spot report.
+#define MAX_REPORT_WIDTH 60
+
+/// Number of samples taken on a source line.
+typedef struct line_samples_t
+{
+	/// Line number.
+	size_t line;
+	
+	/// Number of samples.
+	uint64_t samples;
+	
+} line_samples_t;
+
+/// Sampler which is currently running, if any.
+static n_sampler_t* volatile active_sampler = 0;
+
+#if defined(N_SAMPLE_SIGPROF)
+	/// Action of `SIGPROF` before the running sampler was started, which is restored when it stops.
+	static struct sigaction previous_action;
+#endif
+
+n_sampler_t* n_sampler_create(const n_program_t* program, double interval)
+{
+	n_sampler_t* sampler = malloc(sizeof(n_sampler_t));
+	if (!sampler)
+		return 0;
+	
+	sampler->instruction_count = program->instruction_count;
+	sampler->samples = calloc(program->instruction_count + 1, sizeof(uint64_t));
+	sampler->sample_count = 0;
+	sampler->interval = interval;
+	sampler->ip = 0;
+	if (!sampler->samples)
+	{
+		free(sampler);
+		return 0;
+	}
+	
+	return sampler;
+}
+
+void n_sampler_free(n_sampler_t* sampler)
+{
+	if (!sampler)
+		return;
+	
+	n_sampler_stop(sampler);
+	free(sampler->samples);
+	free(sampler);
+}
+
+#if defined(N_SAMPLE_SIGPROF)
+	/// Records a sample of the running sampler's current instruction.
+	static void take_sample(int signal)
+	{
+		(void)signal;
+		n_sampler_t* sampler = active_sampler;
+		if (sampler)
+		{
+			++sampler->samples[sampler->ip];
+			++sampler->sample_count;
+		}
+	}
+#endif
+
+int n_sampler_start(n_sampler_t* sampler)
+{
+	#if defined(N_SAMPLE_SIGPROF)
+		if (active_sampler)
+			return -1;
+		
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = take_sample;
+		#if defined(SA_RESTART)
+			action.sa_flags = SA_RESTART;
+		#endif
+		sigemptyset(&action.sa_mask);
+		if (sigaction(SIGPROF, &action, &previous_action))
+			return -1;
+		
+		// Sample on a timer of the CPU time used by the process
+		struct itimerval timer;
+		timer.it_interval.tv_sec = (time_t)sampler->interval;
+		timer.it_interval.tv_usec = (suseconds_t)((sampler->interval - (double)timer.it_interval.tv_sec) * 1e6);
+		if (!timer.it_interval.tv_sec && !timer.it_interval.tv_usec)
+			timer.it_interval.tv_usec = 1;
+		timer.it_value = timer.it_interval;
+		
+		active_sampler = sampler;
+		if (setitimer(ITIMER_PROF, &timer, 0))
+		{
+			active_sampler = 0;
+			sigaction(SIGPROF, &previous_action, 0);
+			return -1;
+		}
+		
+		return 0;
+	#else
+		(void)sampler;
+		return -1;
+	#endif
+}
+
+void n_sampler_stop(n_sampler_t* sampler)
+{
+	#if defined(N_SAMPLE_SIGPROF)
+		if (active_sampler != sampler)
+			return;
+		
+		// Stop the timer, then restore the action which the sampler replaced
+		struct itimerval timer;
+		memset(&timer, 0, sizeof(timer));
+		setitimer(ITIMER_PROF, &timer, 0);
+		active_sampler = 0;
+		sigaction(SIGPROF, &previous_action, 0);
+	#else
+		(void)sampler;
+	#endif
+}
+
+/// Orders line samples by descending number of samples, then by line number.
+static int compare_line_samples(const void* a, const void* b)
+{
+	const line_samples_t* x = a;
+	const line_samples_t* y = b;
+	if (x->samples != y->samples)
+		return (x->samples < y->samples) ? 1 : -1;
+	return (x->line > y->line) - (x->line < y->line);
+}
+
+int n_sampler_write_report(const n_sampler_t* sampler, const n_program_t* program, const char* source, size_t length, size_t max_lines, FILE* file)
+{
+	if (sampler->instruction_count != program->instruction_count)
+		return -1;
+	
+	// Find the line at which each instruction starts
+	size_t* instruction_lines;
+	size_t* instruction_columns;
+	if (n_program_source_positions(source, length, &instruction_lines, &instruction_columns))
+		return -1;
+	
+	// Count source lines, and find where each begins
+	size_t line_count = 1;
+	for (size_t i = 0; i < length; ++i)
+		line_count += (source[i] == '\n');
+	size_t* line_starts = malloc((line_count + 1) * sizeof(size_t));
+	line_samples_t* lines = calloc(line_count + 1, sizeof(line_samples_t));
+	if (!line_starts || !lines)
+	{
+		free(instruction_lines);
+		free(instruction_columns);
+		free(line_starts);
+		free(lines);
+		return -1;
+	}
+	line_starts[1] = 0;
+	for (size_t i = 0, line = 1; i < length; ++i)
+		if (source[i] == '\n')
+			line_starts[++line] = i + 1;
+	
+	// Accumulate samples by line
+	for (size_t line = 0; line <= line_count; ++line)
+		lines[line].line = line;
+	for (size_t ip = 0; ip < program->instruction_count; ++ip)
+	{
+		if (!sampler->samples[ip])
+			continue;
+		lines[instruction_lines[ip]].samples += sampler->samples[ip];
+	}
+	qsort(lines, line_count + 1, sizeof(line_samples_t), compare_line_samples);
+	
+	fprintf(file, "%" PRIu64 " samples at %.3f ms intervals\n", sampler->sample_count, sampler->interval * 1e3);
+	for (size_t i = 0; i < max_lines && i <= line_count && lines[i].samples; ++i)
+	{
+		// Print the line without leading whitespace or its line ending
+		const char* text = source + line_starts[lines[i].line];
+		const char* end = source + length;
+		while (text != end && (*text == ' ' || *text == '\t'))
+			++text;
+		int width = 0;
+		while (text + width != end && text[width] != '\n' && text[width] != '\r' && width < MAX_REPORT_WIDTH)
+			++width;
+		
+		fprintf(file, "%6.2f%% %10" PRIu64 "  line %-6zu %.*s\n", 100.0 * (double)lines[i].samples / (double)sampler->sample_count, lines[i].samples, lines[i].line, width, text);
+	}
+	
+	free(instruction_lines);
+	free(instruction_columns);
+	free(line_starts);
+	free(lines);
+	return 0;
+}
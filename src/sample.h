@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_SAMPLE_H
+#define N_SAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "program.h"
+
+/**
+ * Sampling profiler, which periodically records the instruction being executed by a context whose `sampler` is set.
+ *
+ * Samples are taken by a `SIGPROF` interval timer, so only one sampler may be running in a process at a time, and sampling is only supported on POSIX systems. The interpreter publishes the index of each instruction before executing it, which costs one store per instruction while sampling, and nothing otherwise.
+ */
+typedef struct n_sampler_t
+{
+	/// Number of instructions in the sampled program.
+	size_t instruction_count;
+	
+	/// Number of samples taken of each instruction.
+	uint64_t* samples;
+	
+	/// Total number of samples taken.
+	uint64_t sample_count;
+	
+	/// Interval between samples, in seconds of CPU time.
+	double interval;
+	
+	/// Index of the instruction being executed.
+	volatile size_t ip;
+	
+} n_sampler_t;
+
+/**
+ * Creates a sampler for a program.
+ *
+ * @param program Program to be sampled.
+ * @param interval Interval between samples, in seconds of CPU time.
+ *
+ * @return Sampler, or `0` if memory could not be allocated.
+ */
+n_sampler_t* n_sampler_create(const n_program_t* program, double interval);
+
+/// Deallocates a sampler, stopping it if running.
+void n_sampler_free(n_sampler_t* sampler);
+
+/**
+ * Starts taking samples.
+ *
+ * @return `0` on success, or `-1` if sampling is not supported or another sampler is running.
+ */
+int n_sampler_start(n_sampler_t* sampler);
+
+/// Stops taking samples.
+void n_sampler_stop(n_sampler_t* sampler);
+
+/**
+ * Writes a hot-spot report of the source lines in which the most samples were taken, mapping instructions to lines with the preprocessor's source map.
+ *
+ * @param sampler Sampler of a program.
+ * @param program Sampled program.
+ * @param source (N) source code from which the program was compiled.
+ * @param length Length of the source code, in bytes.
+ * @param max_lines Maximum number of lines to report.
+ * @param file File stream to write to.
+ *
+ * @return `0` on success, or `-1` if memory could not be allocated or the source does not match the program.
+ */
+int n_sampler_write_report(const n_sampler_t* sampler, const n_program_t* program, const char* source, size_t length, size_t max_lines, FILE* file);
+
+#endif // N_SAMPLE_H
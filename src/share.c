@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "share.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define N_SHARE_MMAP
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+/// Smallest capacity of a shared input's ring buffer, which must be a power of two.
+#define MIN_CAPACITY 16
+
+n_shared_input_t* n_shared_input_create(const bignum_t* input, size_t input_count)
+{
+	static const bignum_t zero = 0;
+	if (!input_count)
+	{
+		input = &zero;
+		input_count = 1;
+	}
+	
+	n_shared_input_t* shared = calloc(1, sizeof(n_shared_input_t));
+	if (!shared)
+		return 0;
+	
+	shared->count = input_count;
+	shared->capacity = MIN_CAPACITY;
+	while (shared->capacity < input_count)
+		shared->capacity <<= 1;
+	
+	#if defined(N_SHARE_MMAP)
+		// Write the sequence to an unlinked temporary file, then extend it to the capacity of the ring buffer so that appends to the mapping stay within the file
+		shared->file = tmpfile();
+		if (shared->file &&
+			fwrite(input, sizeof(bignum_t), input_count, shared->file) == input_count &&
+			!fflush(shared->file) &&
+			!ftruncate(fileno(shared->file), (off_t)(shared->capacity * sizeof(bignum_t))))
+			return shared;
+		
+		if (shared->file)
+			fclose(shared->file);
+		free(shared);
+		return 0;
+	#else
+		shared->elements = malloc(input_count * sizeof(bignum_t));
+		if (!shared->elements)
+		{
+			free(shared);
+			return 0;
+		}
+		memcpy(shared->elements, input, input_count * sizeof(bignum_t));
+		return shared;
+	#endif
+}
+
+void n_shared_input_free(n_shared_input_t* input)
+{
+	if (!input)
+		return;
+	
+	if (input->file)
+		fclose(input->file);
+	free(input->elements);
+	free(input);
+}
+
+bignum_t* n_shared_input_map(const n_shared_input_t* input, size_t* size)
+{
+	*size = input->capacity * sizeof(bignum_t);
+	
+	#if defined(N_SHARE_MMAP)
+		// Private writable mappings copy pages on write, leaving the file and other mappings unchanged
+		void* mapping = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(input->file), 0);
+		return (mapping == MAP_FAILED) ? 0 : (bignum_t*)mapping;
+	#else
+		bignum_t* elements = malloc(*size);
+		if (elements)
+			memcpy(elements, input->elements, input->count * sizeof(bignum_t));
+		return elements;
+	#endif
+}
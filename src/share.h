@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_SHARE_H
+#define N_SHARE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "bignum.h"
+
+/**
+ * Input sequence which can be shared by runs of any number of programs, without each run copying it.
+ *
+ * The sequence is written once to a temporary file, which each run maps privately as its ring buffer. Pages of the file are only copied when a program writes to them, so runs use one copy of the input plus the pages they change. On platforms without memory mapping, each run copies the whole sequence.
+ */
+typedef struct n_shared_input_t
+{
+	/// Temporary file holding the sequence, padded to the capacity of the ring buffer, or `0` if the sequence is copied.
+	FILE* file;
+	
+	/// Sequence elements, if the sequence is copied rather than mapped.
+	bignum_t* elements;
+	
+	/// Number of elements in the sequence.
+	size_t count;
+	
+	/// Capacity of the ring buffer into which the sequence is mapped, in elements.
+	size_t capacity;
+	
+} n_shared_input_t;
+
+/**
+ * Creates a shared input sequence.
+ *
+ * @param input Array of input sequence elements. If empty, the input sequence will be the zero singleton.
+ * @param input_count Number of input sequence elements.
+ *
+ * @return Shared input sequence, or `0` if it could not be written or memory could not be allocated.
+ */
+n_shared_input_t* n_shared_input_create(const bignum_t* input, size_t input_count);
+
+/// Deallocates a shared input sequence. Runs which mapped it keep their own mappings.
+void n_shared_input_free(n_shared_input_t* input);
+
+/**
+ * Maps a shared input sequence into a new ring buffer, which starts with the sequence and must be unmapped with `n_cache_unmap()`.
+ *
+ * @param input Shared input sequence.
+ * @param[out] size Size of the mapping, in bytes.
+ *
+ * @return Pointer to the ring buffer, which holds `input->capacity` elements, or `0` if it could not be mapped.
+ */
+bignum_t* n_shared_input_map(const n_shared_input_t* input, size_t* size);
+
+#endif // N_SHARE_H
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+#include "cache.h"
+#include "memo.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <unistd.h>
+	#define N_SNAPSHOT_PID
+#endif
+
+/// Magic number at the start of snapshot files.
+static const char snapshot_magic[8] = {'(', 'N', ')', 'S', 'N', 'A', 'P', '\0'};
+
+/// Header of a snapshot file, which is followed by the loop counter stack, then the sequence starting from its first element.
+typedef struct snapshot_header_t
+{
+	/// Magic number identifying the file as a snapshot.
+	char magic[8];
+	
+	/// Hash of the compiled program.
+	uint64_t program_hash;
+	
+	/// Number of instructions executed.
+	uint64_t steps;
+	
+	/// Index of the next instruction to execute.
+	uint64_t ip;
+	
+	/// Number of loops entered.
+	uint64_t loop_depth;
+	
+	/// Number of elements in the sequence.
+	uint64_t count;
+	
+	/// Largest number of elements in the sequence so far.
+	uint64_t peak_count;
+	
+} snapshot_header_t;
+
+int n_context_save(const n_context_t* context, const n_program_t* program, const char* path)
+{
+	snapshot_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+	header.program_hash = n_program_hash(program);
+	header.steps = context->steps;
+	header.ip = context->ip;
+	header.loop_depth = context->loop_depth;
+	header.count = context->count;
+	header.peak_count = context->peak_count;
+	
+	// Build temporary file path
+	size_t path_length = strlen(path);
+	char* temporary_path = malloc(path_length + 32);
+	if (!temporary_path)
+		return -1;
+	#if defined(N_SNAPSHOT_PID)
+		sprintf(temporary_path, "%s.%ld.tmp", path, (long)getpid());
+	#else
+		sprintf(temporary_path, "%s.tmp", path);
+	#endif
+	
+	// Write header, loop counters and the sequence, which may wrap around the end of the ring buffer
+	size_t first_count = context->capacity - context->head;
+	if (first_count > context->count)
+		first_count = context->count;
+	size_t second_count = context->count - first_count;
+	FILE* file = fopen(temporary_path, "wb");
+	int result = -1;
+	if (file)
+	{
+		if (fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(context->loop_counters + 1, sizeof(bignum_t), context->loop_depth, file) == context->loop_depth &&
+			fwrite(context->elements + context->head, sizeof(bignum_t), first_count, file) == first_count &&
+			fwrite(context->elements, sizeof(bignum_t), second_count, file) == second_count)
+			result = 0;
+		if (fclose(file))
+			result = -1;
+		
+		// Replace snapshot file with temporary file
+		if (!result)
+		{
+			#if !defined(N_SNAPSHOT_PID)
+				remove(path);
+			#endif
+			result = rename(temporary_path, path) ? -1 : 0;
+		}
+		if (result)
+			remove(temporary_path);
+	}
+	
+	free(temporary_path);
+	return result;
+}
+
+int n_context_load(n_context_t* context, const n_program_t* program, const char* path)
+{
+	size_t size = 0;
+	void* mapping = n_cache_map(path, &size);
+	if (!mapping)
+		return N_ERROR_SNAPSHOT;
+	
+	// Validate header
+	const snapshot_header_t* header = mapping;
+	size_t word_count = (size - sizeof(snapshot_header_t)) / sizeof(bignum_t);
+	if (size < sizeof(snapshot_header_t) ||
+		memcmp(header->magic, snapshot_magic, sizeof(snapshot_magic)) ||
+		header->program_hash != n_program_hash(program) ||
+		header->ip > program->instruction_count ||
+		header->loop_depth > program->max_loop_depth ||
+		!header->count || header->count > word_count ||
+		size != sizeof(snapshot_header_t) + (header->loop_depth + header->count) * sizeof(bignum_t))
+	{
+		n_cache_unmap(mapping, size);
+		return N_ERROR_SNAPSHOT;
+	}
+	
+	// Grow loop counter stack and ring buffer
+	const bignum_t* loop_counters = (const bignum_t*)((const char*)mapping + sizeof(snapshot_header_t));
+	const bignum_t* elements = loop_counters + header->loop_depth;
+	context->count = 0;
+	context->head = 0;
+	int status = n_context_prepare(context, program, header->count);
+	if (status != N_SUCCESS)
+	{
+		n_cache_unmap(mapping, size);
+		return status;
+	}
+	
+	// Restore execution state
+	memcpy(context->loop_counters + 1, loop_counters, header->loop_depth * sizeof(bignum_t));
+	memcpy(context->elements, elements, header->count * sizeof(bignum_t));
+	context->count = header->count;
+	context->peak_count = (header->peak_count > header->count) ? header->peak_count : header->count;
+	context->steps = header->steps;
+	context->ip = header->ip;
+	context->loop_depth = header->loop_depth;
+	
+	n_cache_unmap(mapping, size);
+	return N_SUCCESS;
+}
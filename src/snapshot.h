@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_SNAPSHOT_H
+#define N_SNAPSHOT_H
+
+#include "context.h"
+#include "program.h"
+
+/**
+ * Writes a snapshot of a context stopped partway through a program, from which the program can later be resumed with `n_context_load()` and `n_context_resume()`.
+ *
+ * Snapshots hold the context's execution state, loop counter stack and sequence, laid out so that the file can be memory-mapped when loaded. They are written to a temporary file which then replaces the snapshot file, so an existing snapshot is never left partially written.
+ *
+ * @param context Execution context, stopped by `N_INTERRUPTED` or an execution limit.
+ * @param program Program the context was running.
+ * @param path Path to the snapshot file.
+ *
+ * @return `0` on success, `-1` otherwise.
+ */
+int n_context_save(const n_context_t* context, const n_program_t* program, const char* path);
+
+/**
+ * Restores a context from a snapshot.
+ *
+ * @param context Execution context.
+ * @param program Program the snapshot was taken of.
+ * @param path Path to the snapshot file.
+ *
+ * @return `N_SUCCESS`, `N_ERROR_MEMORY` if storage could not be allocated, or `N_ERROR_SNAPSHOT` if the file could not be read or was not taken of the given program.
+ */
+int n_context_load(n_context_t* context, const n_program_t* program, const char* path);
+
+#endif // N_SNAPSHOT_H
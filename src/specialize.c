@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "specialize.h"
+#include "clock.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// Source of an element whose value is known.
+#define CONSTANT SIZE_MAX
+
+/// Source of the element which stands for the unknown rest of an input sequence of unknown length.
+#define REST (SIZE_MAX - 1)
+
+/// Initial capacity of the abstract sequence.
+#define MIN_CAPACITY 16
+
+/// Number of evaluated instructions between checks of the time limit.
+#define CHECK_INTERVAL (1 << 20)
+
+#define STATUS_STATIC 0
+#define STATUS_DYNAMIC 1
+#define STATUS_STOPPED 2
+#define STATUS_MEMORY 3
+
+/// Abstract sequence, whose elements are either known values or unknown elements of the input, in a ring buffer with a power of two capacity.
+typedef struct state_t
+{
+	/// Values of known elements.
+	bignum_t* values;
+	
+	/// Index in the unknown elements of the input of each element, or `CONSTANT` if its value is known, or `REST`.
+	size_t* sources;
+	
+	/// Capacity of the ring buffer, in elements.
+	size_t capacity;
+	
+	/// Index of the first element in the ring buffer.
+	size_t head;
+	
+	/// Number of elements in the sequence.
+	size_t count;
+	
+	/// Non-zero if the number of elements is known, which is false while the sequence holds the rest of an input of unknown length.
+	int count_known;
+	
+	/// Number of evaluated instructions.
+	uint64_t steps;
+	
+	/// Limits of the evaluation, which are ignored while replaying instructions which are known to be static.
+	n_limits_t limits;
+	
+	/// Time at which the evaluation started.
+	double start_time;
+	
+} state_t;
+
+/// Growable text buffer of operators.
+typedef struct text_t
+{
+	/// Null-terminated operators.
+	char* data;
+	
+	/// Number of operators.
+	size_t length;
+	
+	/// Capacity of the buffer, excluding the null terminator.
+	size_t capacity;
+	
+	/// Non-zero if memory could not be allocated.
+	int error;
+	
+} text_t;
+
+/// Ensures an abstract sequence can hold a given number of elements, copying it to the start of a larger ring buffer if necessary.
+static int reserve(state_t* state, size_t count)
+{
+	if (count <= state->capacity)
+		return 0;
+	
+	size_t capacity = (state->capacity) ? state->capacity : MIN_CAPACITY;
+	while (capacity < count)
+		capacity <<= 1;
+	
+	bignum_t* values = malloc(capacity * sizeof(bignum_t));
+	size_t* sources = malloc(capacity * sizeof(size_t));
+	if (!values || !sources)
+	{
+		free(values);
+		free(sources);
+		return -1;
+	}
+	
+	size_t mask = state->capacity - 1;
+	for (size_t i = 0; i < state->count; ++i)
+	{
+		values[i] = state->values[(state->head + i) & mask];
+		sources[i] = state->sources[(state->head + i) & mask];
+	}
+	
+	free(state->values);
+	free(state->sources);
+	state->values = values;
+	state->sources = sources;
+	state->capacity = capacity;
+	state->head = 0;
+	
+	return 0;
+}
+
+/// Appends an element to an abstract sequence.
+static int push(state_t* state, size_t source, bignum_t value)
+{
+	if (reserve(state, state->count + 1))
+		return -1;
+	
+	size_t index = (state->head + state->count++) & (state->capacity - 1);
+	state->sources[index] = source;
+	state->values[index] = value;
+	
+	return 0;
+}
+
+/// Sets an abstract sequence to the input sequence, with the known elements and unknown elements numbered in order, and returns the number of unknown elements, or `SIZE_MAX` if the input exceeds the element limit or memory could not be allocated.
+static size_t load_input(state_t* state, const n_known_input_t* known)
+{
+	state->head = 0;
+	state->count = 0;
+	state->count_known = (known->count != N_UNKNOWN_COUNT);
+	state->steps = 0;
+	
+	// An empty input is the zero singleton
+	if (!known->count)
+		return (push(state, CONSTANT, 0)) ? SIZE_MAX : 0;
+	
+	// An input of unknown length is its known prefix followed by the rest
+	size_t count = known->count;
+	if (state->count_known && state->limits.max_elements && count > state->limits.max_elements)
+		return SIZE_MAX;
+	if (!state->count_known)
+		count = (known->known_count) ? known->positions[known->known_count - 1] + 1 : 0;
+	
+	size_t unknown_count = 0;
+	size_t k = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		while (k < known->known_count && known->positions[k] < i)
+			++k;
+		int error = (k < known->known_count && known->positions[k] == i) ? push(state, CONSTANT, known->values[k]) : push(state, unknown_count++, 0);
+		if (error)
+			return SIZE_MAX;
+	}
+	if (!state->count_known && push(state, REST, 0))
+		return SIZE_MAX;
+	
+	return unknown_count;
+}
+
+/// Rotates an abstract sequence left by an amount, or right if negative.
+static void rotate(state_t* state, bignum_t amount, int left)
+{
+	size_t mask = state->capacity - 1;
+	amount %= state->count;
+	if (state->count == state->capacity)
+	{
+		state->head = (left) ? (state->head + amount) & mask : (state->head - amount) & mask;
+		return;
+	}
+	
+	for (; amount; --amount)
+	{
+		if (left)
+		{
+			state->values[(state->head + state->count) & mask] = state->values[state->head];
+			state->sources[(state->head + state->count) & mask] = state->sources[state->head];
+			state->head = (state->head + 1) & mask;
+		}
+		else
+		{
+			state->head = (state->head - 1) & mask;
+			state->values[state->head] = state->values[(state->head + state->count) & mask];
+			state->sources[state->head] = state->sources[(state->head + state->count) & mask];
+		}
+	}
+}
+
+/// Counts an evaluated instruction, and returns whether a limit has been exceeded.
+static int exceeded(state_t* state)
+{
+	const n_limits_t* limits = &state->limits;
+	++state->steps;
+	if (limits->max_steps && state->steps > limits->max_steps)
+		return 1;
+	
+	return (limits->max_time > 0.0 && !(state->steps % CHECK_INTERVAL) && n_clock() - state->start_time >= limits->max_time);
+}
+
+/// Evaluates the instructions in a range, which contains only whole loops. Instructions are checked before they change the sequence, so the sequence is unchanged if the first instruction is not static.
+static int evaluate(state_t* state, const n_program_t* program, size_t first, size_t last)
+{
+	const n_instruction_t* instructions = program->instructions;
+	for (size_t ip = first; ip < last; ++ip)
+	{
+		if (exceeded(state))
+			return STATUS_STOPPED;
+		
+		bignum_t operand = instructions[ip].operand;
+		size_t head = state->head;
+		int head_known = (state->sources[head] == CONSTANT);
+		switch (instructions[ip].opcode)
+		{
+			case N_OP_ADD:
+				if (!head_known)
+					return STATUS_DYNAMIC;
+				state->values[head] += operand;
+				break;
+			
+			case N_OP_SUB:
+				if (!head_known)
+					return STATUS_DYNAMIC;
+				state->values[head] = (state->values[head] > operand) ? state->values[head] - operand : 0;
+				break;
+			
+			case N_OP_SHIFT_LEFT:
+			case N_OP_SHIFT_RIGHT:
+				if (!state->count_known)
+					return STATUS_DYNAMIC;
+				rotate(state, operand, instructions[ip].opcode == N_OP_SHIFT_LEFT);
+				break;
+			
+			case N_OP_COUNT:
+				if (!state->count_known)
+					return STATUS_DYNAMIC;
+				state->sources[head] = CONSTANT;
+				state->values[head] = state->count;
+				break;
+			
+			case N_OP_APPEND:
+			{
+				// Copies of unknown elements cannot be rebuilt from the unknown elements of the input
+				if (!head_known)
+					return STATUS_DYNAMIC;
+				size_t max_elements = state->limits.max_elements;
+				if (operand > SIZE_MAX / 2 - state->count || (max_elements && state->count + operand > max_elements))
+					return STATUS_STOPPED;
+				if (reserve(state, state->count + operand))
+					return STATUS_MEMORY;
+				bignum_t value = state->values[state->head];
+				for (; operand; --operand)
+					push(state, CONSTANT, value);
+				break;
+			}
+			
+			case N_OP_TRUNCATE:
+				if (!state->count_known)
+					return STATUS_DYNAMIC;
+				state->count -= (operand < state->count) ? operand : state->count - 1;
+				break;
+			
+			case N_OP_LOOP_START:
+			{
+				if (!head_known)
+					return STATUS_DYNAMIC;
+				
+				// The loop count is fixed when the loop is entered
+				size_t end = operand;
+				for (bignum_t trips = state->values[head]; trips; --trips)
+				{
+					int status = evaluate(state, program, ip + 1, end);
+					if (status == STATUS_STATIC && exceeded(state))
+						status = STATUS_STOPPED;
+					if (status != STATUS_STATIC)
+						return status;
+				}
+				ip = end;
+				break;
+			}
+		}
+	}
+	
+	return STATUS_STATIC;
+}
+
+/// Evaluates top-level instructions until one which is not static, or a given instruction, and returns its index. A top-level loop which is not static leaves the sequence as it was when the loop was reached, by replaying the static instructions before it.
+static size_t evaluate_top_level(state_t* state, const n_program_t* program, const n_known_input_t* known, size_t stop, int* status)
+{
+	const n_instruction_t* instructions = program->instructions;
+	size_t instruction_count = program->instruction_count;
+	size_t ip = 0;
+	*status = STATUS_STATIC;
+	while (ip < instruction_count && ip < stop)
+	{
+		const n_instruction_t* instruction = &instructions[ip];
+		if (instruction->opcode == N_OP_LOOP_START && instruction->operand == instruction_count)
+		{
+			// An unmatched loop runs the rest of the program once, or skips it
+			if (state->sources[state->head] != CONSTANT)
+				return ip;
+			if (exceeded(state))
+			{
+				*status = STATUS_STOPPED;
+				return ip;
+			}
+			ip = (state->values[state->head]) ? ip + 1 : instruction_count;
+			continue;
+		}
+		
+		size_t next = (instruction->opcode == N_OP_LOOP_START) ? (size_t)instruction->operand + 1 : ip + 1;
+		*status = evaluate(state, program, ip, next);
+		if (*status == STATUS_MEMORY)
+			return ip;
+		if (*status != STATUS_STATIC)
+		{
+			if (next > ip + 1)
+			{
+				// Replay up to the loop without limits, since everything before it is static
+				n_limits_t limits = state->limits;
+				int replay_status;
+				state->limits.max_steps = 0;
+				state->limits.max_elements = 0;
+				state->limits.max_time = 0.0;
+				if (load_input(state, known) == SIZE_MAX)
+					replay_status = STATUS_MEMORY;
+				else
+					evaluate_top_level(state, program, known, ip, &replay_status);
+				state->limits = limits;
+				if (replay_status == STATUS_MEMORY)
+					*status = STATUS_MEMORY;
+			}
+			return ip;
+		}
+		ip = next;
+	}
+	
+	return ip;
+}
+
+/// Appends an operator to a text buffer a number of times.
+static void append_operators(text_t* text, char op, bignum_t count)
+{
+	if (text->error || !count)
+		return;
+	
+	if (count > SIZE_MAX / 2 - text->length)
+	{
+		text->error = 1;
+		return;
+	}
+	if (text->length + count > text->capacity)
+	{
+		size_t capacity = (text->capacity) ? text->capacity : 256;
+		while (capacity < text->length + count)
+			capacity <<= 1;
+		char* data = realloc(text->data, capacity + 1);
+		if (!data)
+		{
+			text->error = 1;
+			return;
+		}
+		text->data = data;
+		text->capacity = capacity;
+	}
+	
+	memset(text->data + text->length, op, count);
+	text->length += count;
+	text->data[text->length] = '\0';
+}
+
+/// Appends a string of operators to a text buffer.
+static void append_string(text_t* text, const char* string)
+{
+	for (; *string; ++string)
+		append_operators(text, *string, 1);
+}
+
+/// Appends operators which set the first element to a value, by setting it to the sequence length and clearing it before building the value.
+static void append_constant(text_t* text, const n_constant_table_t* table, bignum_t value)
+{
+	append_string(text, "#[-]");
+	char* operators = n_constant_synthesize(table, value, 0);
+	if (!operators)
+	{
+		text->error = 1;
+		return;
+	}
+	append_string(text, operators);
+	free(operators);
+}
+
+/// Appends operators which rebuild an abstract sequence of known length from the unknown elements of the input. Each element is moved to the end in turn, unknown elements by shifting and known elements by appending a copy of the first element and replacing its value, and unused unknown elements are truncated.
+static void rebuild_known_count(text_t* text, const state_t* state, size_t unknown_count, const n_constant_table_t* table)
+{
+	// An input without unknown elements is the zero singleton, which is truncated
+	if (!unknown_count)
+		unknown_count = 1;
+	
+	size_t mask = state->capacity - 1;
+	size_t next = 0;
+	for (size_t i = 0; i < state->count; ++i)
+	{
+		if (state->sources[(state->head + i) & mask] != CONSTANT)
+		{
+			next = state->sources[(state->head + i) & mask];
+			break;
+		}
+	}
+	append_operators(text, '<', next);
+	
+	size_t remaining = unknown_count;
+	for (size_t i = 0; i < state->count; ++i)
+	{
+		size_t index = (state->head + i) & mask;
+		if (state->sources[index] == CONSTANT)
+		{
+			append_string(text, ":>");
+			append_constant(text, table, state->values[index]);
+			append_operators(text, '<', 1);
+			continue;
+		}
+		
+		for (; next != state->sources[index]; next = (next + 1) % unknown_count, --remaining)
+			append_string(text, "<|");
+		append_operators(text, '<', 1);
+		next = (next + 1) % unknown_count;
+		--remaining;
+	}
+	for (; remaining; --remaining)
+		append_string(text, "<|");
+}
+
+/// Appends operators which rebuild an abstract sequence holding the rest of an input of unknown length, from the unknown elements of the input. Appended known elements are rebuilt first, then the unknown elements of the prefix are shifted to the end so that the prefix can be rebuilt in reverse at the start.
+static void rebuild_unknown_count(text_t* text, const state_t* state, size_t unknown_count, const n_constant_table_t* table)
+{
+	size_t mask = state->capacity - 1;
+	size_t rest = 0;
+	while (state->sources[(state->head + rest) & mask] != REST)
+		++rest;
+	
+	for (size_t i = rest + 1; i < state->count; ++i)
+	{
+		append_string(text, ":>");
+		append_constant(text, table, state->values[(state->head + i) & mask]);
+		append_operators(text, '<', 1);
+	}
+	
+	append_operators(text, '<', unknown_count);
+	for (size_t i = rest; i--;)
+	{
+		size_t index = (state->head + i) & mask;
+		if (state->sources[index] == CONSTANT)
+		{
+			append_string(text, ":>");
+			append_constant(text, table, state->values[index]);
+		}
+		else
+		{
+			append_operators(text, '>', 1);
+		}
+	}
+}
+
+char* n_program_specialize(const n_program_t* program, const n_known_input_t* known, const n_constant_table_t* table, n_limits_t limits, size_t* length)
+{
+	state_t state = {0};
+	state.limits = limits;
+	if (!state.limits.max_steps)
+		state.limits.max_steps = N_SPECIALIZE_MAX_STEPS;
+	if (!state.limits.max_elements)
+		state.limits.max_elements = N_SPECIALIZE_MAX_ELEMENTS;
+	state.start_time = n_clock();
+	
+	text_t text = {0};
+	append_operators(&text, '+', 0);
+	
+	size_t unknown_count = load_input(&state, known);
+	int status = STATUS_MEMORY;
+	size_t stop = 0;
+	if (unknown_count != SIZE_MAX)
+		stop = evaluate_top_level(&state, program, known, SIZE_MAX, &status);
+	
+	if (status != STATUS_MEMORY)
+	{
+		// Rebuild the sequence at the first instruction which is not static, and continue with the rest of the program
+		if (state.count_known)
+			rebuild_known_count(&text, &state, unknown_count, table);
+		else
+			rebuild_unknown_count(&text, &state, unknown_count, table);
+		
+		static const char operators[] = "+-<>#:|[]";
+		const n_instruction_t* instructions = program->instructions;
+		for (size_t ip = stop; ip < program->instruction_count; ++ip)
+		{
+			int loop = (instructions[ip].opcode == N_OP_LOOP_START || instructions[ip].opcode == N_OP_LOOP_END);
+			append_operators(&text, operators[instructions[ip].opcode], (loop) ? 1 : instructions[ip].operand);
+		}
+	}
+	
+	free(state.values);
+	free(state.sources);
+	if (status == STATUS_MEMORY || text.error)
+	{
+		free(text.data);
+		return 0;
+	}
+	
+	// Allocate an empty program
+	if (!text.data)
+		text.data = calloc(1, 1);
+	if (length)
+		*length = text.length;
+	
+	return text.data;
+}
+
+size_t n_known_input_sort(size_t* positions, bignum_t* values, size_t known_count)
+{
+	// Stable insertion sort, since there are few known elements
+	for (size_t i = 1; i < known_count; ++i)
+	{
+		size_t position = positions[i];
+		bignum_t value = values[i];
+		size_t j = i;
+		for (; j && positions[j - 1] > position; --j)
+		{
+			positions[j] = positions[j - 1];
+			values[j] = values[j - 1];
+		}
+		positions[j] = position;
+		values[j] = value;
+	}
+	
+	size_t count = 0;
+	for (size_t i = 0; i < known_count; ++i)
+	{
+		if (count && positions[count - 1] == positions[i])
+			--count;
+		positions[count] = positions[i];
+		values[count++] = values[i];
+	}
+	
+	return count;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef N_SPECIALIZE_H
+#define N_SPECIALIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bignum.h"
+#include "constant.h"
+#include "context.h"
+#include "program.h"
+
+/// Sequence length which marks the length of an input sequence as unknown.
+#define N_UNKNOWN_COUNT SIZE_MAX
+
+/// Number of instructions which are evaluated by `n_program_specialize()` when the limits have no step limit.
+#define N_SPECIALIZE_MAX_STEPS (UINT64_C(1) << 30)
+
+/// Number of elements to which the sequence may grow during `n_program_specialize()` when the limits have no element limit.
+#define N_SPECIALIZE_MAX_ELEMENTS ((size_t)1 << 20)
+
+/// Known part of an input sequence, against which a program is specialized.
+typedef struct n_known_input_t
+{
+	/// Number of elements of the input sequence, or `N_UNKNOWN_COUNT`. A count of zero is the zero singleton.
+	size_t count;
+	
+	/// Positions of the known elements, in increasing order.
+	const size_t* positions;
+	
+	/// Values of the known elements.
+	const bignum_t* values;
+	
+	/// Number of known elements.
+	size_t known_count;
+	
+} n_known_input_t;
+
+/**
+ * Specializes a program against a partly known input sequence, producing a residual program which takes only the unknown elements of the input, in order, and has the same output as the original program given the whole input.
+ *
+ * The program is evaluated on the known elements and length until it reaches a top-level instruction which depends on an unknown element, or on the length if it is unknown, or until a limit is exceeded. Top-level loops are evaluated whole or not at all. The residual program rebuilds the sequence at that point from the unknown elements, with constants synthesized for the known elements, followed by the rest of the program.
+ *
+ * If the length is unknown, the known elements must be at the start of the input sequence, and the residual program must be given at least one element, since an empty input would be the zero singleton.
+ *
+ * @param program Compiled program.
+ * @param known Known part of the input sequence. Known elements at positions past a known length are ignored.
+ * @param table Constant table, with which known elements are synthesized.
+ * @param limits Limits of the evaluation, where the time limit is measured from the start of the evaluation, and `N_SPECIALIZE_MAX_STEPS` and `N_SPECIALIZE_MAX_ELEMENTS` apply if there is no step or element limit.
+ * @param[out] length Number of operators of the residual program, or `0` to ignore.
+ *
+ * @return Null-terminated source of the residual program, which must be freed with `free()`, or `0` if the input sequence exceeds the element limit or memory could not be allocated.
+ */
+char* n_program_specialize(const n_program_t* program, const n_known_input_t* known, const n_constant_table_t* table, n_limits_t limits, size_t* length);
+
+/**
+ * Sorts known elements by position, keeping the last value given for each position.
+ *
+ * @param positions Positions of the known elements.
+ * @param values Values of the known elements.
+ * @param known_count Number of known elements.
+ *
+ * @return Number of known elements with distinct positions.
+ */
+size_t n_known_input_sort(size_t* positions, bignum_t* values, size_t known_count);
+
+#endif // N_SPECIALIZE_H
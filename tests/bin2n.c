@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of bin2n.
+ *
+ * bin2n is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bin2n is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bin2n.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bin2n.h"
+#include "n.h"
+
+/// Size of the inputs which span more than one chunk of bin2n.
+#define LARGE_INPUT_SIZE (600 * 1024)
+
+/// Returns a pseudorandom number, so that inputs are the same on every run.
+static uint32_t next_random(uint32_t* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+/// Returns the length of the program which builds each byte as a separate element, either in a preallocated element or as a copy of the previous byte, which is what bin2n writes without runs or repeated blocks.
+static size_t plain_length(const unsigned char* input, size_t size)
+{
+	size_t slot_count = 0;
+	size_t length = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		size_t slot = bin2n_lengths[input[i]] + 2;
+		size_t delta = ((input[i] > input[i - !!i]) ? input[i] - input[i - !!i] : input[i - !!i] - input[i]) + 3;
+		if (i && delta < slot)
+		{
+			length += delta;
+		}
+		else
+		{
+			length += slot - 1;
+			++slot_count;
+		}
+	}
+	
+	return strlen(bin2n_clear_sequence) + slot_count - 1 + length;
+}
+
+/// Converts an input with bin2n, then checks that the program is no longer than the plain encoding and builds the input. Returns zero on success.
+static int check_input(const char* bin2n, const char* name, const unsigned char* input, size_t size, const char* options)
+{
+	// Convert input
+	char command[4096];
+	FILE* file = fopen("bin2n-test.bin", "wb");
+	if (!file || fwrite(input, 1, size, file) != size || fclose(file))
+	{
+		printf("%s: failed to write input\n", name);
+		return 1;
+	}
+	snprintf(command, sizeof(command), "\"%s\" bin2n-test.bin bin2n-test.n %s", bin2n, options);
+	if (system(command))
+	{
+		printf("%s: bin2n failed\n", name);
+		return 1;
+	}
+	
+	// Read program
+	file = fopen("bin2n-test.n", "rb");
+	if (!file)
+	{
+		printf("%s: failed to read program\n", name);
+		return 1;
+	}
+	fseek(file, 0, SEEK_END);
+	size_t length = ftell(file);
+	rewind(file);
+	char* source = malloc(length + 1);
+	if (!source || fread(source, 1, length, file) != length)
+	{
+		printf("%s: failed to read program\n", name);
+		free(source);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	
+	// Runs and repeated blocks are only built by loops which save operators
+	int failed = 0;
+	size_t plain = plain_length(input, size);
+	if (length > plain)
+	{
+		printf("%s: program of %zu operators is longer than the plain encoding of %zu\n", name, length, plain);
+		failed = 1;
+	}
+	
+	// Run program, which must build the input
+	n_program_t* program = n_program_compile(source, length);
+	n_context_t* context = n_context_create();
+	free(source);
+	if (!program || !context || n_context_run(context, program, 0, 0) != N_SUCCESS)
+	{
+		printf("%s: failed to run program\n", name);
+		failed = 1;
+	}
+	else
+	{
+		size_t count;
+		const bignum_t* output = n_context_result(context, &count);
+		size_t i = 0;
+		while (i < size && i < count && output[i] == input[i])
+			++i;
+		if (count != size || i != size)
+		{
+			printf("%s: program builds %zu elements which differ from the input of %zu bytes at %zu\n", name, count, size, i);
+			failed = 1;
+		}
+	}
+	n_program_free(program);
+	n_context_free(context);
+	
+	return failed;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("Usage: test-bin2n <bin2n>\n");
+		return EXIT_FAILURE;
+	}
+	
+	unsigned char* input = malloc(LARGE_INPUT_SIZE);
+	if (!input)
+		return EXIT_FAILURE;
+	
+	int failed = 0;
+	uint32_t state = 1;
+	
+	// Random bytes, which have no runs or repeated blocks
+	for (size_t i = 0; i < 4096; ++i)
+		input[i] = (unsigned char)next_random(&state);
+	failed |= check_input(argv[1], "random", input, 4096, "");
+	
+	// Runs of every length up to beyond the longest run of copies appended at once
+	size_t size = 0;
+	for (size_t length = 1; length <= 200; ++length)
+		for (size_t i = 0; i < length; ++i)
+			input[size++] = (unsigned char)(length * 37);
+	failed |= check_input(argv[1], "runs", input, size, "");
+	
+	// Blocks of every period repeated a few times, whose words differ by small and large amounts, so that loop bodies both adjust and rebuild copies
+	size = 0;
+	for (size_t period = 2; period <= 70; ++period)
+	{
+		unsigned char block[70];
+		for (size_t i = 0; i < period; ++i)
+			block[i] = (unsigned char)((i % 3) ? next_random(&state) : next_random(&state) % 8 + 100);
+		for (size_t repeat = 2 + period % 4; repeat; --repeat)
+		{
+			memcpy(input + size, block, period);
+			size += period;
+		}
+	}
+	failed |= check_input(argv[1], "blocks", input, size, "");
+	
+	// Short blocks repeated only a few times, as the only loops of their programs, whose savings are close to the cost of the loop and its counter
+	for (size_t i = 0; i < 500; ++i)
+	{
+		size_t period = next_random(&state) % 5 + 2;
+		size_t repeat = next_random(&state) % 2 + 2;
+		unsigned char block[6];
+		for (size_t j = 0; j < period; ++j)
+		{
+			uint32_t kind = next_random(&state) % 3;
+			block[j] = (unsigned char)((kind == 0) ? next_random(&state) : (kind == 1) ? next_random(&state) % 21 : next_random(&state) % 41 + 100);
+		}
+		size = 0;
+		input[size++] = (unsigned char)next_random(&state);
+		for (; repeat; --repeat)
+		{
+			memcpy(input + size, block, period);
+			size += period;
+		}
+		failed |= check_input(argv[1], "short blocks", input, size, "");
+	}
+	
+	// Repeated blocks of random bytes, spanning several chunks converted by separate threads
+	size = 0;
+	while (size < LARGE_INPUT_SIZE)
+	{
+		size_t period = next_random(&state) % 64 + 1;
+		size_t repeat = next_random(&state) % 8 + 1;
+		unsigned char block[64];
+		for (size_t i = 0; i < period; ++i)
+			block[i] = (unsigned char)next_random(&state);
+		for (; repeat && size + period <= LARGE_INPUT_SIZE; --repeat)
+		{
+			memcpy(input + size, block, period);
+			size += period;
+		}
+		if (size + period > LARGE_INPUT_SIZE)
+			break;
+	}
+	failed |= check_input(argv[1], "chunks", input, size, "--threads 3");
+	
+	remove("bin2n-test.bin");
+	remove("bin2n-test.n");
+	free(input);
+	
+	return (failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2020  Christopher J. Howard
+ *
+ * This file is part of nterpreter.
+ *
+ * nterpreter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nterpreter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nterpreter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "n.h"
+
+/// Size of the test sources, which are split into chunks for at least four threads.
+#define SOURCE_SIZE ((size_t)66 << 20)
+
+/// Number of threads compared with one thread.
+#define THREAD_COUNT 4
+
+/// Finds the operators of a source one character at a time, as the original preprocessor did, independently of the vectorized preprocessor. Returns the number of operators.
+static size_t find_operators(const char* source, size_t size, char* operators)
+{
+	size_t length = 0;
+	int comment = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (comment)
+		{
+			comment = (source[i] != '\n');
+			continue;
+		}
+		
+		switch (source[i])
+		{
+			case '+':
+			case '-':
+			case '>':
+			case '<':
+			case '[':
+			case ']':
+			case ':':
+			case '|':
+			case '#':
+				operators[length++] = source[i];
+				break;
+			
+			case ';':
+				comment = 1;
+				break;
+		}
+	}
+	return length;
+}
+
+/// Preprocesses a source in memory, and as a file with one thread and with several, and checks that each gives the operators of the source. Returns zero on success.
+static int check_source(const char* name, const char* source, size_t size)
+{
+	FILE* file = fopen("preprocess-test.n", "wb");
+	if (!file || fwrite(source, 1, size, file) != size || fclose(file))
+	{
+		printf("%s: failed to write source\n", name);
+		return 1;
+	}
+	
+	char* expected = malloc(size + 1);
+	char* block = malloc(size + 1);
+	if (!expected || !block)
+		return 1;
+	size_t expected_length = find_operators(source, size, expected);
+	
+	// Preprocess the source in memory, as one block
+	int failed = 0;
+	n_preprocessor_t preprocessor = {0};
+	size_t block_length = n_preprocess_block(&preprocessor, source, size, block);
+	if (block_length != expected_length || memcmp(block, expected, block_length))
+	{
+		printf("%s: %zu operators of one block differ from the %zu operators of the source\n", name, block_length, expected_length);
+		failed = 1;
+	}
+	free(block);
+	
+	size_t thread_counts[2] = {1, THREAD_COUNT};
+	for (size_t i = 0; i < 2; ++i)
+	{
+		char* operators;
+		size_t length;
+		double start_time = n_clock();
+		if (n_preprocess_file("preprocess-test.n", thread_counts[i], &operators, &length))
+		{
+			printf("%s: failed to preprocess with %zu threads\n", name, thread_counts[i]);
+			failed = 1;
+			continue;
+		}
+		double time = n_clock() - start_time;
+		
+		if (length != expected_length || memcmp(operators, expected, length) || operators[length])
+		{
+			printf("%s: %zu operators with %zu threads differ from the %zu operators of the source\n", name, length, thread_counts[i], expected_length);
+			failed = 1;
+		}
+		printf("%s: %zu operators with %zu threads in %.3f seconds\n", name, length, thread_counts[i], time);
+		free(operators);
+	}
+	
+	free(expected);
+	remove("preprocess-test.n");
+	return failed;
+}
+
+int main(void)
+{
+	char* source = malloc(SOURCE_SIZE);
+	if (!source)
+		return EXIT_FAILURE;
+	
+	// Operators without newlines or comments, as written by bin2n
+	static const char operators[] = "+-<>[]:|#";
+	for (size_t i = 0; i < SOURCE_SIZE; ++i)
+		source[i] = operators[(i * 7 + i / 13) % 9];
+	int failed = check_source("no newlines", source, SOURCE_SIZE);
+	
+	// A comment which spans whole chunks, ended by the only newline, then a comment left open at the end
+	source[SOURCE_SIZE / 10] = ';';
+	source[SOURCE_SIZE / 10 * 6] = '\n';
+	source[SOURCE_SIZE / 10 * 9] = ';';
+	failed |= check_source("comments across chunks", source, SOURCE_SIZE);
+	
+	// Comments started and ended by the last character of a vector, of any vector size up to 64
+	for (size_t i = 0; i + 4096 < SOURCE_SIZE; i += 4096)
+	{
+		source[i + 63] = ';';
+		source[i + 64 * 17 + 63] = '\n';
+		source[i + 64 * 40 + 63] = ';';
+		source[i + 64 * 40 + 64] = '\n';
+	}
+	failed |= check_source("vector ends", source, SOURCE_SIZE);
+	
+	// Comments started and ended on either side of the boundaries between the chunks of each thread
+	size_t chunk_size = SOURCE_SIZE / THREAD_COUNT;
+	source[chunk_size - 1] = ';';
+	source[chunk_size + 100] = '\n';
+	source[chunk_size * 2 - 50] = ';';
+	source[chunk_size * 2 - 1] = '\n';
+	source[chunk_size * 3] = ';';
+	source[chunk_size * 3 + 1] = '\n';
+	failed |= check_source("chunk boundaries", source, SOURCE_SIZE);
+	
+	// Short commented lines
+	for (size_t i = 0; i < SOURCE_SIZE; i += 61)
+	{
+		source[i] = '\n';
+		if (i + 40 < SOURCE_SIZE)
+			source[i + 40] = ';';
+	}
+	failed |= check_source("lines", source, SOURCE_SIZE);
+	
+	free(source);
+	return (failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}